@@ -155,6 +155,7 @@ Calibrator::Calibrator()
     d->model       = new QStandardItemModel(this);
     d->modelHelper = new CalibratorModelHelper(d->model, this);
     d->markerTiler = new KGeoMap::ItemMarkerTiler(d->modelHelper, this);
+    d->markerTiler->setMaxLevel(KGeoMap::TileIndex::MaxLevel);
 
     QVBoxLayout* const vboxLayout1 = new QVBoxLayout();
     QWidget* const dummy1          = new QWidget(this);
@@ -22,10 +22,14 @@
 var mapDiv;
 var map;
 var eventBuffer = new Array();
+var eventNotificationPending = false;
+// of these events, only the most recent one of a batch is kept:
+var coalescedEventTypes = { 'id': true, 'MB': true, 'ZC': true, 'MT': true };
 var markerList = new Object();
 var clusterList = new Object();
 var clusterDataList = new Object();
 var trackList = new Array();
+var tracksVisible = true;
 var isInEditMode = false;
 var dragMarker;
 var dragSnappingToMid = -1;
@@ -45,24 +49,52 @@ ProjectionHelper.prototype = new google.maps.OverlayView();
 ProjectionHelper.prototype.draw = function() { }
 var projectionHelper = null;
 
-function kgeomapPostEventString(eventString)
+function kgeomapPostEvent(eventType, eventParameters)
 {
-    eventBuffer.push(eventString);
-    window.status = '(event)';
+    // events are arrays holding the type and the parameters of the event
+    var event = [eventType].concat(eventParameters || []);
+    if (coalescedEventTypes[eventType])
+    {
+        for (var i = 0; i < eventBuffer.length; ++i)
+        {
+            if (eventBuffer[i][0] == eventType)
+            {
+                eventBuffer.splice(i, 1);
+                break;
+            }
+        }
+    }
+    eventBuffer.push(event);
+
+    // notify the application at most once per frame:
+    if (!eventNotificationPending)
+    {
+        eventNotificationPending = true;
+        window.setTimeout(kgeomapNotifyEvents, 16);
+    }
 }
 
-function kgeomapReadEventStrings()
+function kgeomapNotifyEvents()
 {
-    var eventBufferString = eventBuffer.join('|');
+    eventNotificationPending = false;
+    if (eventBuffer.length > 0)
+    {
+        window.status = '(event)';
+    }
+}
+
+function kgeomapReadEvents()
+{
+    var events = eventBuffer;
     eventBuffer = new Array();
     // let the application know that there are no more events waiting:
     window.status = '()';
-    return eventBufferString;
+    return events;
 }
 
 function kgeomapDebugOut(someString)
 {
-    kgeomapPostEventString('do'+someString);
+    kgeomapPostEvent('do', [someString]);
 }
 
 function kgeomapSetZoom(zoomvalue)
@@ -227,6 +259,27 @@ function kgeomapClearTracks()
     return true;
 }
 
+function kgeomapSetTracksVisible(state)
+{
+    tracksVisible = state;
+    for (var i in trackList) {
+        trackList[i].track.setMap(state ? map : null);
+    }
+}
+
+function kgeomapSetTrackColor(tid, trackColor)
+{
+    var trackIndex = kgeomapGetTrackIndex(tid);
+    if (trackIndex<0)
+    {
+        return false;
+    }
+
+    trackList[trackIndex].track.setOptions({ strokeColor: trackColor });
+
+    return true;
+}
+
 function kgeomapGetTrackIndex(tid)
 {
     for (var i=0; i<trackList.length; ++i)
@@ -276,7 +329,28 @@ function kgeomapCreateTrack(tid, trackColor)
     return trackList.length-1;
 }
 
-function kgeomapAddToTrack(tid, coordString)
+function kgeomapDecodeCoordinates(packedCoordinates)
+{
+    // packedCoordinates is a base64 string of little-endian 32 bit integers, holding
+    // latitude and longitude of each point in units of 1e-7 degrees
+    var bytes = atob(packedCoordinates);
+    var byteArray = new Uint8Array(bytes.length);
+    for (var i = 0; i < bytes.length; ++i)
+    {
+        byteArray[i] = bytes.charCodeAt(i);
+    }
+
+    var dataView = new DataView(byteArray.buffer);
+    var coordinates = new Float64Array(Math.floor(byteArray.length/4));
+    for (var i = 0; i < coordinates.length; ++i)
+    {
+        coordinates[i] = dataView.getInt32(i*4, true) / 1e7;
+    }
+
+    return coordinates;
+}
+
+function kgeomapAddToTrack(tid, packedCoordinates)
 {
     var trackIndex = kgeomapGetTrackIndex(tid);
     if (trackIndex<0)
@@ -290,20 +364,13 @@ function kgeomapAddToTrack(tid, coordString)
     track.setMap(null);
 
     var trackCoordinates = track.getPath();
-//     for (var i = 0; i < coordString.length; i+=2)
-//     {
-//         var cLat = coordString[i];
-//         var cLon = coordString[i+1];
-//         trackCoordinates.push(new google.maps.LatLng(cLat,cLon));
-//     }
-    var coordArray = JSON.parse(coordString);
-    for (var i = 0; i < coordArray.length; ++i)
-    {
-        var coord = coordArray[i];
-        trackCoordinates.push(new google.maps.LatLng(coord.lat,coord.lon));
+    var coordinates = kgeomapDecodeCoordinates(packedCoordinates);
+    for (var i = 0; i+1 < coordinates.length; i+=2)
+    {
+        trackCoordinates.push(new google.maps.LatLng(coordinates[i], coordinates[i+1]));
     }
     track.setPath(trackCoordinates);
-    track.setMap(map);
+    track.setMap(tracksVisible ? map : null);
     trackList[trackIndex].track = track;
 
     return true;
@@ -331,7 +398,7 @@ function kgeomapAddMarker(mid, id, lat, lon, setDraggable, setSnaps)
 
     google.maps.event.addListener(marker, 'dragend', function()
         {
-            kgeomapPostEventString('mm'+id.toString());
+            kgeomapPostEvent('mm', [mid, id]);
         });
     if (!markerList[mid])
     {
@@ -343,6 +410,15 @@ function kgeomapAddMarker(mid, id, lat, lon, setDraggable, setSnaps)
         };
 }
 
+function kgeomapAddMarkers(mid, markerData)
+{
+    // markerData holds five values per marker: id, lat, lon, draggable, snaps
+    for (var i = 0; i+4 < markerData.length; i+=5)
+    {
+        kgeomapAddMarker(mid, markerData[i], markerData[i+1], markerData[i+2], markerData[i+3]!=0, markerData[i+4]!=0);
+    }
+}
+
 function kgeomapGetMarkerPosition(mid,id)
 {
     var latlngString;
@@ -397,6 +473,16 @@ function kgeomapGetPixmapName(markerCount, markerSelectedCount)
     return colorCode;
 }
 
+function kgeomapGetClusterIcon(markerCount, markerSelectedCount)
+{
+    var colorCode = kgeomapGetPixmapName(markerCount, markerSelectedCount);
+    if (isInEditMode)
+    {
+        return new google.maps.MarkerImage('marker-'+colorCode+'.png', new google.maps.Size(20, 32));
+    }
+    return new google.maps.MarkerImage('cluster-circle-'+colorCode+'.png', new google.maps.Size(30, 30), new google.maps.Point(0,0), new google.maps.Point(15, 15));
+}
+
 function kgeomapSetClusterPixmap(id, pixmapWidth, pixmapHeight, xOffset, yOffset, pixmapurl)
 {
     var pixmapSize = new google.maps.Size(pixmapWidth, pixmapHeight);
@@ -406,18 +492,28 @@ function kgeomapSetClusterPixmap(id, pixmapWidth, pixmapHeight, xOffset, yOffset
     clusterList[id].setIcon(markerImage);
 }
 
-function kgeomapAddCluster(id, lat, lon, setDraggable, markerCount, markerSelectedCount)
+function kgeomapSetClusterPixmaps(atlasUrl, atlasTable)
 {
-    var latlng = new google.maps.LatLng(lat, lon);
-    var clusterIcon;
-    var colorCode = kgeomapGetPixmapName(markerCount, markerSelectedCount);
-    if (isInEditMode)
+    // atlasTable holds seven values per cluster: id, position of the pixmap in the atlas,
+    // size of the pixmap and its anchor point
+    for (var i = 0; i+6 < atlasTable.length; i+=7)
     {
-        clusterIcon = new google.maps.MarkerImage('marker-'+colorCode+'.png', new google.maps.Size(20, 32));
-    } else
-    {
-        clusterIcon = new google.maps.MarkerImage('cluster-circle-'+colorCode+'.png', new google.maps.Size(30, 30), new google.maps.Point(0,0), new google.maps.Point(15, 15));
+        var id = atlasTable[i];
+        if (!clusterList[id])
+        {
+            continue;
+        }
+        var pixmapSize = new google.maps.Size(atlasTable[i+3], atlasTable[i+4]);
+        var pixmapOrigin = new google.maps.Point(atlasTable[i+1], atlasTable[i+2]);
+        var anchorPoint = new google.maps.Point(atlasTable[i+5], atlasTable[i+6]);
+        clusterList[id].setIcon(new google.maps.MarkerImage(atlasUrl, pixmapSize, pixmapOrigin, anchorPoint));
     }
+}
+
+function kgeomapAddCluster(id, lat, lon, setDraggable, markerCount, markerSelectedCount)
+{
+    var latlng = new google.maps.LatLng(lat, lon);
+    var clusterIcon = kgeomapGetClusterIcon(markerCount, markerSelectedCount);
     var marker = new google.maps.Marker({
             position: latlng,
             map: map,
@@ -472,7 +568,7 @@ function kgeomapAddCluster(id, lat, lon, setDraggable, markerCount, markerSelect
                 var colorCode = kgeomapGetPixmapName(leftOverMarkerCount, 0);
                 var clusterIcon = new google.maps.MarkerImage('marker-'+colorCode+'.png', new google.maps.Size(20, 32));
                 var leftOverMarker = new google.maps.Marker({
-                        position: latlng,
+                        position: marker.getPosition(),
                         map: map,
                         icon: clusterIcon,
                         title: leftOverMarkerCount.toString(),
@@ -526,16 +622,16 @@ function kgeomapAddCluster(id, lat, lon, setDraggable, markerCount, markerSelect
         {
             if (dragSnappingToMid>=0)
             {
-                kgeomapPostEventString('cs'+id.toString()+'/'+dragSnappingToMid.toString()+'/'+dragSnappingToId.toString());
+                kgeomapPostEvent('cs', [id, parseInt(dragSnappingToMid), parseInt(dragSnappingToId)]);
             }
             else
             {
-                kgeomapPostEventString('cm'+id.toString());
+                kgeomapPostEvent('cm', [id]);
             }
         });
     google.maps.event.addListener(marker, 'click', function()
         {
-            kgeomapPostEventString('cc'+id.toString());
+            kgeomapPostEvent('cc', [id]);
         });
     
     clusterList[id] = marker;
@@ -545,6 +641,48 @@ function kgeomapAddCluster(id, lat, lon, setDraggable, markerCount, markerSelect
     clusterDataList[id]=clusterData;
 }
 
+function kgeomapAddClusters(clusterData)
+{
+    // clusterData holds five values per cluster: id, lat, lon, markerCount, markerSelectedCount
+    for (var i = 0; i+4 < clusterData.length; i+=5)
+    {
+        kgeomapAddCluster(clusterData[i], clusterData[i+1], clusterData[i+2], isInEditMode, clusterData[i+3], clusterData[i+4]);
+    }
+}
+
+function kgeomapUpdateClusters(clusterData)
+{
+    // clusterData holds five values per cluster, as for kgeomapAddClusters
+    for (var i = 0; i+4 < clusterData.length; i+=5)
+    {
+        var id = clusterData[i];
+        if (!clusterList[id])
+        {
+            continue;
+        }
+        var markerCount = clusterData[i+3];
+        var markerSelectedCount = clusterData[i+4];
+        clusterList[id].setPosition(new google.maps.LatLng(clusterData[i+1], clusterData[i+2]));
+        clusterList[id].setIcon(kgeomapGetClusterIcon(markerCount, markerSelectedCount));
+        clusterDataList[id]["MarkerCount"]=markerCount;
+        clusterDataList[id]["MarkerSelectedCount"]=markerSelectedCount;
+    }
+}
+
+function kgeomapRemoveClusters(clusterIds)
+{
+    for (var i = 0; i < clusterIds.length; ++i)
+    {
+        var id = clusterIds[i];
+        if (clusterList[id])
+        {
+            clusterList[id].setMap(null);
+            delete clusterList[id];
+            delete clusterDataList[id];
+        }
+    }
+}
+
 function kgeomapGetClusterPosition(id)
 {
     var latlngString;
@@ -748,7 +886,7 @@ function kgeomapInitialize()
     map = new google.maps.Map(mapDiv, myOptions);
     google.maps.event.addListener(map, 'maptypeid_changed', function()
         {
-            kgeomapPostEventString('MT'+kgeomapGetMapType());
+            kgeomapPostEvent('MT', [kgeomapGetMapType()]);
         });
 
     //google.maps.event.clearListeners(map, 'dragstart');
@@ -758,14 +896,14 @@ function kgeomapInitialize()
 
     //  these are too heavy on the performance. monitor 'idle' event only for now:
     //       google.maps.event.addListener(map, 'bounds_changed', function() {
-    //           kgeomapPostEventString('MB');
+    //           kgeomapPostEvent('MB');
     //       });
     //       google.maps.event.addListener(map, 'zoom_changed', function() {
-    //           kgeomapPostEventString('ZC');
+    //           kgeomapPostEvent('ZC');
     //       });
     google.maps.event.addListener(map, 'idle', function()
         {
-            kgeomapPostEventString('id');
+            kgeomapPostEvent('id');
         });
     // source: http://taapps-javalibs.blogspot.com/2009/10/google-map-v3how-to-use-overlayviews.html
     projectionHelper = new ProjectionHelper(map);
@@ -1,7 +1,7 @@
 /* ============================================================
  *
  * Date        : 2010-02-05
- * Description : JavaScript part of the OpenStreetMap-backend for WorldMapWidget2
+ * Description : JavaScript part of the OpenStreetMap-backend for KGeoMap
  *
  * Copyright (C) 2010, 2011 by Michael G. Hansen <mike at mghansen dot de>
  *
@@ -20,46 +20,74 @@
 var mapDiv;
 var map;
 var mapLayer;
+var navigationControl;
 var eventBuffer = new Array();
+var eventNotificationPending = false;
+// of these events, only the most recent one of a batch is kept:
+var coalescedEventTypes = { 'id': true, 'MB': true, 'ZC': true, 'MT': true };
 var markerList = new Object();
 var clusterList = new Object();
 var vectorLayerMarkers;
-var layerColors = Array('ff0000', 'ff7f00', 'ffff00', '00ff00', '00ffff');
-for (var layerColorIndex in layerColors) {
-    eval('var vectorLayersClusters'+layerColors[layerColorIndex]+';');
-}
+var vectorLayerClusters;
+var vectorLayerSelection;
+var selectionRectangle;
+var temporarySelectionRectangle;
+var isInEditMode = false;
+var clusterDragMoved = false;
+var projectionWGS84;
 
 function kgeomapLonLat2Projection(lonLat) {
-    return lonLat.transform(new OpenLayers.Projection('EPSG:4326'), map.getProjectionObject());
+    return lonLat.transform(projectionWGS84, map.getProjectionObject());
 }
 function kgeomapLonLatFromProjection(lonLat) {
-    return lonLat.clone().transform(map.getProjectionObject(), new OpenLayers.Projection('EPSG:4326'));
+    return lonLat.clone().transform(map.getProjectionObject(), projectionWGS84);
 }
 function kgeomapLonLat2String(lonLat) {
     return lonLat.lat.toString()+','+lonLat.lon.toString();
 }
-function kgeomapProjectedLonLat2String(lonLat) {
-    var myLonLat = kgeomapLonLatFromProjection(lonLat);
-    return kgeomapLonLat2String(myLonLat);
+function kgeomapPostEvent(eventType, eventParameters) {
+    // events are arrays holding the type and the parameters of the event
+    var event = [eventType].concat(eventParameters || []);
+    if (coalescedEventTypes[eventType]) {
+        for (var i = 0; i < eventBuffer.length; ++i) {
+            if (eventBuffer[i][0] == eventType) {
+                eventBuffer.splice(i, 1);
+                break;
+            }
+        }
+    }
+    eventBuffer.push(event);
+    // notify the application at most once per frame:
+    if (!eventNotificationPending) {
+        eventNotificationPending = true;
+        window.setTimeout(kgeomapNotifyEvents, 16);
+    }
 }
-function kgeomapPostEventString(eventString) {
-    eventBuffer.push(eventString);
-    window.status = '(event)';
+function kgeomapNotifyEvents() {
+    eventNotificationPending = false;
+    if (eventBuffer.length > 0) {
+        window.status = '(event)';
+    }
 }
-function kgeomapReadEventStrings() {
-    var eventBufferString = eventBuffer.join('|');
+function kgeomapReadEvents() {
+    var events = eventBuffer;
     eventBuffer = new Array();
     // let the application know that there are no more events waiting:
     window.status = '()';
-    return eventBufferString;
+    return events;
 }
 function kgeomapDebugOut(someString) {
     if (typeof kgeomapDebugHook == 'function') {
         kgeomapDebugHook(someString);
     } else {
-        kgeomapPostEventString('do'+someString);
+        kgeomapPostEvent('do', [someString]);
     }
 }
+function kgeomapSetTileUrl(tileUrl) {
+    // tileUrl is a template like 'kgeomaptile:/${z}/${x}/${y}', which the application resolves
+    mapLayer.setUrl(tileUrl);
+    mapLayer.redraw();
+}
 function kgeomapSetZoom(zoomvalue) {
     map.zoomTo(zoomvalue);
 }
@@ -74,153 +102,276 @@ function kgeomapZoomOut() {
 }
 function kgeomapSetCenter(lat, lon) {
     var lonLat = new OpenLayers.LonLat(lon, lat);
-    map.setCenter(kgeomapLonLat2Projection(lonLat), 2);
+    map.setCenter(kgeomapLonLat2Projection(lonLat));
 }
 function kgeomapGetCenter() {
     var lonLat = kgeomapLonLatFromProjection(map.getCenter());
     return kgeomapLonLat2String(lonLat);
 }
-function kgeomapGetBounds() {
-    var mapBounds = mapLayer.getExtent();
-    mapBounds.transform(map.getProjectionObject(),new OpenLayers.Projection('EPSG:4326'));
-
-    return '(('+mapBounds.bottom+','+mapBounds.left+'),('+mapBounds.top+','+mapBounds.right+'))';
+function kgeomapGetMapState() {
+    // everything the application needs to project coordinates itself: zoom, lat, lon
+    var lonLat = kgeomapLonLatFromProjection(map.getCenter());
+    return [map.getZoom(), lonLat.lat, lonLat.lon];
+}
+function kgeomapSetIsInEditMode(state) {
+    isInEditMode = state;
 }
 function kgeomapLatLngToPixel(lat, lon) {
-    // TODO: do we need to transform the lonlat???
     var myPixel = map.getPixelFromLonLat(kgeomapLonLat2Projection(new OpenLayers.LonLat(lon, lat)));
     return '('+myPixel.x.toString()+','+myPixel.y.toString()+')';
 }
 function kgeomapPixelToLatLng(x, y) {
-    // TODO: do we need to transform the lonlat???
     var myLonLat = kgeomapLonLatFromProjection(map.getLonLatFromPixel(new OpenLayers.Pixel(x, y)));
     return kgeomapLonLat2String(myLonLat);
 }
-function kgeomapClearMarkers() {
-    for (var i in markerList) {
-        vectorLayerMarkers.removeFeatures(markerList[i]);
-        markerList[i].destroy();
-    }
-    markerList = new Object();
-}
-function kgeomapGetMapBounds() {
-}
-function kgeomapAddMarker(id, lat, lon, setDraggable) {
+function kgeomapCreatePointFeature(lat, lon, kgeomapId) {
     var projectedLonLat = kgeomapLonLat2Projection(new OpenLayers.LonLat(lon, lat));
-
-    var myVectorMarker = new OpenLayers.Feature.Vector(
+    var feature = new OpenLayers.Feature.Vector(
             new OpenLayers.Geometry.Point(projectedLonLat.lon, projectedLonLat.lat)
         );
-    vectorLayerMarkers.addFeatures(myVectorMarker);
-    markerList[id.toString()] = myVectorMarker;
+    feature.kgeomapId = kgeomapId;
+    return feature;
+}
+function kgeomapGetFeaturePosition(feature) {
+    var lonLat = kgeomapLonLatFromProjection(new OpenLayers.LonLat(feature.geometry.x, feature.geometry.y));
+    return kgeomapLonLat2String(lonLat);
 }
-function kgeomapGetMarkerPosition(id) {
+function kgeomapSetFeaturePixmap(feature, pixmapWidth, pixmapHeight, xOffset, yOffset, pixmapurl) {
+    feature.style = {
+        externalGraphic: pixmapurl,
+        graphicWidth: pixmapWidth,
+        graphicHeight: pixmapHeight,
+        graphicXOffset: -xOffset,
+        graphicYOffset: -yOffset
+    };
+}
+function kgeomapClearMarkers(mid) {
+    if (markerList[mid]) {
+        var features = new Array();
+        for (var id in markerList[mid]) {
+            features.push(markerList[mid][id]);
+        }
+        vectorLayerMarkers.destroyFeatures(features);
+    }
+    markerList[mid] = new Object();
+}
+function kgeomapAddMarkers(mid, markerData) {
+    // markerData holds three values per marker: id, lat, lon
+    if (!markerList[mid]) {
+        markerList[mid] = new Object();
+    }
+    var features = new Array();
+    for (var i = 0; i+2 < markerData.length; i+=3) {
+        var feature = kgeomapCreatePointFeature(markerData[i+1], markerData[i+2], markerData[i]);
+        kgeomapSetFeaturePixmap(feature, 20, 32, 10, 32, 'marker-00ff00.png');
+        markerList[mid][markerData[i]] = feature;
+        features.push(feature);
+    }
+    // adding all features at once lets OpenLayers render them in one pass:
+    vectorLayerMarkers.addFeatures(features);
+}
+function kgeomapSetMarkerPixmap(mid, id, pixmapWidth, pixmapHeight, xOffset, yOffset, pixmapurl) {
+    var feature = markerList[mid] ? markerList[mid][id] : null;
+    if (feature) {
+        kgeomapSetFeaturePixmap(feature, pixmapWidth, pixmapHeight, xOffset, yOffset, pixmapurl);
+        vectorLayerMarkers.drawFeature(feature);
+    }
+}
+function kgeomapGetMarkerPosition(mid, id) {
     var latlngString;
-    if (markerList[id.toString()]) {
-        var markerClone = markerList[id.toString()].clone();
-        markerClone.geometry.transform(new OpenLayers.Projection("EPSG:900913"), new OpenLayers.Projection("EPSG:4326"));
-        var x = markerClone.geometry.x;
-        var y = markerClone.geometry.y;
-        latlngString = y.toString()+','+x.toString();
+    if (markerList[mid] && markerList[mid][id]) {
+        latlngString = kgeomapGetFeaturePosition(markerList[mid][id]);
     }
     return latlngString;
 }
-function kgeomapClearClusters() {
-    for (var layerColorIndex in layerColors) {
-        eval('vectorLayersClusters'+layerColors[layerColorIndex]+'.removeFeatures(vectorLayersClusters'+layerColors[layerColorIndex]+'.features);');
+function kgeomapGetPixmapName(markerCount, markerSelectedCount) {
+    var colorCode;
+    if (markerCount>=100) {
+        colorCode='ff0000';
+    } else if (markerCount>=50) {
+        colorCode='ff7f00';
+    } else if (markerCount>=10) {
+        colorCode='ffff00';
+    } else if (markerCount>=2) {
+        colorCode='00ff00';
+    } else {
+        colorCode='00ffff';
     }
-    for (var i in clusterList) {
-        clusterList[i].destroy();
+    if (markerSelectedCount==markerCount) {
+        colorCode+='-selected';
+    } else if (markerSelectedCount>0) {
+        colorCode+='-someselected';
+    }
+    return colorCode;
+}
+function kgeomapSetClusterIcon(feature, markerCount, markerSelectedCount) {
+    var colorCode = kgeomapGetPixmapName(markerCount, markerSelectedCount);
+    if (isInEditMode) {
+        kgeomapSetFeaturePixmap(feature, 20, 32, 10, 32, 'marker-'+colorCode+'.png');
+    } else {
+        kgeomapSetFeaturePixmap(feature, 30, 30, 15, 15, 'cluster-circle-'+colorCode+'.png');
     }
+}
+function kgeomapClearClusters() {
+    vectorLayerClusters.destroyFeatures();
     clusterList = new Object();
 }
-function kgeomapAddCluster(id, lat, lon, setDraggable, clusterColor, labelText) {
-    var projectedLonLat = kgeomapLonLat2Projection(new OpenLayers.LonLat(lon, lat));
-
-    var myVectorMarker = new OpenLayers.Feature.Vector(
-            new OpenLayers.Geometry.Point(projectedLonLat.lon, projectedLonLat.lat)
-            // setting styles per point does not seem to work in KHTML...
-//             ,null,
-//             new OpenLayers.StyleMap({
-//                 externalGraphic : iconFile,
-//                 pointRadius: 15
-//             })
-        );
-    eval('vectorLayersClusters'+clusterColor+'.addFeatures(myVectorMarker);');
-    clusterList[id.toString()] = myVectorMarker;
+function kgeomapAddClusters(clusterData) {
+    // clusterData holds five values per cluster: id, lat, lon, markerCount, markerSelectedCount
+    var features = new Array();
+    for (var i = 0; i+4 < clusterData.length; i+=5) {
+        var feature = kgeomapCreatePointFeature(clusterData[i+1], clusterData[i+2], clusterData[i]);
+        kgeomapSetClusterIcon(feature, clusterData[i+3], clusterData[i+4]);
+        clusterList[clusterData[i]] = feature;
+        features.push(feature);
+    }
+    vectorLayerClusters.addFeatures(features);
+}
+function kgeomapUpdateClusters(clusterData) {
+    // clusterData holds five values per cluster, as for kgeomapAddClusters
+    for (var i = 0; i+4 < clusterData.length; i+=5) {
+        var feature = clusterList[clusterData[i]];
+        if (!feature) {
+            continue;
+        }
+        var projectedLonLat = kgeomapLonLat2Projection(new OpenLayers.LonLat(clusterData[i+2], clusterData[i+1]));
+        feature.geometry.x = projectedLonLat.lon;
+        feature.geometry.y = projectedLonLat.lat;
+        feature.geometry.clearBounds();
+        kgeomapSetClusterIcon(feature, clusterData[i+3], clusterData[i+4]);
+        vectorLayerClusters.drawFeature(feature);
+    }
+}
+function kgeomapRemoveClusters(clusterIds) {
+    var features = new Array();
+    for (var i = 0; i < clusterIds.length; ++i) {
+        var id = clusterIds[i];
+        if (clusterList[id]) {
+            features.push(clusterList[id]);
+            delete clusterList[id];
+        }
+    }
+    vectorLayerClusters.destroyFeatures(features);
+}
+function kgeomapSetClusterPixmap(id, pixmapWidth, pixmapHeight, xOffset, yOffset, pixmapurl) {
+    var feature = clusterList[id];
+    if (feature) {
+        kgeomapSetFeaturePixmap(feature, pixmapWidth, pixmapHeight, xOffset, yOffset, pixmapurl);
+        vectorLayerClusters.drawFeature(feature);
+    }
 }
 function kgeomapGetClusterPosition(id) {
     var latlngString;
-    if (clusterList[id.toString()]) {
-        var clusterClone = clusterList[id.toString()].clone();
-        clusterClone.geometry.transform(new OpenLayers.Projection("EPSG:900913"), new OpenLayers.Projection("EPSG:4326"));
-        var x = clusterClone.geometry.x;
-        var y = clusterClone.geometry.y;
-        latlngString = y.toString()+','+x.toString();
+    if (clusterList[id]) {
+        latlngString = kgeomapGetFeaturePosition(clusterList[id]);
     }
     return latlngString;
 }
 function kgeomapWidgetResized(newWidth, newHeight) {
     document.getElementById('map_canvas').style.height=newHeight.toString()+'px';
+    map.updateSize();
+}
+function kgeomapCreateRectangleFeature(west, north, east, south, strokeColor) {
+    var bounds = new OpenLayers.Bounds(west, south, east, north);
+    bounds.transform(projectionWGS84, map.getProjectionObject());
+    var feature = new OpenLayers.Feature.Vector(bounds.toGeometry());
+    feature.style = {
+        fillOpacity: 0.0,
+        strokeColor: strokeColor,
+        strokeWidth: 1
+    };
+    vectorLayerSelection.addFeatures([feature]);
+    return feature;
+}
+function kgeomapSetSelectionRectangle(west, north, east, south) {
+    kgeomapRemoveSelectionRectangle();
+    selectionRectangle = kgeomapCreateRectangleFeature(west, north, east, south, '#FF0000');
+}
+function kgeomapSetTemporarySelectionRectangle(west, north, east, south) {
+    kgeomapRemoveTemporarySelectionRectangle();
+    temporarySelectionRectangle = kgeomapCreateRectangleFeature(west, north, east, south, '#0000FF');
+}
+function kgeomapRemoveSelectionRectangle() {
+    if (selectionRectangle) {
+        vectorLayerSelection.destroyFeatures([selectionRectangle]);
+        selectionRectangle = null;
+    }
+}
+function kgeomapRemoveTemporarySelectionRectangle() {
+    if (temporarySelectionRectangle) {
+        vectorLayerSelection.destroyFeatures([temporarySelectionRectangle]);
+        temporarySelectionRectangle = null;
+    }
+}
+function kgeomapSelectionModeStatus(state) {
+    // the map must not be panned while a selection is drawn
+    if (state) {
+        navigationControl.deactivate();
+    } else {
+        navigationControl.activate();
+        kgeomapRemoveTemporarySelectionRectangle();
+    }
+}
+function kgeomapSetMapBoundaries(west, north, east, south, useSaneZoomLevel) {
+    var bounds = new OpenLayers.Bounds(west, south, east, north);
+    bounds.transform(projectionWGS84, map.getProjectionObject());
+    map.zoomToExtent(bounds);
+    if (useSaneZoomLevel && (map.getZoom()>17)) {
+        map.zoomTo(17);
+    }
 }
 function kgeomapInitialize() {
-    map = new OpenLayers.Map("map_canvas", {
+    // neither the installed copy nor the network copy of OpenLayers could be loaded:
+    if (typeof OpenLayers == 'undefined') {
+        document.getElementById('map_canvas').innerHTML =
+            'OpenLayers could not be loaded. Install it next to backend-osm.html, see the README of libkgeomap.';
+        return;
+    }
+    projectionWGS84 = new OpenLayers.Projection('EPSG:4326');
+
+    navigationControl = new OpenLayers.Control.Navigation();
+    map = new OpenLayers.Map('map_canvas', {
         controls:[
-            new OpenLayers.Control.Navigation(),
+            navigationControl,
             new OpenLayers.Control.PanZoomBar(),
-            new OpenLayers.Control.Attribution()],
-        projection: new OpenLayers.Projection("EPSG:900913"),
-        displayProjection: new OpenLayers.Projection("EPSG:4326")
+            new OpenLayers.Control.Attribution()]
     } );
-    mapLayer = new OpenLayers.Layer.OSM.Osmarender("Osmarender");
+    // tiles are served by the application, see kgeomapSetTileUrl:
+    mapLayer = new OpenLayers.Layer.OSM('OpenStreetMap', 'kgeomaptile:/${z}/${x}/${y}', { numZoomLevels: 20 });
     map.addLayer(mapLayer);
 
-    for (var layerColorIndex in layerColors) {
-        eval('vectorLayersClusters'+layerColors[layerColorIndex]+' = new OpenLayers.Layer.Vector("Vector layer clusters",'+
-            '{ styleMap: new OpenLayers.StyleMap({ pointRadius: 15,  externalGraphic : "cluster-circle-'+layerColors[layerColorIndex]+'.png" }) });');
-        eval('map.addLayer(vectorLayersClusters'+layerColors[layerColorIndex]+');');
-    }
+    vectorLayerSelection = new OpenLayers.Layer.Vector('Selection');
+    map.addLayer(vectorLayerSelection);
 
-    // create a vector layer to hold the movable markers:
-    vectorLayerMarkers = new OpenLayers.Layer.Vector("Vector layer markers",
-        {
-            styleMap: new OpenLayers.StyleMap({
-                externalGraphic : "marker-00ff00.png",
-                graphicWidth : 20,
-                graphicHeight : 32,
-                graphicXOffset : -10,
-                graphicYOffset : 0
-            })
-        });
+    // the style of each marker and cluster is set on its feature:
+    vectorLayerMarkers = new OpenLayers.Layer.Vector('Markers');
     map.addLayer(vectorLayerMarkers);
+    vectorLayerClusters = new OpenLayers.Layer.Vector('Clusters');
+    map.addLayer(vectorLayerClusters);
 
-    var dragFeature = new OpenLayers.Control.DragFeature(vectorLayerMarkers);
-    dragFeature.onComplete = function(feature, pixel) {
-            // get the id of the feature
-            // TODO: is there an easier way? Features seem to be able to have ids,
-            // but they are not explained in the documentation
-            for (id in markerList) {
-                if (markerList[id] == feature) {
-                    // marker moved
-                    kgeomapPostEventString('mm'+id);
-                    return;
-                }
-            }
-            for (id in clusterList) {
-                if (clusterList[id] == feature) {
-                    // marker moved
-                    kgeomapPostEventString('cm'+id);
-                    return;
-                }
+    // clusters can be clicked, and moved in edit mode:
+    var dragFeature = new OpenLayers.Control.DragFeature(vectorLayerClusters);
+    dragFeature.moveFeature = function(pixel) {
+            if (isInEditMode) {
+                OpenLayers.Control.DragFeature.prototype.moveFeature.apply(this, arguments);
             }
         };
+    dragFeature.onStart = function(feature, pixel) {
+            clusterDragMoved = false;
+        };
+    dragFeature.onDrag = function(feature, pixel) {
+            clusterDragMoved = true;
+        };
+    dragFeature.onComplete = function(feature, pixel) {
+            kgeomapPostEvent(clusterDragMoved ? 'cm' : 'cc', [feature.kgeomapId]);
+        };
     map.addControl(dragFeature);
     dragFeature.activate();
 
     kgeomapSetCenter(52.0, 6.0);
 
     map.events.register('moveend', map, function() {
-        kgeomapPostEventString('id');
+        kgeomapPostEvent('id');
     } );
 
     kgeomapDebugOut('OSM initialize done');
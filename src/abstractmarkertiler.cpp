@@ -44,12 +44,14 @@ public:
 
     Private()
         : rootTile(nullptr),
-          isDirty(true)
+          isDirty(true),
+          maxLevel(TileIndex::DefaultMaxLevel)
     {
     }
 
     AbstractMarkerTiler::Tile* rootTile;
     bool                       isDirty;
+    int                        maxLevel;
 };
 
 AbstractMarkerTiler::AbstractMarkerTiler(QObject* const parent)
@@ -93,6 +95,31 @@ void AbstractMarkerTiler::setDirty(const bool state)
     }
 }
 
+int AbstractMarkerTiler::maxLevel() const
+{
+    return d->maxLevel;
+}
+
+/**
+ * @brief Sets the deepest level into which markers are sorted
+ *
+ * Deeper levels separate markers which are very close to each other, at the
+ * cost of more tiles. The backends never request tiles below this level.
+ */
+void AbstractMarkerTiler::setMaxLevel(const int level)
+{
+    KGEOMAP_ASSERT(level >= 0);
+    KGEOMAP_ASSERT(level <= TileIndex::MaxLevel);
+
+    const int newMaxLevel = qBound(0, level, int(TileIndex::MaxLevel));
+
+    if (newMaxLevel == d->maxLevel)
+        return;
+
+    d->maxLevel = newMaxLevel;
+    setDirty();
+}
+
 AbstractMarkerTiler::Tile* AbstractMarkerTiler::resetRootTile()
 {
     tileDelete(d->rootTile);
@@ -163,6 +190,20 @@ AbstractMarkerTiler::Flags AbstractMarkerTiler::tilerFlags() const
     return FlagNull;
 }
 
+/**
+ * @brief Returns a hash of a representative index, for looking up indices in hash tables
+ *
+ * Indices which are equal according to indicesEqual() have to return the same hash. The
+ * default implementation returns the same hash for all indices, which is correct but makes
+ * lookups linear. Reimplement it together with indicesEqual().
+ */
+uint AbstractMarkerTiler::indexHash(const QVariant& index) const
+{
+    Q_UNUSED(index)
+
+    return 0;
+}
+
 void AbstractMarkerTiler::clear()
 {
     tileDelete(d->rootTile);
@@ -179,10 +179,16 @@ public:
                                 const QPersistentModelIndex& targetSnapIndex);
 
     virtual void setActive(const bool state) = 0;
+
+    // appended after the other virtual functions, so that their vtable slots do not change
+    virtual uint indexHash(const QVariant& index) const;
+
     Tile* rootTile();
     bool indicesEqual(const QIntList& a, const QIntList& b, const int upToLevel) const;
     bool isDirty() const;
     void setDirty(const bool state = true);
+    int maxLevel() const;
+    void setMaxLevel(const int level);
     Tile* resetRootTile();
 
 Q_SIGNALS:
@@ -28,14 +28,27 @@
 
 #include "backendgooglemaps.h"
 
+// C++ includes
+
+#include <algorithm>
+
 // Qt includes
 
 #include <QBuffer>
 #include <QActionGroup>
+#include <QHash>
+#include <QSet>
 #include <QMenu>
 #include <QPointer>
 #include <QResizeEvent>
 #include <QAction>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QtEndian>
+#include <QtNumeric>
+#include <QImage>
+#include <QPainter>
 
 // Marble Widget includes
 
@@ -48,6 +61,7 @@
 
 // local includes
 
+#include "htmlclusterdiff.h"
 #include "htmlwidget.h"
 #include "mapwidget.h"
 #include "abstractmarkertiler.h"
@@ -66,7 +80,11 @@ public:
         htmlWidget = nullptr;
     }
 
-    HTMLWidget* htmlWidget;
+    HTMLWidget*            htmlWidget;
+
+    /// the tracks which are completely on the page, and the track manager they belong to
+    QPointer<TrackManager> trackManager;
+    QSet<quint64>          trackIds;
 };
 
 } /* KGeoMap */
@@ -100,10 +118,43 @@ public:
       cacheBounds(),
       activeState(false),
       widgetIsDocked(false),
-      trackChangeTracker()
+      trackChangeTracker(),
+      clusterDiff(),
+      trackUploads(),
+      trackUploadTimer(nullptr),
+      trackUploadPointsDone(0),
+      trackUploadPointsTotal(0),
+      pageTracks()
     {
     }
 
+    enum
+    {
+        /// number of track points passed to the page at once
+        TrackUploadChunkSize  = 2000,
+        /// time in milliseconds after which the upload returns to the event loop
+        TrackUploadTimeBudget = 10
+    };
+
+    /**
+     * @brief A track whose points are being passed to the page
+     */
+    class TrackUpload
+    {
+    public:
+
+        TrackUpload()
+            : trackId(0),
+              nextPoint(0),
+              pointCount(0)
+        {
+        }
+
+        quint64 trackId;
+        int     nextPoint;
+        int     pointCount;
+    };
+
     QPointer<HTMLWidget>                      htmlWidget;
     QPointer<QWidget>                         htmlWidgetWrapper;
     bool                                      isReady;
@@ -125,6 +176,16 @@ public:
     bool                                      activeState;
     bool                                      widgetIsDocked;
     QList<TrackManager::TrackChanges>         trackChangeTracker;
+
+    HtmlClusterDiff                           clusterDiff;
+
+    QList<TrackUpload>                        trackUploads;
+    QTimer*                                   trackUploadTimer;
+    int                                       trackUploadPointsDone;
+    int                                       trackUploadPointsTotal;
+
+    /// ids of the tracks which have been created on the page
+    QSet<quint64>                             pageTracks;
 };
 
 BackendGoogleMaps::BackendGoogleMaps(const QExplicitlySharedDataPointer<KGeoMapSharedData>& sharedData, QObject* const parent)
@@ -132,6 +193,13 @@ BackendGoogleMaps::BackendGoogleMaps(const QExplicitlySharedDataPointer<KGeoMapS
       d(new Private())
 {
     createActions();
+
+    d->trackUploadTimer = new QTimer(this);
+    d->trackUploadTimer->setSingleShot(true);
+    d->trackUploadTimer->setInterval(0);
+
+    connect(d->trackUploadTimer, SIGNAL(timeout()),
+            this, SLOT(slotTrackUploadTimeout()));
 }
 
 BackendGoogleMaps::~BackendGoogleMaps()
@@ -227,9 +295,24 @@ QWidget* BackendGoogleMaps::mapWidget()
             d->htmlWidgetWrapper               = info.widget;
             const GMInternalWidgetInfo intInfo = info.backendData.value<GMInternalWidgetInfo>();
             d->htmlWidget                      = intInfo.htmlWidget;
+
+            // the tracks of the previous owner can stay on the page if they come from our track manager
+            if (s->trackManager && (intInfo.trackManager == s->trackManager))
+            {
+                d->pageTracks = intInfo.trackIds;
+                d->htmlWidget->runScript(QString::fromLatin1("kgeomapSetTracksVisible(%1);")
+                                             .arg(s->trackManager->getVisibility() ? QLatin1String("true") : QLatin1String("false")));
+            }
+            else
+            {
+                d->pageTracks.clear();
+                d->htmlWidget->runScript(QString::fromLatin1("kgeomapClearTracks();"));
+            }
         }
         else
         {
+            d->pageTracks.clear();
+
             // the widget has not been created yet, create it now:
             d->htmlWidgetWrapper = new QWidget();
             d->htmlWidgetWrapper->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
@@ -240,8 +323,8 @@ QWidget* BackendGoogleMaps::mapWidget()
         connect(d->htmlWidget, SIGNAL(signalJavaScriptReady()),
                 this, SLOT(slotHTMLInitialized()));
 
-        connect(d->htmlWidget, SIGNAL(signalHTMLEvents(QStringList)),
-                this, SLOT(slotHTMLEvents(QStringList)));
+        connect(d->htmlWidget, SIGNAL(signalHTMLEvents(QVariantList)),
+                this, SLOT(slotHTMLEvents(QVariantList)));
 
         connect(d->htmlWidget, SIGNAL(selectionHasBeenMade(KGeoMap::GeoCoordinates::Pair)),
                 this, SLOT(slotSelectionHasBeenMade(KGeoMap::GeoCoordinates::Pair)));
@@ -286,7 +369,8 @@ bool BackendGoogleMaps::isReady() const
 
 void BackendGoogleMaps::slotHTMLInitialized()
 {
-    d->isReady = true;
+    d->isReady           = true;
+    d->clusterDiff.invalidate();
     d->htmlWidget->runScript(QString::fromLatin1("kgeomapWidgetResized(%1, %2)").arg(d->htmlWidgetWrapper->width()).arg(d->htmlWidgetWrapper->height()));
 
     // TODO: call javascript directly here and update action availability in one shot
@@ -404,44 +488,63 @@ void BackendGoogleMaps::slotUngroupedModelChanged(const int mindex)
     if (!isReady())
         return;
 
-    d->htmlWidget->runScript(QString::fromLatin1("kgeomapClearMarkers(%1);").arg(mindex));
+    // all markers of the model are transferred in one script
+    QString script = QString::fromLatin1("kgeomapClearMarkers(%1);").arg(mindex);
 
     // this can happen when a model was removed and we are simply asked to remove its markers
-    if (mindex>s->ungroupedModels.count())
+    if (mindex >= s->ungroupedModels.count())
+    {
+        d->htmlWidget->runScript(script);
         return;
+    }
 
     ModelHelper* const modelHelper = s->ungroupedModels.at(mindex);
 
-    if (!modelHelper)
-        return;
-
-    if (!modelHelper->modelFlags().testFlag(ModelHelper::FlagVisible))
+    if (!modelHelper || !modelHelper->modelFlags().testFlag(ModelHelper::FlagVisible))
+    {
+        d->htmlWidget->runScript(script);
         return;
+    }
 
     QAbstractItemModel* const model = modelHelper->model();
+    const int rowCount              = model->rowCount();
+
+    // read the coordinates by row from the coordinate cache, unless it is out of sync with the model
+    const bool haveCachedRows       = (modelHelper->cachedRowCount() == rowCount);
+    const qreal* const latitudes    = modelHelper->cachedLatitudes();
+    const qreal* const longitudes   = modelHelper->cachedLongitudes();
+    QStringList markerData;
+    QString pixmapScripts;
 
-    for (int row = 0; row < model->rowCount(); ++row)
+    for (int row = 0; row < rowCount; ++row)
     {
-        const QModelIndex currentIndex     = model->index(row, 0);
+        const QModelIndex currentIndex = model->index(row, 0);
+        GeoCoordinates currentCoordinates;
+
+        if (haveCachedRows)
+        {
+            if (qIsNaN(latitudes[row]) || qIsNaN(longitudes[row]))
+                continue;
+
+            currentCoordinates = GeoCoordinates(latitudes[row], longitudes[row]);
+        }
+        else if (!modelHelper->cachedItemCoordinates(currentIndex, &currentCoordinates))
+        {
+            continue;
+        }
+
         const ModelHelper::Flags itemFlags = modelHelper->itemFlags(currentIndex);
 
         // TODO: this is untested! We need to make sure the indices stay correct inside the JavaScript part!
         if (!itemFlags.testFlag(ModelHelper::FlagVisible))
             continue;
 
-        GeoCoordinates currentCoordinates;
-        if (!modelHelper->itemCoordinates(currentIndex, &currentCoordinates))
-            continue;
-
-        // TODO: use the pixmap supplied by the modelHelper
-        d->htmlWidget->runScript(QString::fromLatin1("kgeomapAddMarker(%1, %2, %3, %4, %5, %6);")
-                .arg(mindex)
-                .arg(row)
-                .arg(currentCoordinates.latString())
-                .arg(currentCoordinates.lonString())
-                .arg(itemFlags.testFlag(ModelHelper::FlagMovable)?QLatin1String("true" ):QLatin1String("false"))
-                .arg(itemFlags.testFlag(ModelHelper::FlagSnaps)?QLatin1String("true" ):QLatin1String("false"))
-            );
+        // five values per marker, see kgeomapAddMarkers
+        markerData << QString::number(row)
+                   << currentCoordinates.latString()
+                   << currentCoordinates.lonString()
+                   << (itemFlags.testFlag(ModelHelper::FlagMovable) ? QLatin1String("1") : QLatin1String("0"))
+                   << (itemFlags.testFlag(ModelHelper::FlagSnaps)   ? QLatin1String("1") : QLatin1String("0"));
 
         QPoint     markerCenterPoint;
         QSize      markerSize;
@@ -454,15 +557,20 @@ void BackendGoogleMaps::slotUngroupedModelChanged(const int mindex)
         {
             if (!markerUrl.isEmpty())
             {
-                setMarkerPixmap(mindex, row, markerCenterPoint, markerSize, markerUrl);
+                pixmapScripts += markerPixmapScript(mindex, row, markerCenterPoint, markerSize, markerUrl);
             }
             else
             {
-                setMarkerPixmap(mindex, row, markerCenterPoint, markerPixmap);
+                pixmapScripts += markerPixmapScript(mindex, row, markerCenterPoint, markerPixmap);
             }
         }
     }
 
+    // the pixmaps can only be set once the markers exist
+    script += QString::fromLatin1("kgeomapAddMarkers(%1, [%2]);").arg(mindex).arg(markerData.join(QLatin1Char(',')));
+    script += pixmapScripts;
+
+    d->htmlWidget->runScript(script);
 }
 void BackendGoogleMaps::updateMarkers()
 {
@@ -473,7 +581,7 @@ void BackendGoogleMaps::updateMarkers()
     }
 }
 
-void BackendGoogleMaps::slotHTMLEvents(const QStringList& events)
+void BackendGoogleMaps::slotHTMLEvents(const QVariantList& events)
 {
     // for some events, we just note that they appeared and then process them later on:
     bool centerProbablyChanged    = false;
@@ -486,17 +594,18 @@ void BackendGoogleMaps::slotHTMLEvents(const QStringList& events)
 
     // TODO: verify that the order of the events is still okay
     //       or that the order does not matter
-    for (QStringList::const_iterator it = events.constBegin(); it != events.constEnd(); ++it)
+    for (QVariantList::const_iterator it = events.constBegin(); it != events.constEnd(); ++it)
     {
-        const QString eventCode           = it->left(2);
-        const QString eventParameter      = it->mid(2);
-        const QStringList eventParameters = eventParameter.split(QLatin1Char( '/' ));
+        // each event holds its code followed by its parameters
+        const QVariantList event           = it->toList();
+        const QString eventCode            = event.value(0).toString();
+        const QVariantList eventParameters = event.mid(1);
 
         if (eventCode == QLatin1String("MT"))
         {
             // map type changed
             mapTypeChanged  = true;
-            d->cacheMapType = eventParameter;
+            d->cacheMapType = eventParameters.value(0).toString();
         }
         else if (eventCode == QLatin1String("MB"))
         {   // NOTE: event currently disabled in javascript part
@@ -523,12 +632,13 @@ void BackendGoogleMaps::slotHTMLEvents(const QStringList& events)
             /// @todo buffer this event type!
             // cluster moved
             bool okay              = false;
-            const int clusterIndex = eventParameter.toInt(&okay);
+            const int pageId       = eventParameters.value(0).toInt(&okay);
             KGEOMAP_ASSERT(okay);
 
             if (!okay)
                 continue;
 
+            const int clusterIndex = d->clusterDiff.clusterIndexForPageId(pageId);
             KGEOMAP_ASSERT(clusterIndex >= 0);
             KGEOMAP_ASSERT(clusterIndex < s->clusterList.size());
 
@@ -538,7 +648,7 @@ void BackendGoogleMaps::slotHTMLEvents(const QStringList& events)
             // re-read the marker position:
             GeoCoordinates clusterCoordinates;
             const bool isValid = d->htmlWidget->runScript2Coordinates(
-                    QString::fromLatin1("kgeomapGetClusterPosition(%1);").arg(clusterIndex),
+                    QString::fromLatin1("kgeomapGetClusterPosition(%1);").arg(pageId),
                     &clusterCoordinates
                 );
 
@@ -552,18 +662,22 @@ void BackendGoogleMaps::slotHTMLEvents(const QStringList& events)
             s->clusterList[clusterIndex].coordinates = clusterCoordinates;
 
             movedClusters << clusterIndex;
+
+            // the clusters on the page were modified while dragging, re-send all of them:
+            d->clusterDiff.invalidate();
         }
         else if (eventCode == QLatin1String("cs"))
         {
             /// @todo buffer this event type!
             // cluster snapped
-            bool okay = false;
-            const int clusterIndex = eventParameters.first().toInt(&okay);
+            bool okay              = false;
+            const int pageId       = eventParameters.value(0).toInt(&okay);
             KGEOMAP_ASSERT(okay);
 
             if (!okay)
                 continue;
 
+            const int clusterIndex = d->clusterDiff.clusterIndexForPageId(pageId);
             KGEOMAP_ASSERT(clusterIndex >= 0);
             KGEOMAP_ASSERT(clusterIndex < s->clusterList.size());
 
@@ -572,14 +686,14 @@ void BackendGoogleMaps::slotHTMLEvents(const QStringList& events)
 
             // determine to which marker we snapped:
             okay                  = false;
-            const int snapModelId = eventParameters.at(1).toInt(&okay);
+            const int snapModelId = eventParameters.value(1).toInt(&okay);
             KGEOMAP_ASSERT(okay);
 
             if (!okay)
                 continue;
 
             okay                   = false;
-            const int snapMarkerId = eventParameters.at(2).toInt(&okay);
+            const int snapMarkerId = eventParameters.value(2).toInt(&okay);
             KGEOMAP_ASSERT(okay);
 
             if (!okay)
@@ -589,6 +703,7 @@ void BackendGoogleMaps::slotHTMLEvents(const QStringList& events)
             ModelHelper* const modelHelper  = s->ungroupedModels.at(snapModelId);
             QAbstractItemModel* const model = modelHelper->model();
             QPair<int, QModelIndex> snapTargetIndex(snapModelId, model->index(snapMarkerId, 0));
+            d->clusterDiff.invalidate();
             emit(signalClustersMoved(QIntList() << clusterIndex, snapTargetIndex));
         }
         else if (eventCode == QLatin1String("cc"))
@@ -596,12 +711,13 @@ void BackendGoogleMaps::slotHTMLEvents(const QStringList& events)
             /// @todo buffer this event type!
             // cluster clicked
             bool okay              = false;
-            const int clusterIndex = eventParameter.toInt(&okay);
+            const int pageId       = eventParameters.value(0).toInt(&okay);
             KGEOMAP_ASSERT(okay);
 
             if (!okay)
                 continue;
 
+            const int clusterIndex = d->clusterDiff.clusterIndexForPageId(pageId);
             KGEOMAP_ASSERT(clusterIndex>=0);
             KGEOMAP_ASSERT(clusterIndex < s->clusterList.size());
 
@@ -648,7 +764,7 @@ void BackendGoogleMaps::slotHTMLEvents(const QStringList& events)
         else if (eventCode == QLatin1String("do"))
         {
             // debug output:
-            qCDebug(LIBKGEOMAP_LOG) << QString::fromLatin1("javascript:%1").arg(eventParameter);
+            qCDebug(LIBKGEOMAP_LOG) << QString::fromLatin1("javascript:%1").arg(eventParameters.value(0).toString());
         }
     }
 
@@ -716,38 +832,41 @@ void BackendGoogleMaps::updateClusters()
     if (!isReady())
         return;
 
-    // TODO: only update clusters that have actually changed!
+    // only the clusters which changed since the last update are transferred
+    QIntList redrawnClusters;
+    QString script = d->clusterDiff.updateScript(s, &redrawnClusters);
 
-    // re-transfer all markers to the javascript-part:
-    const bool canMoveItems = s->modificationsAllowed && s->markerModel->tilerFlags().testFlag(AbstractMarkerTiler::FlagMovable) && !s->showThumbnails;
-    d->htmlWidget->runScript(QLatin1String("kgeomapClearClusters();"));
-    d->htmlWidget->runScript(QString::fromLatin1("kgeomapSetIsInEditMode(%1);").arg(s->showThumbnails?QLatin1String("false" ):QLatin1String("true" )));
-
-    for (int currentIndex = 0; currentIndex < s->clusterList.size(); ++currentIndex)
-    {
-        const KGeoMapCluster& currentCluster = s->clusterList.at(currentIndex);
-
-        d->htmlWidget->runScript(QString::fromLatin1("kgeomapAddCluster(%1, %2, %3, %4, %5, %6);")
-                .arg(currentIndex)
-                .arg(currentCluster.coordinates.latString())
-                .arg(currentCluster.coordinates.lonString())
-                .arg(canMoveItems ? QLatin1String("true") : QLatin1String("false"))
-                .arg(currentCluster.markerCount)
-                .arg(currentCluster.markerSelectedCount)
-            );
-
-        // TODO: for now, only set generated pixmaps when not in edit mode
-        // this can be changed once we figure out how to appropriately handle
-        // the selection state changes when a marker is dragged
-        if (s->showThumbnails)
+    // TODO: for now, only set generated pixmaps when not in edit mode
+    // this can be changed once we figure out how to appropriately handle
+    // the selection state changes when a marker is dragged
+    if (s->showThumbnails && !redrawnClusters.isEmpty())
+    {
+        QVector<int> atlasClusterIds;
+        QVector<QPoint> atlasCenterPoints;
+        QVector<QPixmap> atlasPixmaps;
+
+        foreach(const int clusterIndex, redrawnClusters)
         {
             QPoint clusterCenterPoint;
             // TODO: who calculates the override values?
-            const QPixmap clusterPixmap = s->worldMapWidget->getDecoratedPixmapForCluster(currentIndex, nullptr, nullptr, &clusterCenterPoint);
+            const QPixmap clusterPixmap = s->worldMapWidget->getDecoratedPixmapForCluster(clusterIndex, nullptr, nullptr, &clusterCenterPoint);
 
-            setClusterPixmap(currentIndex, clusterCenterPoint, clusterPixmap);
+            // the pixmaps of all clusters are sent together, see clusterPixmapAtlasScript
+            atlasClusterIds   << d->clusterDiff.pageIdForClusterIndex(clusterIndex);
+            atlasCenterPoints << clusterCenterPoint;
+            atlasPixmaps      << clusterPixmap;
         }
+
+        script += clusterPixmapAtlasScript(atlasClusterIds, atlasCenterPoints, atlasPixmaps);
+    }
+
+    if (script.isEmpty())
+    {
+        qCDebug(LIBKGEOMAP_LOG) << "end updateclusters, nothing changed";
+        return;
     }
+
+    d->htmlWidget->runScript(script);
     qCDebug(LIBKGEOMAP_LOG) << "end updateclusters";
 }
 
@@ -915,14 +1034,16 @@ int BackendGoogleMaps::getMarkerModelLevel()
     else if (currentZoom==18) { tileLevel = 7; }
     else if (currentZoom==19) { tileLevel = 8; }
     else if (currentZoom==20) { tileLevel = 9; }
-    else if (currentZoom==21) { tileLevel = 9; }
-    else if (currentZoom==22) { tileLevel = 9; }
+    else if (currentZoom==21) { tileLevel = 10; }
+    else if (currentZoom==22) { tileLevel = 10; }
+    else if (currentZoom==23) { tileLevel = 11; }
     else
     {
-        tileLevel = TileIndex::MaxLevel-1;
+        tileLevel = TileIndex::MaxLevel;
     }
 
-    KGEOMAP_ASSERT(tileLevel <= TileIndex::MaxLevel-1);
+    // the tile grouper limits this to the depth of the marker tiler
+    KGEOMAP_ASSERT(tileLevel <= TileIndex::MaxLevel);
 
     return tileLevel;
 }
@@ -992,63 +1113,140 @@ void BackendGoogleMaps::updateZoomMinMaxCache()
 //     d->cacheMinZoom = d->htmlWidget->runScript("kgeomapGetMinZoom();").toInt();
 }
 
-void BackendGoogleMaps::slotThumbnailAvailableForIndex(const QVariant& index, const QPixmap& pixmap)
+void BackendGoogleMaps::slotThumbnailsAvailable(const QVariantList& indices, const QList<QPixmap>& pixmaps)
 {
-    qCDebug(LIBKGEOMAP_LOG) << index<<pixmap.size();
+    qCDebug(LIBKGEOMAP_LOG) << indices.count();
 
-    if (pixmap.isNull() || !s->showThumbnails)
+    if (!d->htmlWidget)
         return;
 
-    // TODO: properly reject pixmaps with the wrong size
-    const int expectedThumbnailSize = s->worldMapWidget->getUndecoratedThumbnailSize();
+    const QIntList clusterIndices = clustersRepresentedBy(indices, pixmaps);
 
-    if ((pixmap.size().height() != expectedThumbnailSize)&&(pixmap.size().width()!=expectedThumbnailSize))
-        return;
+    // the new pixmaps are sent together, like the pixmaps of an update of the clusters
+    QVector<int> atlasClusterIds;
+    QVector<QPoint> atlasCenterPoints;
+    QVector<QPixmap> atlasPixmaps;
 
-    // find the cluster which is represented by this index:
-    for (int i = 0; i < s->clusterList.count(); ++i)
+    foreach(const int clusterIndex, clusterIndices)
     {
-        // TODO: use the right sortkey
-        // TODO: let the representativeChooser handle the index comparison
-        const QVariant representativeMarker = s->worldMapWidget->getClusterRepresentativeMarker(i, s->sortKey);
+        const int pageId = d->clusterDiff.pageIdForClusterIndex(clusterIndex);
 
-        if (s->markerModel->indicesEqual(index, representativeMarker))
-        {
-            QPoint clusterCenterPoint;
-            // TODO: who calculates the override values?
-            const QPixmap clusterPixmap = s->worldMapWidget->getDecoratedPixmapForCluster(i, nullptr, nullptr, &clusterCenterPoint);
+        if (pageId < 0)
+            continue;
 
-            setClusterPixmap(i, clusterCenterPoint, clusterPixmap);
+        QPoint clusterCenterPoint;
+        // TODO: who calculates the override values?
+        const QPixmap clusterPixmap = s->worldMapWidget->getDecoratedPixmapForCluster(clusterIndex, nullptr, nullptr, &clusterCenterPoint);
 
-            break;
-        }
+        atlasClusterIds   << pageId;
+        atlasCenterPoints << clusterCenterPoint;
+        atlasPixmaps      << clusterPixmap;
+    }
+
+    if (!atlasPixmaps.isEmpty())
+    {
+        d->htmlWidget->runScript(clusterPixmapAtlasScript(atlasClusterIds, atlasCenterPoints, atlasPixmaps));
     }
 }
 
-void BackendGoogleMaps::setClusterPixmap(const int clusterId, const QPoint& centerPoint, const QPixmap& clusterPixmap)
+/**
+ * @brief Returns the script which sets the pixmaps of several clusters at once
+ *
+ * The pixmaps are packed into rows of one atlas image, which is transferred only once.
+ * The clusters use sub-rectangles of it, see kgeomapSetClusterPixmaps.
+ */
+QString BackendGoogleMaps::clusterPixmapAtlasScript(const QVector<int>& clusterIds,
+                                                    const QVector<QPoint>& centerPoints,
+                                                    const QVector<QPixmap>& clusterPixmaps) const
 {
-    // decorate the pixmap:
-    const QPixmap styledPixmap = clusterPixmap;
+    KGEOMAP_ASSERT(clusterIds.count() == clusterPixmaps.count());
+    KGEOMAP_ASSERT(centerPoints.count() == clusterPixmaps.count());
+
+    const int maxAtlasWidth = 1024;
+
+    // place the highest pixmaps first, so that the rows are filled evenly
+    QVector<int> order(clusterPixmaps.count());
+
+    for (int i = 0; i < order.count(); ++i)
+    {
+        order[i] = i;
+    }
+
+    std::stable_sort(order.begin(), order.end(),
+                     [&clusterPixmaps](const int a, const int b)
+                     {
+                         return clusterPixmaps.at(a).height() > clusterPixmaps.at(b).height();
+                     });
+
+    QVector<QPoint> atlasPositions(clusterPixmaps.count());
+    int x          = 0;
+    int y          = 0;
+    int rowHeight  = 0;
+    int atlasWidth = 0;
+
+    Q_FOREACH(const int i, order)
+    {
+        const QSize pixmapSize = clusterPixmaps.at(i).size();
+
+        if ((x > 0) && (x + pixmapSize.width() > maxAtlasWidth))
+        {
+            x         = 0;
+            y        += rowHeight;
+            rowHeight = 0;
+        }
+
+        atlasPositions[i] = QPoint(x, y);
+        x                += pixmapSize.width();
+        rowHeight         = qMax(rowHeight, pixmapSize.height());
+        atlasWidth        = qMax(atlasWidth, x);
+    }
+
+    const int atlasHeight = y + rowHeight;
+
+    if ((atlasWidth <= 0) || (atlasHeight <= 0))
+    {
+        return QString();
+    }
+
+    QImage atlas(atlasWidth, atlasHeight, QImage::Format_ARGB32_Premultiplied);
+    atlas.fill(Qt::transparent);
+
+    QStringList atlasTable;
+
+    {
+        QPainter painter(&atlas);
+
+        for (int i = 0; i < clusterPixmaps.count(); ++i)
+        {
+            const QPixmap& pixmap = clusterPixmaps.at(i);
+            painter.drawPixmap(atlasPositions.at(i), pixmap);
+
+            // seven values per cluster, see kgeomapSetClusterPixmaps
+            atlasTable << QString::number(clusterIds.at(i))
+                       << QString::number(atlasPositions.at(i).x())
+                       << QString::number(atlasPositions.at(i).y())
+                       << QString::number(pixmap.width())
+                       << QString::number(pixmap.height())
+                       << QString::number(centerPoints.at(i).x())
+                       << QString::number(centerPoints.at(i).y());
+        }
+    }
 
     QByteArray bytes;
     QBuffer buffer(&bytes);
     buffer.open(QIODevice::WriteOnly);
-    clusterPixmap.save(&buffer, "PNG");
+    atlas.save(&buffer, "PNG");
 
     // http://www.faqs.org/rfcs/rfc2397.html
     const QString imageData = QString::fromLatin1("data:image/png;base64,%1").arg(QString::fromLatin1(bytes.toBase64()));
-    d->htmlWidget->runScript(QString::fromLatin1("kgeomapSetClusterPixmap(%1,%5,%6,%2,%3,'%4');")
-                    .arg(clusterId)
-                    .arg(centerPoint.x())
-                    .arg(centerPoint.y())
+
+    return QString::fromLatin1("kgeomapSetClusterPixmaps('%1',[%2]);")
                     .arg(imageData)
-                    .arg(clusterPixmap.width())
-                    .arg(clusterPixmap.height())
-                );
+                    .arg(atlasTable.join(QLatin1Char(',')));
 }
 
-void BackendGoogleMaps::setMarkerPixmap(const int modelId, const int markerId,
-                                        const QPoint& centerPoint, const QPixmap& markerPixmap)
+QString BackendGoogleMaps::markerPixmapScript(const int modelId, const int markerId,
+                                              const QPoint& centerPoint, const QPixmap& markerPixmap) const
 {
     QByteArray bytes;
     QBuffer buffer(&bytes);
@@ -1057,32 +1255,30 @@ void BackendGoogleMaps::setMarkerPixmap(const int modelId, const int markerId,
 
     // http://www.faqs.org/rfcs/rfc2397.html
     const QString imageData = QString::fromLatin1("data:image/png;base64,%1").arg(QString::fromLatin1(bytes.toBase64()));
-    d->htmlWidget->runScript(QString::fromLatin1("kgeomapSetMarkerPixmap(%7,%1,%5,%6,%2,%3,'%4');")
+
+    return QString::fromLatin1("kgeomapSetMarkerPixmap(%7,%1,%5,%6,%2,%3,'%4');")
                     .arg(markerId)
                     .arg(centerPoint.x())
                     .arg(centerPoint.y())
                     .arg(imageData)
                     .arg(markerPixmap.width())
                     .arg(markerPixmap.height())
-                    .arg(modelId)
-                );
+                    .arg(modelId);
 }
 
-void BackendGoogleMaps::setMarkerPixmap(const int modelId, const int markerId,
-                                        const QPoint& centerPoint, const QSize& iconSize,
-                                        const QUrl& iconUrl
-                                       )
+QString BackendGoogleMaps::markerPixmapScript(const int modelId, const int markerId,
+                                              const QPoint& centerPoint, const QSize& iconSize,
+                                              const QUrl& iconUrl) const
 {
     /// @todo Sort the parameters
-    d->htmlWidget->runScript(QString::fromLatin1("kgeomapSetMarkerPixmap(%7,%1,%5,%6,%2,%3,'%4');")
+    return QString::fromLatin1("kgeomapSetMarkerPixmap(%7,%1,%5,%6,%2,%3,'%4');")
                     .arg(markerId)
                     .arg(centerPoint.x())
                     .arg(centerPoint.y())
                     .arg(iconUrl.url()) /// @todo Escape characters like apostrophe
                     .arg(iconSize.width())
                     .arg(iconSize.height())
-                    .arg(modelId)
-                );
+                    .arg(modelId);
 }
 
 bool BackendGoogleMaps::eventFilter(QObject* object, QEvent* event)
@@ -1205,14 +1401,27 @@ void BackendGoogleMaps::setActive(const bool state)
 
 void BackendGoogleMaps::releaseWidget(KGeoMapInternalWidgetInfo* const info)
 {
-    // clear all tracks
-    d->htmlWidget->runScript(QString::fromLatin1("kgeomapClearTracks();"));
+    // Tracks which are completely on the page stay there, the next owner can use them
+    // if it uses the same track manager. Partially uploaded tracks are removed.
+    Q_FOREACH(const Private::TrackUpload& upload, d->trackUploads)
+    {
+        d->htmlWidget->runScript(QString::fromLatin1("kgeomapRemoveTrack(%1);").arg(upload.trackId));
+        d->pageTracks.remove(upload.trackId);
+    }
+
+    cancelTrackUploads();
+
+    GMInternalWidgetInfo intInfo = info->backendData.value<GMInternalWidgetInfo>();
+    intInfo.trackManager         = s->trackManager;
+    intInfo.trackIds             = d->pageTracks;
+    info->backendData.setValue(intInfo);
+    d->pageTracks.clear();
 
     disconnect(d->htmlWidget, SIGNAL(signalJavaScriptReady()),
                this, SLOT(slotHTMLInitialized()));
 
-    disconnect(d->htmlWidget, SIGNAL(signalHTMLEvents(QStringList)),
-               this, SLOT(slotHTMLEvents(QStringList)));
+    disconnect(d->htmlWidget, SIGNAL(signalHTMLEvents(QVariantList)),
+               this, SLOT(slotHTMLEvents(QVariantList)));
 
     disconnect(d->htmlWidget, SIGNAL(selectionHasBeenMade(KGeoMap::GeoCoordinates::Pair)),
                this, SLOT(slotSelectionHasBeenMade(KGeoMap::GeoCoordinates::Pair)));
@@ -1225,6 +1434,7 @@ void BackendGoogleMaps::releaseWidget(KGeoMapInternalWidgetInfo* const info)
     info->currentOwner   = nullptr;
     info->state          = KGeoMapInternalWidgetInfo::InternalWidgetReleased;
     d->isReady           = false;
+    d->clusterDiff.invalidate();
 
     emit(signalBackendReadyChanged(backendName()));
 }
@@ -1309,14 +1519,11 @@ void BackendGoogleMaps::slotTracksChanged(const QList<TrackManager::TrackChanges
         return;
     }
 
-    /// @TODO We have to re-read the tracks after being inactive.
-    /// @TODO Tracks have to be cleared in JavaScript everytime the
-    ///       htmlwidget is passed to another mapwidget.
-    /// @TODO Clearing all tracks and re-adding them takes too long. We
-    ///       have to see which track changed, and whether coordinates or only properties changed.
     if (!s->trackManager)
     {
         // no track manager, clear all tracks
+        cancelTrackUploads();
+        d->pageTracks.clear();
         const QVariant successClear = d->htmlWidget->runScript(QString::fromLatin1("kgeomapClearTracks();"));
 
         return;
@@ -1326,14 +1533,26 @@ void BackendGoogleMaps::slotTracksChanged(const QList<TrackManager::TrackChanges
     {
         if (tc.second & TrackManager::ChangeRemoved)
         {
+            cancelTrackUpload(tc.first);
             d->htmlWidget->runScript(QString::fromLatin1("kgeomapRemoveTrack(%1);").arg(tc.first));
+            d->pageTracks.remove(tc.first);
+
+            continue;
         }
-        else
+
+        const TrackManager::Track track = s->trackManager->getTrackById(tc.first);
+
+        // Track ids are not re-used and the points of a track do not change after it was loaded.
+        // A track which is added again while it is on the page, for example after the track
+        // visibility was toggled, therefore only needs its metadata updated.
+        const bool needsUpload = !d->pageTracks.contains(tc.first) || (tc.second == TrackManager::ChangeTrackPoints);
+
+        if (needsUpload)
         {
-            /// @TODO For now, remove the track and re-add it.
+            // whatever is still being uploaded for this track is outdated now
+            cancelTrackUpload(tc.first);
             d->htmlWidget->runScript(QString::fromLatin1("kgeomapRemoveTrack(%1);").arg(tc.first));
-
-            const TrackManager::Track track = s->trackManager->getTrackById(tc.first);
+            d->pageTracks.remove(tc.first);
 
             if (track.points.count() < 2)
             {
@@ -1347,30 +1566,146 @@ void BackendGoogleMaps::slotTracksChanged(const QList<TrackManager::TrackChanges
                         .arg(track.id)
                         .arg(track.color.name()); // QColor::name() returns #ff00ff
             d->htmlWidget->runScript(createTrackScript);
+            d->pageTracks.insert(track.id);
+
+            // the points are passed from the event loop, see slotTrackUploadTimeout
+            Private::TrackUpload upload;
+            upload.trackId    = track.id;
+            upload.pointCount = track.points.count();
+            d->trackUploads << upload;
+            d->trackUploadPointsTotal += upload.pointCount;
+        }
+        else if (tc.second & TrackManager::ChangeMetadata)
+        {
+            d->htmlWidget->runScript(QString::fromLatin1("kgeomapSetTrackColor(%1,'%2');")
+                                         .arg(track.id)
+                                         .arg(track.color.name()));
+        }
+    }
+
+    if (!d->trackUploads.isEmpty() && !d->trackUploadTimer->isActive())
+    {
+        d->trackUploadTimer->start();
+    }
+}
+
+/**
+ * @brief Passes the points of pending tracks to the page, until the time budget is used up
+ *
+ * Tracks which intersect the visible area are passed first. Progress is reported via
+ * signalTrackUploadProgress().
+ */
+void BackendGoogleMaps::slotTrackUploadTimeout()
+{
+    if (!d->isReady || !s->trackManager)
+    {
+        cancelTrackUploads();
+        return;
+    }
 
-            QDateTime t1                    = QDateTime::currentDateTime();
-            const int numPointsToPassAtOnce = 1000;
+    const GeoCoordinates::PairList visibleBounds = getNormalizedBounds();
+    QList<Private::TrackUpload> visibleUploads;
+    QList<Private::TrackUpload> hiddenUploads;
 
-            for (int coordIdx = 0; coordIdx < track.points.count(); coordIdx += numPointsToPassAtOnce)
+    Q_FOREACH(const Private::TrackUpload& upload, d->trackUploads)
+    {
+        const TrackManager::Track track = s->trackManager->getTrackById(upload.trackId);
+        bool isVisible                  = track.segments.isEmpty();
+
+        for (int i = 0; (i < visibleBounds.count()) && !isVisible; ++i)
+        {
+            for (int j = 0; (j < track.segments.count()) && !isVisible; ++j)
             {
-                /// @TODO Even by passing only a few points each time, we can
-                ///       block the UI for a long time. Instead, it may be better
-                ///       to call addPointsToTrack via the eventloop repeatedly
-                ///       to allow processing of other events.
-                addPointsToTrack(track.id, track.points, coordIdx, numPointsToPassAtOnce);
+                isVisible = track.segments.at(j).intersects(visibleBounds.at(i));
             }
+        }
+
+        if (isVisible)
+        {
+            visibleUploads << upload;
+        }
+        else
+        {
+            hiddenUploads << upload;
+        }
+    }
+
+    d->trackUploads = visibleUploads + hiddenUploads;
+
+    QElapsedTimer budgetTimer;
+    budgetTimer.start();
+
+    while (!d->trackUploads.isEmpty() && (budgetTimer.elapsed() < Private::TrackUploadTimeBudget))
+    {
+        Private::TrackUpload& upload    = d->trackUploads.first();
+        const TrackManager::Track track = s->trackManager->getTrackById(upload.trackId);
+
+        if ((track.id != upload.trackId) || (track.points.count() != upload.pointCount))
+        {
+            // the track has changed without notice, give up on it
+            cancelTrackUpload(upload.trackId);
+            continue;
+        }
+
+        const int nPoints = qMin(int(Private::TrackUploadChunkSize), upload.pointCount - upload.nextPoint);
+        addPointsToTrack(track.id, track.points, upload.nextPoint, nPoints);
+
+        upload.nextPoint         += nPoints;
+        d->trackUploadPointsDone += nPoints;
+
+        if (upload.nextPoint >= upload.pointCount)
+        {
+            qCDebug(LIBKGEOMAP_LOG) << track.url.fileName() << "uploaded";
+            d->trackUploads.removeFirst();
+        }
+    }
+
+    emit(signalTrackUploadProgress(d->trackUploadPointsDone, d->trackUploadPointsTotal));
 
-            QDateTime t2 = QDateTime::currentDateTime();
-            qCDebug(LIBKGEOMAP_LOG)<<track.url.fileName()<<t1.msecsTo(t2);
+    if (d->trackUploads.isEmpty())
+    {
+        d->trackUploadPointsDone  = 0;
+        d->trackUploadPointsTotal = 0;
+    }
+    else
+    {
+        d->trackUploadTimer->start();
+    }
+}
+
+void BackendGoogleMaps::cancelTrackUpload(const quint64 trackId)
+{
+    for (int i = 0; i < d->trackUploads.count(); ++i)
+    {
+        const Private::TrackUpload& upload = d->trackUploads.at(i);
+
+        if (upload.trackId == trackId)
+        {
+            d->trackUploadPointsDone  -= upload.nextPoint;
+            d->trackUploadPointsTotal -= upload.pointCount;
+            d->trackUploads.removeAt(i);
+            break;
         }
     }
 }
 
+void BackendGoogleMaps::cancelTrackUploads()
+{
+    d->trackUploads.clear();
+    d->trackUploadTimer->stop();
+    d->trackUploadPointsDone  = 0;
+    d->trackUploadPointsTotal = 0;
+}
+
+/**
+ * @brief Sends points of a track to the page
+ *
+ * The coordinates are passed as a base64 string of little-endian 32 bit integers,
+ * in units of 1e-7 degrees, which is about a fifth of the size of the JSON text used before.
+ * See kgeomapDecodeCoordinates.
+ */
 void BackendGoogleMaps::addPointsToTrack(const quint64 trackId, TrackManager::TrackPoint::List const& track, const int firstPoint, const int nPoints)
 {
-    QString json;
-    QTextStream jsonBuilder(&json);
-    jsonBuilder << '[';
     int lastPoint = track.count()-1;
 
     if (nPoints>0)
@@ -1378,50 +1713,54 @@ void BackendGoogleMaps::addPointsToTrack(const quint64 trackId, TrackManager::Tr
         lastPoint = qMin(firstPoint + nPoints - 1, track.count()-1);
     }
 
-    for (int coordIdx = firstPoint; coordIdx <= lastPoint; ++coordIdx)
+    if (lastPoint < firstPoint)
     {
-        GeoCoordinates const& coordinates = track.at(coordIdx).coordinates;
+        return;
+    }
 
-        if (coordIdx > firstPoint)
-        {
-            jsonBuilder << ',';
-        }
+    QByteArray packedCoordinates(2 * sizeof(qint32) * (lastPoint - firstPoint + 1), Qt::Uninitialized);
+    uchar* data = reinterpret_cast<uchar*>(packedCoordinates.data());
 
-        // Pass data in plain array format. In KHTML, this is much slower than
-        // using JSON. In Firefox, the speed is roughly the same.
-//         jsonBuilder /*<< "{\"lat\":" */<< coordinates.latString() << ","
-//                     /*<< "\"lon\":" */<< coordinates.lonString() /*<< "}"*/;
+    for (int coordIdx = firstPoint; coordIdx <= lastPoint; ++coordIdx)
+    {
+        GeoCoordinates const& coordinates = track.at(coordIdx).coordinates;
 
-        /// @TODO This looks like a lot of text to parse. Is there a more compact way?
-        jsonBuilder << "{\"lat\":" << coordinates.latString() << ","
-                    << "\"lon\":" << coordinates.lonString() << "}";
+        qToLittleEndian<qint32>(qint32(qRound(coordinates.lat() * 1e7)), data);
+        data += sizeof(qint32);
+        qToLittleEndian<qint32>(qint32(qRound(coordinates.lon() * 1e7)), data);
+        data += sizeof(qint32);
     }
 
-    jsonBuilder << ']';
-    const QString addTrackScript = QString::fromLatin1("kgeomapAddToTrack(%1,'%2');").arg(trackId).arg(json);
+    const QString addTrackScript = QString::fromLatin1("kgeomapAddToTrack(%1,'%2');")
+                                       .arg(trackId)
+                                       .arg(QString::fromLatin1(packedCoordinates.toBase64()));
     d->htmlWidget->runScript(addTrackScript);
 }
 
 void BackendGoogleMaps::slotTrackVisibilityChanged(const bool newState)
 {
-    /// @TODO Now we remove all tracks and re-add them on visibility change.
-    ///       This is very slow.
+    // the tracks stay on the page while they are hidden
+    if (d->htmlWidget)
+    {
+        d->htmlWidget->runScript(QString::fromLatin1("kgeomapSetTracksVisible(%1);")
+                                     .arg(newState ? QLatin1String("true") : QLatin1String("false")));
+    }
+
     if (newState)
     {
-        // store all tracks which are already in the manager as changed
+        // apply the changes which were stored while the tracks were hidden, and make sure
+        // that all tracks of the manager are on the page
         const TrackManager::Track::List trackList = s->trackManager->getTrackList();
-        QList<TrackManager::TrackChanges> trackChanges;
 
         Q_FOREACH(const TrackManager::Track& t, trackList)
         {
-            trackChanges << TrackManager::TrackChanges(t.id, TrackManager::ChangeAdd);
+            storeTrackChanges(TrackManager::TrackChanges(t.id, TrackManager::ChangeAdd));
         }
+
+        const QList<TrackManager::TrackChanges> trackChanges = d->trackChangeTracker;
+        d->trackChangeTracker.clear();
         slotTracksChanged(trackChanges);
     }
-    else if (d->htmlWidget)
-    {
-        const QVariant successClear = d->htmlWidget->runScript(QString::fromLatin1("kgeomapClearTracks();"));
-    }
 }
 
 } /* namespace KGeoMap */
@@ -98,33 +98,37 @@ public:
 public Q_SLOTS:
 
     void slotClustersNeedUpdating() override;
-    void slotThumbnailAvailableForIndex(const QVariant& index, const QPixmap& pixmap) override;
+    void slotThumbnailsAvailable(const QVariantList& indices, const QList<QPixmap>& pixmaps) override;
     void slotUngroupedModelChanged(const int mindex);
-  
+
 protected:
 
     bool eventFilter(QObject* object, QEvent* event) override;
     void createActions();
-    void setClusterPixmap(const int clusterId, const QPoint& centerPoint, const QPixmap& clusterPixmap);
-    void setMarkerPixmap(const int modelId, const int markerId, const QPoint& centerPoint, const QPixmap& markerPixmap);
-    void setMarkerPixmap(const int modelId, const int markerId, const QPoint& centerPoint, const QSize& iconSize, const QUrl& iconUrl);
+    QString clusterPixmapAtlasScript(const QVector<int>& clusterIds, const QVector<QPoint>& centerPoints,
+                                     const QVector<QPixmap>& clusterPixmaps) const;
+    QString markerPixmapScript(const int modelId, const int markerId, const QPoint& centerPoint, const QPixmap& markerPixmap) const;
+    QString markerPixmapScript(const int modelId, const int markerId, const QPoint& centerPoint, const QSize& iconSize, const QUrl& iconUrl) const;
     void storeTrackChanges(const TrackManager::TrackChanges trackChanges);
 
 private Q_SLOTS:
 
     void slotHTMLInitialized();
     void slotMapTypeActionTriggered(QAction* action);
-    void slotHTMLEvents(const QStringList& eventStrings);
+    void slotHTMLEvents(const QVariantList& events);
     void slotFloatSettingsTriggered(QAction* action);
     void slotSelectionHasBeenMade(const KGeoMap::GeoCoordinates::Pair& searchCoordinates);
     void slotTrackManagerChanged() override;
     void slotTracksChanged(const QList<TrackManager::TrackChanges> trackChanges);
     void slotTrackVisibilityChanged(const bool newState);
+    void slotTrackUploadTimeout();
 
 private:
 
     void updateZoomMinMaxCache();
     static void deleteInfoFunction(KGeoMapInternalWidgetInfo* const info);
+    void cancelTrackUpload(const quint64 trackId);
+    void cancelTrackUploads();
     void addPointsToTrack(const quint64 trackId, TrackManager::TrackPoint::List const& track, const int firstPoint, const int nPoints);
   
 private:
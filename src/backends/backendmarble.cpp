@@ -28,11 +28,20 @@
 
 #include "backendmarble.h"
 
+// C++ includes
+
+#include <algorithm>
+#include <cmath>
+
 // Qt includes
 
 #include <QMenu>
 #include <QMouseEvent>
+#include <QPair>
+#include <QPixmap>
 #include <QPointer>
+#include <QtMath>
+#include <QtNumeric>
 #include <QAction>
 
 // KDE includes
@@ -58,8 +67,10 @@
 #endif // KGEOMAP_MARBLE_ADD_LAYER
 
 #include "abstractmarkertiler.h"
+#include "itemmarkertiler.h"
 #include "mapwidget.h"
 #include "modelhelper.h"
+#include "repaintscheduler.h"
 #include "tracks.h"
 #include "libkgeomap_debug.h"
 
@@ -91,6 +102,108 @@ namespace KGeoMap
 
 class BackendMarble::Private
 {
+public:
+
+    /**
+     * @brief Spatial index of the markers of an ungrouped model
+     */
+    class UngroupedModelTiler
+    {
+    public:
+
+        UngroupedModelTiler()
+          : modelHelper(),
+            tiler(nullptr)
+        {
+        }
+
+        QPointer<ModelHelper> modelHelper;
+        ItemMarkerTiler*      tiler;
+    };
+
+    /**
+     * @brief The points of a track simplified for the tolerance 2^detailLevel degrees
+     */
+    class SimplifiedTrack
+    {
+    public:
+
+        SimplifiedTrack()
+          : detailLevel(0),
+            pointIndices()
+        {
+        }
+
+        int        detailLevel;
+        QList<int> pointIndices;
+    };
+
+    /**
+     * @brief The parameters of the map which determine where coordinates are projected to
+     */
+    class ViewportState
+    {
+    public:
+
+        ViewportState()
+          : centerLat(0.0),
+            centerLon(0.0),
+            radius(-1),
+            projection(-1),
+            size()
+        {
+        }
+
+        bool operator==(const ViewportState& other) const
+        {
+            return (centerLat  == other.centerLat)  &&
+                   (centerLon  == other.centerLon)  &&
+                   (radius     == other.radius)     &&
+                   (projection == other.projection) &&
+                   (size       == other.size);
+        }
+
+        bool operator!=(const ViewportState& other) const
+        {
+            return !(*this == other);
+        }
+
+        qreal centerLat;
+        qreal centerLon;
+        int   radius;
+        int   projection;
+        QSize size;
+    };
+
+    /**
+     * @brief A marker which can be snapped to, at its position on the screen
+     */
+    class SnapCandidate
+    {
+    public:
+
+        SnapCandidate()
+          : point(),
+            coordinates(),
+            modelIndex(-1),
+            row(-1)
+        {
+        }
+
+        QPoint         point;
+        GeoCoordinates coordinates;
+        int            modelIndex;
+        int            row;
+    };
+
+    class ProjectedPoint
+    {
+    public:
+
+        QPoint point;
+        bool   isVisible;
+    };
+
 public:
 
     Private()
@@ -124,13 +237,55 @@ public:
         activeState(false),
         widgetIsDocked(false),
         blockingZoomWhileChangingTheme(false),
-        trackCache()
+        trackCache(),
+        ungroupedModelTilers(),
+        projectionCacheState(),
+        projectionCacheValid(false),
+        projectionCache(),
+        staticLayer(),
+        staticLayerState(),
+        staticLayerDirty(true),
+        staticLayerMovingClusterIndex(-1),
+        staticLayerMarkersInMovingCluster(0),
+        repaintScheduler(nullptr),
+        snapGrid(),
+        snapGridValid(false),
+        snapGridState(),
+        snapGridRadius(0)
 #ifdef KGEOMAP_MARBLE_ADD_LAYER
         , bmLayer(nullptr)
 #endif
     {
     }
 
+    ViewportState currentViewportState() const
+    {
+        ViewportState state;
+        state.centerLat  = marbleWidget->centerLatitude();
+        state.centerLon  = marbleWidget->centerLongitude();
+        state.radius     = marbleWidget->radius();
+        state.projection = marbleWidget->projection();
+        state.size       = marbleWidget->size();
+
+        return state;
+    }
+
+    /**
+     * @brief Drops the cached screen positions if the viewport changed since they were projected
+     */
+    void validateProjectionCache()
+    {
+        const ViewportState currentState = currentViewportState();
+
+        if (currentState != projectionCacheState)
+        {
+            projectionCacheState = currentState;
+            projectionCache.clear();
+        }
+
+        projectionCacheValid = true;
+    }
+
     QPointer<Marble::MarbleWidget>            marbleWidget;
 
     QActionGroup*                             actionGroupMapTheme;
@@ -167,7 +322,29 @@ public:
     bool                                      widgetIsDocked;
     bool                                      blockingZoomWhileChangingTheme;
 
-    QHash<quint64, Marble::GeoDataLineString> trackCache;
+    QHash<quint64, SimplifiedTrack>           trackCache;
+    QHash<ModelHelper*, UngroupedModelTiler>  ungroupedModelTilers;
+
+    /// screen positions of coordinates, valid as long as the viewport does not change
+    ViewportState                             projectionCacheState;
+    bool                                      projectionCacheValid;
+    QHash<QPair<qreal, qreal>, ProjectedPoint> projectionCache;
+
+    /// tracks, markers and clusters, rendered again only when they or the viewport change
+    QPixmap                                   staticLayer;
+    ViewportState                             staticLayerState;
+    bool                                      staticLayerDirty;
+    int                                       staticLayerMovingClusterIndex;
+    int                                       staticLayerMarkersInMovingCluster;
+
+    /// collects repaint requests, see slotScheduleUpdate()
+    RepaintScheduler*                         repaintScheduler;
+
+    /// markers to snap to by screen cell, see buildSnapGrid()
+    QHash<QPair<int, int>, QVector<SnapCandidate> > snapGrid;
+    bool                                      snapGridValid;
+    ViewportState                             snapGridState;
+    int                                       snapGridRadius;
 
 #ifdef KGEOMAP_MARBLE_ADD_LAYER
     BackendMarbleLayer*                       bmLayer;
@@ -178,6 +355,11 @@ BackendMarble::BackendMarble(const QExplicitlySharedDataPointer<KGeoMapSharedDat
     : MapBackend(sharedData, parent), d(new Private())
 {
     createActions();
+
+    d->repaintScheduler = new RepaintScheduler(this);
+
+    connect(d->repaintScheduler, SIGNAL(signalRepaint()),
+            this, SLOT(slotUpdateTimerTimeout()));
 }
 
 BackendMarble::~BackendMarble()
@@ -243,6 +425,9 @@ QWidget* BackendMarble::mapWidget()
         connect(d->marbleWidget, SIGNAL(zoomChanged(int)),
                 this, SLOT(slotMarbleZoomChanged()));
 
+        connect(d->marbleWidget, SIGNAL(visibleLatLonAltBoxChanged(GeoDataLatLonAltBox)),
+                this, SLOT(slotMarbleViewportChanged()));
+
         // set a backend first
         /// @todo Do this only if we are set active!
         applyCacheToWidget();
@@ -269,6 +454,11 @@ void BackendMarble::releaseWidget(KGeoMapInternalWidgetInfo* const info)
     disconnect(d->marbleWidget, SIGNAL(zoomChanged(int)),
                this, SLOT(slotMarbleZoomChanged(int)));
 
+    disconnect(d->marbleWidget, SIGNAL(visibleLatLonAltBoxChanged(GeoDataLatLonAltBox)),
+               this, SLOT(slotMarbleViewportChanged()));
+
+    d->projectionCacheValid = false;
+
     info->currentOwner = nullptr;
     info->state        = KGeoMapInternalWidgetInfo::InternalWidgetReleased;
 
@@ -530,9 +720,16 @@ void BackendMarble::updateMarkers()
     }
 
     // just redraw, that's it:
-    d->marbleWidget->update();
+    slotScheduleUpdate();
 }
 
+/**
+ * @brief Projects coordinates onto the screen
+ *
+ * The results are cached until the center, the zoom, the projection or the size of
+ * the map change, so that repaints which only update overlays, like the selection
+ * rectangle or a marker being dragged, do not have to project all markers again.
+ */
 bool BackendMarble::screenCoordinates(const GeoCoordinates& coordinates, QPoint* const point)
 {
     if (!d->marbleWidget)
@@ -545,17 +742,41 @@ bool BackendMarble::screenCoordinates(const GeoCoordinates& coordinates, QPoint*
         return false;
     }
 
-    qreal x, y;
-    const bool isVisible = d->marbleWidget->screenCoordinates(coordinates.lon(), coordinates.lat(), x, y);
+    // the viewport is only compared once per paint or after Marble reported a change of it
+    if (!d->projectionCacheValid)
+    {
+        d->validateProjectionCache();
+    }
+
+    // keep the cache from growing without limits while the viewport stays the same
+    const int maxProjectionCacheSize = 200000;
 
-    if (!isVisible)
+    if (d->projectionCache.size() >= maxProjectionCacheSize)
+    {
+        d->projectionCache.clear();
+    }
+
+    const QPair<qreal, qreal> cacheKey(coordinates.lat(), coordinates.lon());
+    QHash<QPair<qreal, qreal>, Private::ProjectedPoint>::const_iterator it = d->projectionCache.constFind(cacheKey);
+
+    if (it == d->projectionCache.constEnd())
+    {
+        qreal x, y;
+        Private::ProjectedPoint projectedPoint;
+        projectedPoint.isVisible = d->marbleWidget->screenCoordinates(coordinates.lon(), coordinates.lat(), x, y);
+        projectedPoint.point     = QPoint(x, y);
+
+        it = d->projectionCache.insert(cacheKey, projectedPoint);
+    }
+
+    if (!it->isVisible)
     {
         return false;
     }
 
     if (point)
     {
-        *point = QPoint(x, y);
+        *point = it->point;
     }
 
     return true;
@@ -594,6 +815,9 @@ bool BackendMarble::geoCoordinates(const QPoint& point, GeoCoordinates* const co
 /**
  * @brief Replacement for Marble::GeoPainter::drawPixmap which takes a pixel offset
  *
+ * The pixmap is drawn directly at its cached screen position, instead of projecting
+ * the coordinates back and forth to let Marble center the pixmap on them.
+ *
  * @param painter Marble::GeoPainter on which to draw the pixmap
  * @param pixmap Pixmap to be drawn
  * @param coordinates GeoCoordinates where the image is to be drawn
@@ -611,79 +835,80 @@ void BackendMarble::GeoPainter_drawPixmapAtCoordinates(Marble::GeoPainter* const
         return;
     }
 
-    // Marble::GeoPainter::drawPixmap(coordinates, pixmap) draws the pixmap centered on coordinates
-    // therefore we calculate the pixel position of the center of the image if its offsetPoint is to be
-    // at pointOnScreen:
-    const QSize pixmapSize      = pixmap.size();
-    const QPoint pixmapHalfSize = QPoint(pixmapSize.width()/2, pixmapSize.height()/2);
-    const QPoint drawPoint      = pointOnScreen + pixmapHalfSize - offsetPoint;
-
-    // now re-calculate the coordinates of the new pixel coordinates:
-    GeoCoordinates drawGeoCoordinates;
-
-    if (!geoCoordinates(drawPoint, &drawGeoCoordinates))
-    {
-        return;
-    }
-
-    // convert to Marble datatype and draw:
-    const Marble::GeoDataCoordinates mcoord = drawGeoCoordinates.toMarbleCoordinates();
-    painter->drawPixmap(mcoord, pixmap);
+    // the painter works in screen coordinates, there is no need to let Marble
+    // project the coordinates once more
+    painter->drawPixmap(pointOnScreen - offsetPoint, pixmap);
 }
 
-void BackendMarble::marbleCustomPaint(Marble::GeoPainter* painter)
+/**
+ * @brief Paints the tracks, the ungrouped markers and the clusters
+ *
+ * These do not change while the user drags a cluster or a selection rectangle,
+ * therefore marbleCustomPaint() renders them into a cached layer.
+ *
+ * @return The number of markers which are moved together with the moving cluster
+ */
+int BackendMarble::paintStaticContent(Marble::GeoPainter* const painter)
 {
-    if (!d->activeState)
-    {
-        return;
-    }
-
-    // check whether the parameters of the map changed and we may have to update the clusters:
-    if ( (d->clustersDirtyCacheLat        != d->marbleWidget->centerLatitude())  ||
-         (d->clustersDirtyCacheLon        != d->marbleWidget->centerLongitude()) ||
-         (d->clustersDirtyCacheProjection != d->marbleWidget->projection()) )
-    {
-//         qCDebug(LIBKGEOMAP_LOG)<<d->marbleWidget->centerLatitude()<<d->marbleWidget->centerLongitude()<<d->marbleWidget->projection();
-        d->clustersDirtyCacheLat        = d->marbleWidget->centerLatitude();
-        d->clustersDirtyCacheLon        = d->marbleWidget->centerLongitude();
-        d->clustersDirtyCacheProjection = d->marbleWidget->projection();
-        s->worldMapWidget->markClustersAsDirty();
-    }
-
-    painter->save();
-
     if (s->trackManager)
     {
         if (s->trackManager->getVisibility())
         {
             TrackManager::Track::List const& tracks = s->trackManager->getTrackList();
 
-            for (int trackIdx = 0; trackIdx < tracks.count(); ++trackIdx)
+            // Marble's radius is the radius of the globe in pixels. Details smaller than a pixel
+            // are not visible. The tolerance is rounded down to a power of two, so that the
+            // simplified tracks can be re-used while zooming a little.
+            const qreal degreesPerPixel = 180.0 / (M_PI * qMax(1, d->marbleWidget->radius()));
+            const int detailLevel       = int(std::floor(std::log2(degreesPerPixel)));
+            const qreal tolerance       = std::ldexp(1.0, detailLevel);
+
+            // only the segments of the tracks which can be seen are drawn
+            const QList<TrackManager::SegmentReference> visibleSegments = s->trackManager->segmentsInRegions(getNormalizedBounds());
+
+            for (int i = 0; i < visibleSegments.count(); )
             {
+                // join consecutive segments of a track into one line
+                const int trackIdx     = visibleSegments.at(i).first;
+                const int firstSegment = visibleSegments.at(i).second;
+                int lastSegment        = firstSegment;
+
+                for (++i; (i < visibleSegments.count()) &&
+                          (visibleSegments.at(i).first  == trackIdx) &&
+                          (visibleSegments.at(i).second == lastSegment + 1); ++i)
+                {
+                    ++lastSegment;
+                }
+
                 TrackManager::Track const& track = tracks.at(trackIdx);
+                const int firstPoint             = track.segments.at(firstSegment).firstPoint;
+                const int lastPoint              = track.segments.at(lastSegment).lastPoint;
 
-                if (track.points.count() < 2)
+                QHash<quint64, Private::SimplifiedTrack>::iterator it = d->trackCache.find(track.id);
+
+                if ((it == d->trackCache.end()) || (it->detailLevel != detailLevel))
                 {
-                    continue;
+                    Private::SimplifiedTrack simplifiedTrack;
+                    simplifiedTrack.detailLevel  = detailLevel;
+                    simplifiedTrack.pointIndices = TrackManager::simplifiedPointIndices(track, tolerance);
+
+                    it = d->trackCache.insert(track.id, simplifiedTrack);
                 }
 
+                // the simplified points between the end points of the segments
+                const QList<int>& pointIndices                 = it->pointIndices;
+                const QList<int>::const_iterator firstInterior = std::upper_bound(pointIndices.constBegin(), pointIndices.constEnd(), firstPoint);
+                const QList<int>::const_iterator lastInterior  = std::lower_bound(firstInterior, pointIndices.constEnd(), lastPoint);
+
                 Marble::GeoDataLineString lineString;
+                lineString << track.points.at(firstPoint).coordinates.toMarbleCoordinates();
 
-                if (d->trackCache.contains(track.id))
+                for (QList<int>::const_iterator pointIt = firstInterior; pointIt != lastInterior; ++pointIt)
                 {
-                    lineString = d->trackCache.value(track.id);
+                    lineString << track.points.at(*pointIt).coordinates.toMarbleCoordinates();
                 }
-                else
-                {
-                    for (int coordIdx = 0; coordIdx < track.points.count(); ++coordIdx)
-                    {
-                        GeoCoordinates const& coordinates                  = track.points.at(coordIdx).coordinates;
-                        const Marble::GeoDataCoordinates marbleCoordinates = coordinates.toMarbleCoordinates();
-                        lineString << marbleCoordinates;
-                    }
 
-                    d->trackCache.insert(track.id, lineString);
-                }
+                lineString << track.points.at(lastPoint).coordinates.toMarbleCoordinates();
 
                 /// @todo 5 looks a bit too thick IMHO when you zoom out.
                 ///       Maybe adjust to zoom level?
@@ -702,16 +927,31 @@ void BackendMarble::marbleCustomPaint(Marble::GeoPainter* painter)
         if (!modelHelper->modelFlags().testFlag(ModelHelper::FlagVisible))
             continue;
 
-        QAbstractItemModel* const model = modelHelper->model();
+        // render the markers in the visible part of the map:
+        const QList<QPersistentModelIndex> visibleMarkers = visibleUngroupedMarkers(modelHelper);
 
-        // render all visible markers:
-        for (int row = 0; row < model->rowCount(); ++row)
+        // the visible markers are top level items, their coordinates are read by row from the cache
+        const int cachedRowCount      = modelHelper->cachedRowCount();
+        const qreal* const latitudes  = modelHelper->cachedLatitudes();
+        const qreal* const longitudes = modelHelper->cachedLongitudes();
+
+        for (int markerIdx = 0; markerIdx < visibleMarkers.count(); ++markerIdx)
         {
-            const QModelIndex currentIndex = model->index(row, 0);
+            const QModelIndex currentIndex = visibleMarkers.at(markerIdx);
+            const int row                  = currentIndex.row();
             GeoCoordinates markerCoordinates;
 
-            if (!modelHelper->itemCoordinates(currentIndex, &markerCoordinates))
+            if (row < cachedRowCount)
+            {
+                if (qIsNaN(latitudes[row]) || qIsNaN(longitudes[row]))
+                    continue;
+
+                markerCoordinates = GeoCoordinates(latitudes[row], longitudes[row]);
+            }
+            else if (!modelHelper->cachedItemCoordinates(currentIndex, &markerCoordinates))
+            {
                 continue;
+            }
 
             // is the marker being moved right now?
             if (currentIndex == d->mouseMoveMarkerIndex)
@@ -747,8 +987,6 @@ void BackendMarble::marbleCustomPaint(Marble::GeoPainter* painter)
     if (s->markerModel)
     {
         // now for the clusters:
-        s->worldMapWidget->updateClusters();
-
         for (int i = 0; i < s->clusterList.size(); ++i)
         {
             const KGeoMapCluster& cluster            = s->clusterList.at(i);
@@ -791,6 +1029,76 @@ void BackendMarble::marbleCustomPaint(Marble::GeoPainter* painter)
         }
     }
 
+    return markersInMovingCluster;
+}
+
+void BackendMarble::marbleCustomPaint(Marble::GeoPainter* painter)
+{
+    if (!d->activeState)
+    {
+        return;
+    }
+
+    d->validateProjectionCache();
+
+    // check whether the parameters of the map changed and we may have to update the clusters:
+    if ( (d->clustersDirtyCacheLat        != d->marbleWidget->centerLatitude())  ||
+         (d->clustersDirtyCacheLon        != d->marbleWidget->centerLongitude()) ||
+         (d->clustersDirtyCacheProjection != d->marbleWidget->projection()) )
+    {
+//         qCDebug(LIBKGEOMAP_LOG)<<d->marbleWidget->centerLatitude()<<d->marbleWidget->centerLongitude()<<d->marbleWidget->projection();
+        d->clustersDirtyCacheLat        = d->marbleWidget->centerLatitude();
+        d->clustersDirtyCacheLon        = d->marbleWidget->centerLongitude();
+        d->clustersDirtyCacheProjection = d->marbleWidget->projection();
+        s->worldMapWidget->markClustersAsDirty();
+    }
+
+    if (s->markerModel)
+    {
+        // the clusters have to be up to date before deciding whether the static layer is still valid
+        s->worldMapWidget->updateClusters();
+    }
+
+    const Private::ViewportState currentState = d->currentViewportState();
+    const int movingClusterIndex              = d->haveMouseMovingObject ? d->mouseMoveClusterIndex : -1;
+
+    // Repaints which only move the overlays drawn below re-use the static layer. A moving
+    // ungrouped marker is part of the static content, so the layer can not be re-used then.
+    const qreal pixelRatio = d->marbleWidget->devicePixelRatioF();
+
+    if ( d->staticLayerDirty                                           ||
+         d->mouseMoveMarkerIndex.isValid()                             ||
+         (d->staticLayerState                != currentState)          ||
+         (d->staticLayerMovingClusterIndex   != movingClusterIndex)    ||
+         (d->staticLayer.devicePixelRatioF() != pixelRatio) )
+    {
+        const QSize layerSize = currentState.size * pixelRatio;
+
+        // panning re-renders the layer on every frame, so the pixmap is only re-allocated when needed
+        if ((d->staticLayer.size() != layerSize) || (d->staticLayer.devicePixelRatioF() != pixelRatio))
+        {
+            d->staticLayer = QPixmap(layerSize);
+            d->staticLayer.setDevicePixelRatio(pixelRatio);
+        }
+
+        d->staticLayer.fill(Qt::transparent);
+
+        Marble::GeoPainter layerPainter(&d->staticLayer, d->marbleWidget->viewport(), d->marbleWidget->mapQuality());
+        layerPainter.setRenderHints(painter->renderHints());
+        d->staticLayerMarkersInMovingCluster = paintStaticContent(&layerPainter);
+        layerPainter.end();
+
+        d->staticLayerState              = currentState;
+        d->staticLayerMovingClusterIndex = movingClusterIndex;
+        d->staticLayerDirty              = false;
+    }
+
+    painter->save();
+
+    painter->drawPixmap(0, 0, d->staticLayer);
+
+    const int markersInMovingCluster = d->staticLayerMarkersInMovingCluster;
+
     // now render the mouse-moving cluster, if there is one:
     if (d->haveMouseMovingObject&&(d->mouseMoveClusterIndex>=0))
     {
@@ -975,18 +1283,21 @@ void BackendMarble::slotFloatSettingsTriggered(QAction* action)
 
 void BackendMarble::slotClustersNeedUpdating()
 {
+    d->staticLayerDirty = true;
+
     if (!d->marbleWidget)
     {
         return;
     }
 
     // tell the widget to redraw:
-    d->marbleWidget->update();
+    slotScheduleUpdate();
 }
 
 void BackendMarble::updateClusters()
 {
-    // clusters are only needed during redraw
+    // clusters are only needed during redraw, but the cached layer shows the old ones
+    d->staticLayerDirty = true;
 }
 
 QSize BackendMarble::mapSize() const
@@ -1052,8 +1363,10 @@ int BackendMarble::getMarkerModelLevel()
             else if (currentZoom<1900) { tileLevel = 6; }
             else if (currentZoom<2300) { tileLevel = 7; }
             else if (currentZoom<2800) { tileLevel = 8; }
-            else                       { tileLevel = 9; }
-            // note: level 9 is not enough starting at zoom level 3200
+            else if (currentZoom<3200) { tileLevel = 9; }
+            else if (currentZoom<3700) { tileLevel = 10; }
+            else if (currentZoom<4100) { tileLevel = 11; }
+            else                       { tileLevel = 12; }
             break;
 
         case Marble::Mercator:
@@ -1063,8 +1376,10 @@ int BackendMarble::getMarkerModelLevel()
             else if (currentZoom<1900) { tileLevel = 6; }
             else if (currentZoom<2300) { tileLevel = 7; }
             else if (currentZoom<2800) { tileLevel = 8; }
-            else                       { tileLevel = 9; }
-            // note: level 9 is not enough starting at zoom level 3200
+            else if (currentZoom<3200) { tileLevel = 9; }
+            else if (currentZoom<3700) { tileLevel = 10; }
+            else if (currentZoom<4100) { tileLevel = 11; }
+            else                       { tileLevel = 12; }
             break;
 
         default:
@@ -1074,13 +1389,15 @@ int BackendMarble::getMarkerModelLevel()
             else if (currentZoom<1800) { tileLevel = 6; }
             else if (currentZoom<2200) { tileLevel = 7; }
             else if (currentZoom<2800) { tileLevel = 8; }
-            else                       { tileLevel = 9; }
-            // note: level 9 is not enough starting at zoom level 3200
+            else if (currentZoom<3200) { tileLevel = 9; }
+            else if (currentZoom<3700) { tileLevel = 10; }
+            else if (currentZoom<4100) { tileLevel = 11; }
+            else                       { tileLevel = 12; }
             break;
     }
 
-    // TODO: verify that this assertion was too strict
-//     KGEOMAP_ASSERT(tileLevel <= AbstractMarkerTiler::TileIndex::MaxLevel-1);
+    // the tile grouper limits this to the depth of the marker tiler
+    KGEOMAP_ASSERT(tileLevel <= TileIndex::MaxLevel);
 
     return tileLevel;
 }
@@ -1426,6 +1743,8 @@ bool BackendMarble::eventFilter(QObject *object, QEvent *event)
             d->haveMouseMovingObject = false;
             d->mouseMoveClusterIndex = -1;
             d->mouseMoveMarkerIndex  = QPersistentModelIndex();
+            d->snapGridValid         = false;
+            d->snapGrid.clear();
             d->marbleWidget->update();
             s->haveMovingCluster     = false;
         }
@@ -1490,42 +1809,115 @@ void BackendMarble::updateActionAvailability()
     d->actionShowOverviewMap->setChecked(d->cacheShowOverviewMap);
 }
 
-void BackendMarble::slotThumbnailAvailableForIndex(const QVariant& index, const QPixmap& pixmap)
+void BackendMarble::slotThumbnailsAvailable(const QVariantList& indices, const QList<QPixmap>& pixmaps)
 {
     if (!d->marbleWidget)
     {
         return;
     }
 
-    qCDebug(LIBKGEOMAP_LOG) << index << pixmap.size();
+    qCDebug(LIBKGEOMAP_LOG) << indices.count();
 
-    if (pixmap.isNull() || !s->showThumbnails)
+    // one re-paint of the map draws all new pixmaps, if any of the visible clusters uses them
+    if (!clustersRepresentedBy(indices, pixmaps).isEmpty())
     {
-        return;
+        slotScheduleUpdate();
     }
+}
 
-    // TODO: properly reject pixmaps with the wrong size
-    const int expectedThumbnailSize = s->worldMapWidget->getUndecoratedThumbnailSize();
+void BackendMarble::slotUngroupedModelChanged(const int /*index*/)
+{
+    // drop the spatial indices of models which were removed
+    for (QHash<ModelHelper*, Private::UngroupedModelTiler>::iterator it = d->ungroupedModelTilers.begin();
+         it != d->ungroupedModelTilers.end(); )
+    {
+        if (!it->modelHelper || !s->ungroupedModels.contains(it.key()))
+        {
+            delete it->tiler;
+            it = d->ungroupedModelTilers.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    // the tilers follow the changes of the rows and coordinates of their models themselves
+    d->staticLayerDirty = true;
+    d->snapGridValid    = false;
 
-    if ((pixmap.size().height() != expectedThumbnailSize) && (pixmap.size().width() != expectedThumbnailSize))
+    if (!d->marbleWidget)
     {
         return;
     }
 
-    // re-paint the map
-    d->marbleWidget->update();
+    slotScheduleUpdate();
 }
 
-void BackendMarble::slotUngroupedModelChanged(const int index)
+ItemMarkerTiler* BackendMarble::ungroupedModelTiler(ModelHelper* const modelHelper)
 {
-    Q_UNUSED(index)
+    Private::UngroupedModelTiler& entry = d->ungroupedModelTilers[modelHelper];
 
-    if (!d->marbleWidget)
+    // a new model helper may live at the address of a deleted one
+    if (entry.tiler && !entry.modelHelper)
     {
-        return;
+        delete entry.tiler;
+        entry.tiler = nullptr;
+    }
+
+    if (!entry.tiler)
+    {
+        entry.modelHelper = modelHelper;
+        entry.tiler       = new ItemMarkerTiler(modelHelper, this);
+    }
+
+    return entry.tiler;
+}
+
+/**
+ * @brief Returns the markers of an ungrouped model which may be visible, sorted by row
+ *
+ * The markers are looked up in the tiles covering the visible part of the map, so that
+ * painting does not have to look at all markers of the model. The markers in tiles
+ * at the border of the map still have to be tested by screenCoordinates().
+ */
+QList<QPersistentModelIndex> BackendMarble::visibleUngroupedMarkers(ModelHelper* const modelHelper)
+{
+    ItemMarkerTiler* const tiler             = ungroupedModelTiler(modelHelper);
+    const GeoCoordinates::PairList mapBounds = getNormalizedBounds();
+
+    // Cull with tiles of about a quarter of the size of the viewport: smaller tiles have to
+    // be visited in large numbers, larger ones contain many markers outside of the viewport.
+    qreal viewportFraction = 0.0;
+
+    for (int i = 0; i < mapBounds.count(); ++i)
+    {
+        const GeoCoordinates::Pair& bounds = mapBounds.at(i);
+        viewportFraction = qMax(viewportFraction, qAbs(bounds.second.lat() - bounds.first.lat()) / 180.0);
+        viewportFraction = qMax(viewportFraction, qAbs(bounds.second.lon() - bounds.first.lon()) / 360.0);
     }
 
-    d->marbleWidget->update();
+    // a tile at level l covers 1/Tiling^(l+1) of the map in each direction
+    int level = 0;
+
+    while ((level < tiler->maxLevel()) &&
+           (std::pow(qreal(TileIndex::Tiling), level + 2) * viewportFraction <= 4.0))
+    {
+        ++level;
+    }
+
+    QList<QPersistentModelIndex> result;
+
+    for (AbstractMarkerTiler::NonEmptyIterator tileIterator(tiler, level, mapBounds);
+         !tileIterator.atEnd(); tileIterator.nextIndex())
+    {
+        result << tiler->getTileMarkerIndices(tileIterator.currentIndex());
+    }
+
+    // keep the painting order of the model
+    std::sort(result.begin(), result.end());
+
+    return result;
 }
 
 void BackendMarble::slotTrackManagerChanged()
@@ -1545,83 +1937,151 @@ void BackendMarble::slotTrackManagerChanged()
     slotScheduleUpdate();
 }
 
-bool BackendMarble::findSnapPoint(const QPoint& actualPoint, QPoint* const snapPoint, GeoCoordinates* const snapCoordinates, QPair<int, QModelIndex>* const snapTargetIndex)
+/**
+ * @brief Collects the markers of the snapping models in a grid of screen cells
+ *
+ * The cells are as large as the snap radius, so all markers within the snap radius
+ * of a point are in the cell of the point or in one of its neighbours. The grid is
+ * built once per drag and re-used for every mouse move, as long as the viewport and
+ * the snap radius do not change.
+ */
+void BackendMarble::buildSnapGrid()
 {
-    QPoint bestSnapPoint;
-    GeoCoordinates bestSnapCoordinates;
-    int bestSnapDistanceSquared = -1;
-    QModelIndex bestSnapIndex;
-    int bestSnapUngroupedModel  = -1;
+    d->snapGrid.clear();
+    d->snapGridValid  = true;
+    d->snapGridState  = d->currentViewportState();
+    d->snapGridRadius = s->snapRadius;
 
-    // now handle snapping: is there any object close by?
     for (int im = 0; im < s->ungroupedModels.count(); ++im)
     {
         ModelHelper* const modelHelper = s->ungroupedModels.at(im);
 
-        // TODO: test for active snapping
         if ((!modelHelper->modelFlags().testFlag(ModelHelper::FlagVisible)) ||
             (!modelHelper->modelFlags().testFlag(ModelHelper::FlagSnaps)))
         {
             continue;
         }
 
-        // TODO: configurable snapping radius
-        const int snapRadiusSquared         = 10*10;
         QAbstractItemModel* const itemModel = modelHelper->model();
+        const int rowCount                  = itemModel->rowCount();
 
-        for (int row = 0; row < itemModel->rowCount(); ++row)
+        // read the coordinates by row from the coordinate cache, unless it is out of sync with the model
+        const bool haveCachedRows           = (modelHelper->cachedRowCount() == rowCount);
+        const qreal* const latitudes        = modelHelper->cachedLatitudes();
+        const qreal* const longitudes       = modelHelper->cachedLongitudes();
+
+        for (int row = 0; row < rowCount; ++row)
         {
-            const QModelIndex currentIndex = itemModel->index(row, 0);
-            GeoCoordinates currentCoordinates;
+            Private::SnapCandidate candidate;
+
+            if (haveCachedRows)
+            {
+                if (qIsNaN(latitudes[row]) || qIsNaN(longitudes[row]))
+                {
+                    continue;
+                }
 
-            if (!modelHelper->itemCoordinates(currentIndex, &currentCoordinates))
+                candidate.coordinates = GeoCoordinates(latitudes[row], longitudes[row]);
+            }
+            else if (!modelHelper->cachedItemCoordinates(itemModel->index(row, 0), &candidate.coordinates))
             {
                 continue;
             }
 
-            QPoint snapMarkerPoint;
-
-            if (!screenCoordinates(currentCoordinates, &snapMarkerPoint))
+            if (!screenCoordinates(candidate.coordinates, &candidate.point))
             {
                 continue;
             }
 
-            const QPoint distancePoint    = snapMarkerPoint - actualPoint;
-            const int snapDistanceSquared = (distancePoint.x()*distancePoint.x()+distancePoint.y()*distancePoint.y());
+            candidate.modelIndex = im;
+            candidate.row        = row;
 
-            if ((snapDistanceSquared <= snapRadiusSquared) &&
-                ((bestSnapDistanceSquared == -1) || (bestSnapDistanceSquared > snapDistanceSquared)))
-            {
-                bestSnapDistanceSquared = snapDistanceSquared;
-                bestSnapPoint           = snapMarkerPoint;
-                bestSnapCoordinates     = currentCoordinates;
-                bestSnapIndex           = currentIndex;
-                bestSnapUngroupedModel  = im;
-            }
+            const QPair<int, int> cell(qFloor(qreal(candidate.point.x()) / d->snapGridRadius),
+                                       qFloor(qreal(candidate.point.y()) / d->snapGridRadius));
+            d->snapGrid[cell] << candidate;
         }
     }
+}
+
+bool BackendMarble::findSnapPoint(const QPoint& actualPoint, QPoint* const snapPoint, GeoCoordinates* const snapCoordinates, QPair<int, QModelIndex>* const snapTargetIndex)
+{
+    const int snapRadius = s->snapRadius;
+
+    if ((snapRadius <= 0) || !d->marbleWidget)
+    {
+        return false;
+    }
 
-    const bool foundSnapPoint = (bestSnapDistanceSquared>=0);
+    if ( !d->snapGridValid                                      ||
+         (d->snapGridRadius != snapRadius)                      ||
+         (d->snapGridState  != d->currentViewportState()) )
+    {
+        buildSnapGrid();
+    }
+
+    // now handle snapping: is there any object close by?
+    const int snapRadiusSquared                  = snapRadius*snapRadius;
+    const int cellX                              = qFloor(qreal(actualPoint.x()) / snapRadius);
+    const int cellY                              = qFloor(qreal(actualPoint.y()) / snapRadius);
+    const Private::SnapCandidate* bestCandidate  = nullptr;
+    int bestSnapDistanceSquared                  = -1;
 
-    if (foundSnapPoint)
+    for (int x = cellX - 1; x <= cellX + 1; ++x)
     {
-        if (snapPoint)
+        for (int y = cellY - 1; y <= cellY + 1; ++y)
         {
-            *snapPoint = bestSnapPoint;
-        }
+            QHash<QPair<int, int>, QVector<Private::SnapCandidate> >::const_iterator it = d->snapGrid.constFind(QPair<int, int>(x, y));
 
-        if (snapCoordinates)
-        {
-            *snapCoordinates = bestSnapCoordinates;
-        }
+            if (it == d->snapGrid.constEnd())
+            {
+                continue;
+            }
 
-        if (snapTargetIndex)
-        {
-            *snapTargetIndex = QPair<int, QModelIndex>(bestSnapUngroupedModel, bestSnapIndex);
+            for (int i = 0; i < it->count(); ++i)
+            {
+                const Private::SnapCandidate& candidate = it->at(i);
+                const int snapDistanceSquared           = QPointSquareDistance(candidate.point, actualPoint);
+
+                if (snapDistanceSquared > snapRadiusSquared)
+                {
+                    continue;
+                }
+
+                // on ties, prefer the first model and row, like a scan over all markers would
+                if ( !bestCandidate                                                ||
+                     (snapDistanceSquared < bestSnapDistanceSquared)               ||
+                     ( (snapDistanceSquared == bestSnapDistanceSquared) &&
+                       (qMakePair(candidate.modelIndex, candidate.row) < qMakePair(bestCandidate->modelIndex, bestCandidate->row)) ) )
+                {
+                    bestCandidate           = &candidate;
+                    bestSnapDistanceSquared = snapDistanceSquared;
+                }
+            }
         }
     }
 
-    return foundSnapPoint;
+    if (!bestCandidate || (bestCandidate->modelIndex >= s->ungroupedModels.count()))
+    {
+        return false;
+    }
+
+    if (snapPoint)
+    {
+        *snapPoint = bestCandidate->point;
+    }
+
+    if (snapCoordinates)
+    {
+        *snapCoordinates = bestCandidate->coordinates;
+    }
+
+    if (snapTargetIndex)
+    {
+        QAbstractItemModel* const itemModel = s->ungroupedModels.at(bestCandidate->modelIndex)->model();
+        *snapTargetIndex                    = QPair<int, QModelIndex>(bestCandidate->modelIndex, itemModel->index(bestCandidate->row, 0));
+    }
+
+    return true;
 }
 
 void BackendMarble::regionSelectionChanged()
@@ -1806,6 +2266,14 @@ void BackendMarble::applyCacheToWidget()
     setShowScaleBar(d->cacheShowScaleBar);
 }
 
+/**
+ * @brief Makes the next call of screenCoordinates() check whether the cached positions are still valid
+ */
+void BackendMarble::slotMarbleViewportChanged()
+{
+    d->projectionCacheValid = false;
+}
+
 void BackendMarble::slotTracksChanged(const QList<TrackManager::TrackChanges> trackChanges)
 {
     // invalidate the cache for all changed tracks
@@ -1820,11 +2288,27 @@ void BackendMarble::slotTracksChanged(const QList<TrackManager::TrackChanges> tr
     slotScheduleUpdate();
 }
 
+/**
+ * @brief Schedules a repaint after the content of the map changed
+ *
+ * Thumbnails, tracks, markers and clusters often change in bursts. The repaint
+ * scheduler merges them into at most one repaint per frame interval.
+ */
 void BackendMarble::slotScheduleUpdate()
+{
+    // the content changed, the cached layer has to be rendered again
+    d->staticLayerDirty = true;
+
+    if (d->marbleWidget && d->activeState)
+    {
+        d->repaintScheduler->schedule();
+    }
+}
+
+void BackendMarble::slotUpdateTimerTimeout()
 {
     if (d->marbleWidget && d->activeState)
     {
-        /// @todo Put this onto the eventloop to collect update calls into one.
         d->marbleWidget->update();
     }
 }
@@ -44,6 +44,8 @@ namespace Marble
 namespace KGeoMap
 {
 
+class ItemMarkerTiler;
+
 class BackendMarble : public MapBackend
 {
     Q_OBJECT
@@ -110,7 +112,7 @@ public:
 public Q_SLOTS:
 
     void slotClustersNeedUpdating() override;
-    void slotThumbnailAvailableForIndex(const QVariant& index, const QPixmap& pixmap) override;
+    void slotThumbnailsAvailable(const QVariantList& indices, const QList<QPixmap>& pixmaps) override;
     void slotUngroupedModelChanged(const int index);
     void slotTrackManagerChanged() override;
 
@@ -118,10 +120,14 @@ protected:
 
     bool eventFilter(QObject* object, QEvent* event) override;
     void createActions();
+    void buildSnapGrid();
     bool findSnapPoint(const QPoint& actualPoint, QPoint* const snapPoint, GeoCoordinates* const snapCoordinates, QPair<int, QModelIndex>* const snapTargetIndex);
+    int paintStaticContent(Marble::GeoPainter* const painter);
     void GeoPainter_drawPixmapAtCoordinates(Marble::GeoPainter* const painter, const QPixmap& pixmap, const GeoCoordinates& coordinates, const QPoint& basePoint);
     void drawSearchRectangle(Marble::GeoPainter* const painter, const GeoCoordinates::Pair& searchRectangle, const bool isOldRectangle);
     void applyCacheToWidget();
+    ItemMarkerTiler* ungroupedModelTiler(ModelHelper* const modelHelper);
+    QList<QPersistentModelIndex> visibleUngroupedMarkers(ModelHelper* const modelHelper);
 
     static void deleteInfoFunction(KGeoMapInternalWidgetInfo* const info);
 
@@ -131,8 +137,10 @@ protected Q_SLOTS:
     void slotProjectionActionTriggered(QAction* action);
     void slotFloatSettingsTriggered(QAction* action);
     void slotMarbleZoomChanged();
+    void slotMarbleViewportChanged();
     void slotTracksChanged(const QList<TrackManager::TrackChanges> trackChanges);
     void slotScheduleUpdate();
+    void slotUpdateTimerTimeout();
 
 private:
 
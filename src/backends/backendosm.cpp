@@ -9,7 +9,7 @@
  *
  * @author Copyright (C) 2009-2011 by Michael G. Hansen
  *         <a href="mailto:mike at mghansen dot de">mike at mghansen dot de</a>
- * @author Copyright (C) 2010-2015 by Gilles Caulier
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
  *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
  *
  * This program is free software; you can redistribute it
@@ -24,80 +24,109 @@
  *
  * ============================================================ */
 
-#include "backend_osm.h"
+#include "backendosm.h"
 
 // Qt includes
 
+#include <QBuffer>
+#include <QHash>
 #include <QMenu>
 #include <QPointer>
-#include <QAction>
+#include <QResizeEvent>
+#include <QtMath>
+#include <QtNumeric>
+#include <QVector>
+#include <QWebPage>
+
+// Marble includes
+
+#include <marble/GeoDataLatLonBox.h>
 
 // KDE includes
 
 #include <kconfiggroup.h>
-#include <khtml_part.h>
+#include <klocalizedstring.h>
 
 // local includes
 
+#include "htmlclusterdiff.h"
 #include "htmlwidget.h"
-#include "kgeomap.h"
-#include "markermodel.h"
+#include "tilenetworkaccessmanager.h"
+#include "mapwidget.h"
+#include "abstractmarkertiler.h"
+#include "modelhelper.h"
 #include "libkgeomap_debug.h"
 
 namespace KGeoMap
 {
 
+class OSMInternalWidgetInfo
+{
+public:
+
+    OSMInternalWidgetInfo()
+    {
+        htmlWidget = nullptr;
+    }
+
+    HTMLWidget* htmlWidget;
+};
+
+} /* KGeoMap */
+
+Q_DECLARE_METATYPE(KGeoMap::OSMInternalWidgetInfo)
+
+namespace KGeoMap
+{
+
 class BackendOSM::Private
 {
 public:
 
     Private()
-      : htmlWidget(0),
-        htmlWidgetWrapper(0),
+      : htmlWidget(nullptr),
+        htmlWidgetWrapper(nullptr),
         isReady(false),
+        activeState(false),
+        widgetIsDocked(false),
         cacheZoom(1),
         cacheCenter(0.0, 0.0),
-        cacheBounds()
+        cacheBounds(),
+        tileSourceRevision(0),
+        clusterDiff()
     {
     }
 
     QPointer<HTMLWidget>                  htmlWidget;
     QPointer<QWidget>                     htmlWidgetWrapper;
     bool                                  isReady;
+    bool                                  activeState;
+    bool                                  widgetIsDocked;
 
     int                                   cacheZoom;
     GeoCoordinates                        cacheCenter;
     QPair<GeoCoordinates, GeoCoordinates> cacheBounds;
+    int                                   tileSourceRevision;
+
+    HtmlClusterDiff                       clusterDiff;
 };
 
 BackendOSM::BackendOSM(const QExplicitlySharedDataPointer<KGeoMapSharedData>& sharedData, QObject* const parent)
-    : MapBackend(sharedData, parent), d(new Private())
-{
-    d->htmlWidgetWrapper = new QWidget();
-    d->htmlWidgetWrapper->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
-    d->htmlWidget        = new HTMLWidget(d->htmlWidgetWrapper);
-    d->htmlWidgetWrapper->resize(400, 400);
-
-    connect(d->htmlWidget, SIGNAL(signalJavaScriptReady()),
-            this, SLOT(slotHTMLInitialized()));
-
-    connect(d->htmlWidget, SIGNAL(signalHTMLEvents(QStringList)),
-            this, SLOT(slotHTMLEvents(QStringList)));
-
-    loadInitialHTML();
-}
-
-void BackendOSM::loadInitialHTML()
+    : MapBackend(sharedData, parent),
+      d(new Private())
 {
-    const QUrl htmlUrl = KGeoMapGlobalObject::instance()->locateDataFile("backend-osm.html");
-
-    d->htmlWidget->openUrl(htmlUrl);
 }
 
 BackendOSM::~BackendOSM()
 {
+    /// @todo Should we leave our widget in this list and not destroy it?
+    KGeoMapGlobalObject* const go = KGeoMapGlobalObject::instance();
+    go->removeMyInternalWidgetFromPool(this);
+
     if (d->htmlWidgetWrapper)
+    {
         delete d->htmlWidgetWrapper;
+    }
 
     delete d;
 }
@@ -112,8 +141,57 @@ QString BackendOSM::backendHumanName() const
     return i18n("OpenStreetMap");
 }
 
-QWidget* BackendOSM::mapWidget() const
+QWidget* BackendOSM::mapWidget()
 {
+    if (!d->htmlWidgetWrapper)
+    {
+        KGeoMapGlobalObject* const go = KGeoMapGlobalObject::instance();
+
+        KGeoMapInternalWidgetInfo info;
+        bool foundReusableWidget      = go->getInternalWidgetFromPool(this, &info);
+
+        if (foundReusableWidget)
+        {
+            d->htmlWidgetWrapper                = info.widget;
+            const OSMInternalWidgetInfo intInfo = info.backendData.value<OSMInternalWidgetInfo>();
+            d->htmlWidget                       = intInfo.htmlWidget;
+        }
+        else
+        {
+            // the widget has not been created yet, create it now:
+            d->htmlWidgetWrapper = new QWidget();
+            d->htmlWidgetWrapper->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+            d->htmlWidget        = new HTMLWidget(d->htmlWidgetWrapper);
+            d->htmlWidgetWrapper->resize(400,400);
+
+            // tiles are served from the local sources and the disk cache where possible
+            d->htmlWidget->page()->setNetworkAccessManager(TileNetworkAccessManager::instance());
+        }
+
+        connect(d->htmlWidget, SIGNAL(signalJavaScriptReady()),
+                this, SLOT(slotHTMLInitialized()));
+
+        connect(d->htmlWidget, SIGNAL(signalHTMLEvents(QVariantList)),
+                this, SLOT(slotHTMLEvents(QVariantList)));
+
+        connect(d->htmlWidget, SIGNAL(selectionHasBeenMade(KGeoMap::GeoCoordinates::Pair)),
+                this, SLOT(slotSelectionHasBeenMade(KGeoMap::GeoCoordinates::Pair)));
+
+        d->htmlWidget->setSharedKGeoMapObject(s.data());
+        d->htmlWidgetWrapper->installEventFilter(this);
+
+        if (foundReusableWidget)
+        {
+            slotHTMLInitialized();
+        }
+        else
+        {
+            const QUrl htmlUrl = KGeoMapGlobalObject::instance()->locateDataFile(QLatin1String("backend-osm.html"));
+
+            d->htmlWidget->load(htmlUrl);
+        }
+    }
+
     return d->htmlWidgetWrapper.data();
 }
 
@@ -124,13 +202,11 @@ GeoCoordinates BackendOSM::getCenter() const
 
 void BackendOSM::setCenter(const GeoCoordinates& coordinate)
 {
-    qCDebug(LIBKGEOMAP_LOG) << isReady() << coordinate.geoUrl();
     d->cacheCenter = coordinate;
 
     if (isReady())
     {
-        d->htmlWidget->runScript(QString::fromLatin1("kgeomapSetCenter(%1, %2);").arg(d->cacheCenter.latString())
-                                                                                 .arg(d->cacheCenter.lonString()));
+        d->htmlWidget->runScript(QString::fromLatin1("kgeomapSetCenter(%1, %2);").arg(d->cacheCenter.latString()).arg(d->cacheCenter.lonString()));
     }
 }
 
@@ -141,17 +217,54 @@ bool BackendOSM::isReady() const
 
 void BackendOSM::slotHTMLInitialized()
 {
-    qCDebug(LIBKGEOMAP_LOG) << 1;
+    d->isReady           = true;
+    d->clusterDiff.invalidate();
+
+    // set up the page in one script:
+    QString script = QString::fromLatin1("kgeomapWidgetResized(%1, %2);").arg(d->htmlWidgetWrapper->width()).arg(d->htmlWidgetWrapper->height());
+    script        += QString::fromLatin1("kgeomapSetTileUrl('%1');").arg(pageTileUrl());
+    script        += QString::fromLatin1("kgeomapSetCenter(%1, %2);").arg(d->cacheCenter.latString()).arg(d->cacheCenter.lonString());
+    script        += QString::fromLatin1("kgeomapSetZoom(%1);").arg(d->cacheZoom);
+    d->htmlWidget->runScript(script);
+
+    readMapState();
+
+    emit(signalBackendReadyChanged(backendName()));
+}
+
+/**
+ * @brief Reads center and zoom from the page in one call and derives the bounds from them
+ */
+void BackendOSM::readMapState()
+{
+    if (!isReady())
+        return;
+
+    const QVariantList mapState = d->htmlWidget->runScript(QLatin1String("kgeomapGetMapState();")).toList();
 
-    d->isReady = true;
-    d->htmlWidget->runScript(QLatin1String("document.getElementById(\"map_canvas\").style.height=\"%1px\"")
-                             .arg(d->htmlWidgetWrapper->height()));
+    if (mapState.count() != 3)
+        return;
+
+    d->cacheZoom   = mapState.at(0).toInt();
+    d->cacheCenter = GeoCoordinates(mapState.at(1).toDouble(), mapState.at(2).toDouble());
+
+    const QSize size          = mapSize();
+    const qreal worldSize     = 256.0 * qPow(2.0, d->cacheZoom);
+    const QPointF centerPoint = KGeoMapHelperMercatorProject(d->cacheCenter, d->cacheZoom);
+    const QPointF halfSize(size.width() / 2.0, size.height() / 2.0);
 
-    // TODO: call javascript directly here and update action availability in one shot
-    setCenter(d->cacheCenter);
-    d->htmlWidget->runScript(QString::fromLatin1("kgeomapSetZoom(%1);").arg(d->cacheZoom));
+    const GeoCoordinates northWest = KGeoMapHelperMercatorUnproject(centerPoint - halfSize, d->cacheZoom);
+    const GeoCoordinates southEast = KGeoMapHelperMercatorUnproject(centerPoint + halfSize, d->cacheZoom);
 
-    emit(signalBackendReady(backendName()));
+    if (size.width() >= worldSize)
+    {
+        // the whole world is visible
+        d->cacheBounds = GeoCoordinates::makePair(southEast.lat(), -180.0, northWest.lat(), 180.0);
+    }
+    else
+    {
+        d->cacheBounds = GeoCoordinates::makePair(southEast.lat(), northWest.lon(), northWest.lat(), southEast.lon());
+    }
 }
 
 void BackendOSM::zoomIn()
@@ -170,276 +283,401 @@ void BackendOSM::zoomOut()
     d->htmlWidget->runScript(QLatin1String("kgeomapZoomOut();"));
 }
 
-void BackendOSM::updateActionsEnabled()
-{
-    // TODO: manage state of the zoom buttons
-}
-
 void BackendOSM::addActionsToConfigurationMenu(QMenu* const configurationMenu)
 {
-    KGEOMAP_ASSERT(configurationMenu != 0);
+    KGEOMAP_ASSERT(configurationMenu != nullptr);
 
-    if (!d->isReady)
-        return;
+    // there are no settings for this backend which can be changed from the menu yet
 }
 
 void BackendOSM::saveSettingsToGroup(KConfigGroup* const group)
 {
-    KGEOMAP_ASSERT(group != 0);
+    KGEOMAP_ASSERT(group != nullptr);
 
     if (!group)
         return;
+
+    group->writeEntry("OSM Tile URL", tileUrl());
+    group->writeEntry("OSM Local Tile Directory", localTileDirectory());
+    group->writeEntry("OSM Offline", isOffline());
 }
 
 void BackendOSM::readSettingsFromGroup(const KConfigGroup* const group)
 {
-    KGEOMAP_ASSERT(group != 0);
+    KGEOMAP_ASSERT(group != nullptr);
 
     if (!group)
         return;
+
+    setTileUrl(group->readEntry("OSM Tile URL", tileUrl()));
+    setLocalTileDirectory(group->readEntry("OSM Local Tile Directory", localTileDirectory()));
+    setOffline(group->readEntry("OSM Offline", isOffline()));
 }
 
-void BackendOSM::updateMarkers()
+QString BackendOSM::tileUrl() const
+{
+    return TileNetworkAccessManager::instance()->remoteTileUrl();
+}
+
+/**
+ * @brief Sets the URL template of the tile server, for example http://localhost:8080/${z}/${x}/${y}.png
+ *
+ * The tile sources are shared by all OpenStreetMap backends.
+ */
+void BackendOSM::setTileUrl(const QString& tileUrl)
+{
+    if (tileUrl.isEmpty() || (tileUrl == this->tileUrl()))
+        return;
+
+    TileNetworkAccessManager::instance()->setRemoteTileUrl(tileUrl);
+    reloadTiles();
+}
+
+QString BackendOSM::localTileDirectory() const
+{
+    return TileNetworkAccessManager::instance()->localTileDirectory();
+}
+
+/**
+ * @brief Sets a directory with tiles laid out as z/x/y.png, which are used before any other source
+ */
+void BackendOSM::setLocalTileDirectory(const QString& directory)
+{
+    if (directory == localTileDirectory())
+        return;
+
+    TileNetworkAccessManager::instance()->setLocalTileDirectory(directory);
+    reloadTiles();
+}
+
+bool BackendOSM::isOffline() const
+{
+    return TileNetworkAccessManager::instance()->isOffline();
+}
+
+/**
+ * @brief In offline mode, only the local tile directory and the tile cache are used
+ */
+void BackendOSM::setOffline(const bool state)
+{
+    if (state == isOffline())
+        return;
+
+    TileNetworkAccessManager::instance()->setOffline(state);
+    reloadTiles();
+}
+
+QString BackendOSM::pageTileUrl() const
+{
+    // the revision makes the page request tiles again when the tile sources changed
+    return QString::fromLatin1("%1?%2").arg(TileNetworkAccessManager::pageTileUrl()).arg(d->tileSourceRevision);
+}
+
+void BackendOSM::reloadTiles()
+{
+    ++d->tileSourceRevision;
+
+    if (isReady())
+    {
+        d->htmlWidget->runScript(QString::fromLatin1("kgeomapSetTileUrl('%1');").arg(pageTileUrl()));
+    }
+}
+
+void BackendOSM::slotUngroupedModelChanged(const int mindex)
 {
     KGEOMAP_ASSERT(isReady());
 
     if (!isReady())
         return;
 
-    // re-transfer all markers to the javascript-part:
-    d->htmlWidget->runScript(QLatin1String("kgeomapClearMarkers();"));
+    // all markers of the model are transferred in one script
+    QString script = QString::fromLatin1("kgeomapClearMarkers(%1);").arg(mindex);
 
-    for (int row = 0; row < s->specialMarkersModel->rowCount(); ++row)
+    // this can happen when a model was removed and we are simply asked to remove its markers
+    if (mindex >= s->ungroupedModels.count())
     {
-        const QModelIndex currentIndex          = s->specialMarkersModel->index(row, 0);
-        const GeoCoordinates currentCoordinates = s->specialMarkersModel->data(currentIndex, s->specialMarkersCoordinatesRole).value<GeoCoordinates>();
+        d->htmlWidget->runScript(script);
+        return;
+    }
+
+    ModelHelper* const modelHelper = s->ungroupedModels.at(mindex);
 
-        d->htmlWidget->runScript(QLatin1String("kgeomapAddMarker(%1, %2, %3, %4);")
-                .arg(row)
-                .arg(currentCoordinates.latString())
-                .arg(currentCoordinates.lonString())
-                .arg(/*currentMarker.isDraggable()?*/"true"/*:"false"*/)
-            );
+    if (!modelHelper || !modelHelper->modelFlags().testFlag(ModelHelper::FlagVisible))
+    {
+        d->htmlWidget->runScript(script);
+        return;
     }
-}
 
-void BackendOSM::slotHTMLEvents(const QStringList& events)
-{
-    // for some events, we just note that they appeared and then process them later on:
-    bool centerProbablyChanged    = false;
-    bool mapTypeChanged           = false;
-    bool zoomProbablyChanged      = false;
-    bool mapBoundsProbablyChanged = false;
-    QIntList movedClusters;
-    QList<QPersistentModelIndex> movedMarkers;
+    QAbstractItemModel* const model = modelHelper->model();
+    const int rowCount              = model->rowCount();
 
-    for (QStringList::const_iterator it = events.constBegin(); it != events.constEnd(); ++it)
+    // read the coordinates by row from the coordinate cache, unless it is out of sync with the model
+    const bool haveCachedRows       = (modelHelper->cachedRowCount() == rowCount);
+    const qreal* const latitudes    = modelHelper->cachedLatitudes();
+    const qreal* const longitudes   = modelHelper->cachedLongitudes();
+    QStringList markerData;
+    QString pixmapScripts;
+
+    for (int row = 0; row < rowCount; ++row)
     {
-        const QString eventCode           = it->left(2);
-        const QString eventParameter      = it->mid(2);
-        const QStringList eventParameters = eventParameter.split(QLatin1Char( '/' ));
+        const QModelIndex currentIndex = model->index(row, 0);
+        GeoCoordinates currentCoordinates;
 
-        if (eventCode == "MB")
-        {   // NOTE: event currently disabled in javascript part
-            // map bounds changed
-            centerProbablyChanged    = true;
-            zoomProbablyChanged      = true;
-            mapBoundsProbablyChanged = true;
-        }
-        else if (eventCode == "ZC")
-        {   // NOTE: event currently disabled in javascript part
-            // zoom changed
-            zoomProbablyChanged      = true;
-            mapBoundsProbablyChanged = true;
+        if (haveCachedRows)
+        {
+            if (qIsNaN(latitudes[row]) || qIsNaN(longitudes[row]))
+                continue;
+
+            currentCoordinates = GeoCoordinates(latitudes[row], longitudes[row]);
         }
-        else if (eventCode == "id")
+        else if (!modelHelper->cachedItemCoordinates(currentIndex, &currentCoordinates))
         {
-            // idle after drastic map changes
-            centerProbablyChanged    = true;
-            zoomProbablyChanged      = true;
-            mapBoundsProbablyChanged = true;
+            continue;
         }
-        else if (eventCode == "cm")
+
+        const ModelHelper::Flags itemFlags = modelHelper->itemFlags(currentIndex);
+
+        if (!itemFlags.testFlag(ModelHelper::FlagVisible))
+            continue;
+
+        // three values per marker, see kgeomapAddMarkers
+        markerData << QString::number(row)
+                   << currentCoordinates.latString()
+                   << currentCoordinates.lonString();
+
+        QPoint     markerCenterPoint;
+        QSize      markerSize;
+        QPixmap    markerPixmap;
+        QUrl       markerUrl;
+        const bool markerHasIcon = modelHelper->itemIcon(currentIndex, &markerCenterPoint,
+                                                         &markerSize, &markerPixmap, &markerUrl);
+
+        if (markerHasIcon)
         {
-            // TODO: buffer this event type!
-            // cluster moved
-            bool okay              = false;
-            const int clusterIndex = eventParameter.toInt(&okay);
+            QString iconUrl = markerUrl.url();
+
+            if (markerUrl.isEmpty())
+            {
+                QByteArray bytes;
+                QBuffer buffer(&bytes);
+                buffer.open(QIODevice::WriteOnly);
+                markerPixmap.save(&buffer, "PNG");
+
+                // http://www.faqs.org/rfcs/rfc2397.html
+                iconUrl    = QString::fromLatin1("data:image/png;base64,%1").arg(QString::fromLatin1(bytes.toBase64()));
+                markerSize = markerPixmap.size();
+            }
+
+            pixmapScripts += QString::fromLatin1("kgeomapSetMarkerPixmap(%1,%2,%3,%4,%5,%6,'%7');")
+                                 .arg(mindex)
+                                 .arg(row)
+                                 .arg(markerSize.width())
+                                 .arg(markerSize.height())
+                                 .arg(markerCenterPoint.x())
+                                 .arg(markerCenterPoint.y())
+                                 .arg(iconUrl);
+        }
+    }
 
-            if (!okay)
-                continue;
+    // the pixmaps can only be set once the markers exist
+    script += QString::fromLatin1("kgeomapAddMarkers(%1, [%2]);").arg(mindex).arg(markerData.join(QLatin1Char(',')));
+    script += pixmapScripts;
 
-            if ((clusterIndex < 0) || (clusterIndex > s->clusterList.size()))
-                continue;
+    d->htmlWidget->runScript(script);
+}
 
-            // re-read the marker position:
-            GeoCoordinates clusterCoordinates;
-            const bool isValid = d->htmlWidget->runScript2Coordinates(
-                    QString::fromLatin1("kgeomapGetClusterPosition(%1);").arg(clusterIndex),
-                    &clusterCoordinates);
+void BackendOSM::updateMarkers()
+{
+    // re-transfer all markers to the javascript-part:
+    for (int i = 0; i < s->ungroupedModels.count(); ++i)
+    {
+        slotUngroupedModelChanged(i);
+    }
+}
 
-            if (!isValid)
-                continue;
+void BackendOSM::slotHTMLEvents(const QVariantList& events)
+{
+    bool mapStateChanged = false;
+    QIntList movedClusters;
+    QIntList clickedClusters;
 
-            // TODO: this discards the altitude!
-            s->clusterList[clusterIndex].coordinates = clusterCoordinates;
+    for (QVariantList::const_iterator it = events.constBegin(); it != events.constEnd(); ++it)
+    {
+        // each event holds its code followed by its parameters
+        const QVariantList event           = it->toList();
+        const QString eventCode            = event.value(0).toString();
+        const QVariantList eventParameters = event.mid(1);
 
-            movedClusters << clusterIndex;
+        if (eventCode == QLatin1String("id"))
+        {
+            // the map was moved or zoomed
+            mapStateChanged = true;
         }
-        else if (eventCode == "mm")
+        else if ((eventCode == QLatin1String("cm")) || (eventCode == QLatin1String("cc")))
         {
-            // TODO: buffer this event type!
-            // marker moved
-            bool okay           = false;
-            const int markerRow = eventParameter.toInt(&okay);
+            // cluster moved or clicked
+            bool okay              = false;
+            const int pageId       = eventParameters.value(0).toInt(&okay);
+            KGEOMAP_ASSERT(okay);
 
             if (!okay)
                 continue;
 
-            if ((markerRow < 0) || (markerRow > s->specialMarkersModel->rowCount()))
+            const int clusterIndex = d->clusterDiff.clusterIndexForPageId(pageId);
+            KGEOMAP_ASSERT(clusterIndex >= 0);
+            KGEOMAP_ASSERT(clusterIndex < s->clusterList.size());
+
+            if ((clusterIndex < 0) || (clusterIndex >= s->clusterList.size()))
                 continue;
 
-            // re-read the marker position:
-            GeoCoordinates markerCoordinates;
+            if (eventCode == QLatin1String("cc"))
+            {
+                clickedClusters << clusterIndex;
+                continue;
+            }
+
+            // re-read the cluster position:
+            GeoCoordinates clusterCoordinates;
             const bool isValid = d->htmlWidget->runScript2Coordinates(
-                    QString::fromLatin1("kgeomapGetMarkerPosition(%1);").arg(markerRow),
-                    &markerCoordinates
+                    QString::fromLatin1("kgeomapGetClusterPosition(%1);").arg(pageId),
+                    &clusterCoordinates
                 );
 
+            KGEOMAP_ASSERT(isValid);
+
             if (!isValid)
                 continue;
 
-            // TODO: this discards the altitude!
-            const QModelIndex markerIndex = s->specialMarkersModel->index(markerRow, 0);
-            s->specialMarkersModel->setData(markerIndex, QVariant::fromValue(markerCoordinates), s->specialMarkersCoordinatesRole);
+            /// @todo this discards the altitude!
+            s->clusterList[clusterIndex].coordinates = clusterCoordinates;
+
+            movedClusters << clusterIndex;
 
-            movedMarkers << QPersistentModelIndex(markerIndex);
+            // the moved cluster is shown at its new position, re-send all clusters:
+            d->clusterDiff.invalidate();
         }
-        else if (eventCode == "do")
+        else if (eventCode == QLatin1String("do"))
         {
             // debug output:
-            qCDebug(LIBKGEOMAP_LOG)<<QString::fromLatin1("javascript:%1").arg(eventParameter);
+            qCDebug(LIBKGEOMAP_LOG) << QString::fromLatin1("javascript:%1").arg(eventParameters.value(0).toString());
         }
     }
 
     if (!movedClusters.isEmpty())
     {
         qCDebug(LIBKGEOMAP_LOG) << movedClusters;
-        emit(signalClustersMoved(movedClusters));
+        emit(signalClustersMoved(movedClusters, QPair<int, QModelIndex>(-1, QModelIndex())));
     }
 
-    if (!movedMarkers.isEmpty())
+    if (!clickedClusters.isEmpty())
     {
-        qCDebug(LIBKGEOMAP_LOG) << movedMarkers;
-        emit(signalSpecialMarkersMoved(movedMarkers));
+        qCDebug(LIBKGEOMAP_LOG) << clickedClusters;
+        emit(signalClustersClicked(clickedClusters));
     }
 
-    // now process the buffered events:
-    if (zoomProbablyChanged)
+    if (mapStateChanged)
     {
-        d->cacheZoom = d->htmlWidget->runScript(QLatin1String("kgeomapGetZoom();")).toInt();
+        const int oldZoom = d->cacheZoom;
+        readMapState();
 
-        emit(signalZoomChanged(QString::fromLatin1("googlemaps:%1").arg(d->cacheZoom)));
-    }
-    if (centerProbablyChanged)
-    {
-        // there is nothing we can do if the coordinates are invalid
-        /*const bool isValid = */d->htmlWidget->runScript2Coordinates("kgeomapGetCenter();", &(d->cacheCenter));
-    }
-
-    // update the actions if necessary:
-    if (zoomProbablyChanged || mapTypeChanged || centerProbablyChanged)
-    {
-        updateActionsEnabled();
-    }
+        if (oldZoom != d->cacheZoom)
+        {
+            emit(signalZoomChanged(getZoom()));
+        }
 
-    if (mapBoundsProbablyChanged)
-    {
-        const QString mapBoundsString = d->htmlWidget->runScript("kgeomapGetBounds();").toString();
-        KGeoMapHelperParseBoundsString(mapBoundsString, &d->cacheBounds);
+        updateActionAvailability();
     }
 
-    if (mapBoundsProbablyChanged || !movedClusters.isEmpty())
+    if (mapStateChanged || !movedClusters.isEmpty())
     {
+        s->worldMapWidget->markClustersAsDirty();
         s->worldMapWidget->updateClusters();
     }
 }
 
 void BackendOSM::updateClusters()
 {
-    qCDebug(LIBKGEOMAP_LOG) << "start updateclusters";
     // re-transfer the clusters to the map:
     KGEOMAP_ASSERT(isReady());
 
     if (!isReady())
         return;
 
-    // TODO: only update clusters that have actually changed!
-
-    // re-transfer all markers to the javascript-part:
-    d->htmlWidget->runScript(QLatin1String("kgeomapClearClusters();"));
+    // only the clusters which changed since the last update are transferred, in one script
+    QIntList redrawnClusters;
+    QString script = d->clusterDiff.updateScript(s, &redrawnClusters);
 
-    for (int currentIndex = 0; currentIndex < s->clusterList.size(); ++currentIndex)
+    if (s->showThumbnails)
     {
-        const KGeoMapCluster& currentCluster = s->clusterList.at(currentIndex);
-
-        // determine the colors:
-        QColor       fillColor;
-        QColor       strokeColor;
-        Qt::PenStyle strokeStyle;
-        QColor       labelColor;
-        QString      labelText;
-        s->worldMapWidget->getColorInfos(currentIndex, &fillColor, &strokeColor,
-                                         &strokeStyle, &labelText, &labelColor);
-
-        const QString fillColorName = fillColor.name();
+        foreach(const int clusterIndex, redrawnClusters)
+        {
+            QPoint clusterCenterPoint;
+            const QPixmap clusterPixmap = s->worldMapWidget->getDecoratedPixmapForCluster(clusterIndex, nullptr, nullptr, &clusterCenterPoint);
 
-        d->htmlWidget->runScript(QLatin1String("kgeomapAddCluster(%1, %2, %3, %4, '%5', '%6');")
-                .arg(currentIndex)
-                .arg(currentCluster.coordinates.latString())
-                .arg(currentCluster.coordinates.lonString())
-                .arg(true?"true":"false")
-                .arg(fillColorName.mid(1))
-                .arg(labelText)
-            );
+            script += clusterPixmapScript(d->clusterDiff.pageIdForClusterIndex(clusterIndex), clusterCenterPoint, clusterPixmap);
+        }
     }
 
-    qCDebug(LIBKGEOMAP_LOG) << "end updateclusters";
+    if (!script.isEmpty())
+    {
+        d->htmlWidget->runScript(script);
+    }
 }
 
+/**
+ * @brief Computes screen coordinates in-process, from the cached center and zoom
+ *
+ * Like in the Google Maps backend, points outside of the visible area are returned as valid.
+ */
 bool BackendOSM::screenCoordinates(const GeoCoordinates& coordinates, QPoint* const point)
 {
     if (!d->isReady)
         return false;
 
-    const bool isValid = KGeoMapHelperParseXYStringToPoint(
-                         d->htmlWidget->runScript(QLatin1String("kgeomapLatLngToPixel(%1, %2);")
-                                .arg(coordinates.latString())
-                                .arg(coordinates.lonString()))
-                         .toString(), point);
+    const qreal worldSize     = 256.0 * qPow(2.0, d->cacheZoom);
+    const QPointF centerPoint = KGeoMapHelperMercatorProject(d->cacheCenter, d->cacheZoom);
+    QPointF worldPoint        = KGeoMapHelperMercatorProject(coordinates, d->cacheZoom);
+
+    // use the copy of the world which is closest to the center of the map
+    if (worldPoint.x() - centerPoint.x() > worldSize / 2.0)
+    {
+        worldPoint.rx() -= worldSize;
+    }
+    else if (worldPoint.x() - centerPoint.x() < -worldSize / 2.0)
+    {
+        worldPoint.rx() += worldSize;
+    }
+
+    const QSize size = mapSize();
 
-    // TODO: apparently, even points outside the visible area are returned as valid
-    // check whether they are actually visible
-    return isValid;
+    if (point)
+    {
+        *point = (worldPoint - centerPoint + QPointF(size.width() / 2.0, size.height() / 2.0)).toPoint();
+    }
+
+    return true;
 }
 
-bool BackendOSM::GeoCoordinates(const QPoint& point, GeoCoordinates* const coordinates) const
+bool BackendOSM::geoCoordinates(const QPoint& point, GeoCoordinates* const coordinates) const
 {
     if (!d->isReady)
         return false;
 
-    const bool isValid = d->htmlWidget->runScript2Coordinates(
-            QLatin1String("kgeomapPixelToLatLng(%1, %2);")
-                .arg(point.x())
-                .arg(point.y()),
-            coordinates);
+    const QSize size          = mapSize();
+    const QPointF centerPoint = KGeoMapHelperMercatorProject(d->cacheCenter, d->cacheZoom);
+    const QPointF worldPoint  = centerPoint + QPointF(point) - QPointF(size.width() / 2.0, size.height() / 2.0);
 
-    return isValid;
+    if (coordinates)
+    {
+        *coordinates = KGeoMapHelperMercatorUnproject(worldPoint, d->cacheZoom);
+    }
+
+    return true;
 }
 
 QSize BackendOSM::mapSize() const
 {
-    KGEOMAP_ASSERT(d->htmlWidgetWrapper != 0);
+    KGEOMAP_ASSERT(d->htmlWidgetWrapper != nullptr);
 
     return d->htmlWidgetWrapper->size();
 }
@@ -451,14 +689,12 @@ void BackendOSM::slotClustersNeedUpdating()
 
 void BackendOSM::setZoom(const QString& newZoom)
 {
-    // zoom settings for OSM are basically the same as for Google Maps, so just re-use the prefix
-    const QString myZoomString = s->worldMapWidget->convertZoomToBackendZoom(newZoom, "googlemaps");
+    // zoom settings for OSM are the same as for Google Maps, so just re-use the prefix
+    const QString myZoomString = s->worldMapWidget->convertZoomToBackendZoom(newZoom, QLatin1String("googlemaps"));
     KGEOMAP_ASSERT(myZoomString.startsWith(QLatin1String("googlemaps:")));
 
-    const int myZoom = myZoomString.mid(QLatin1String("googlemaps:").length()).toInt();
-    qCDebug(LIBKGEOMAP_LOG) << myZoom;
-
-    d->cacheZoom = myZoom;
+    const int myZoom           = myZoomString.mid(QString::fromLatin1("googlemaps:").length()).toInt();
+    d->cacheZoom               = myZoom;
 
     if (isReady())
     {
@@ -468,7 +704,7 @@ void BackendOSM::setZoom(const QString& newZoom)
 
 QString BackendOSM::getZoom() const
 {
-    // zoom settings for OSM are basically the same as for Google Maps, so just re-use the prefix
+    // zoom settings for OSM are the same as for Google Maps, so just re-use the prefix
     return QString::fromLatin1("googlemaps:%1").arg(d->cacheZoom);
 }
 
@@ -483,34 +719,35 @@ int BackendOSM::getMarkerModelLevel()
 
     // get the current zoom level:
     const int currentZoom = d->cacheZoom;
-    int tileLevel         = 0;
-
-         if (currentZoom== 0) { tileLevel = 1;                            }
-    else if (currentZoom== 1) { tileLevel = 1;                            }
-    else if (currentZoom== 2) { tileLevel = 1;                            }
-    else if (currentZoom== 3) { tileLevel = 2;                            }
-    else if (currentZoom== 4) { tileLevel = 2;                            }
-    else if (currentZoom== 5) { tileLevel = 3;                            }
-    else if (currentZoom== 6) { tileLevel = 3;                            }
-    else if (currentZoom== 7) { tileLevel = 3;                            }
-    else if (currentZoom== 8) { tileLevel = 4;                            }
-    else if (currentZoom== 9) { tileLevel = 4;                            }
-    else if (currentZoom==10) { tileLevel = 4;                            }
-    else if (currentZoom==11) { tileLevel = 4;                            }
-    else if (currentZoom==12) { tileLevel = 4;                            }
-    else if (currentZoom==13) { tileLevel = 4;                            }
-    else if (currentZoom==14) { tileLevel = 5;                            }
-    else if (currentZoom==15) { tileLevel = 5;                            }
-    else if (currentZoom==16) { tileLevel = 5;                            }
-    else if (currentZoom==17) { tileLevel = 5;                            }
-    else if (currentZoom==18) { tileLevel = 6;                            }
-    else if (currentZoom==19) { tileLevel = 6;                            }
-    else if (currentZoom==20) { tileLevel = 6;                            }
-    else if (currentZoom==21) { tileLevel = 7;                            }
-    else if (currentZoom==22) { tileLevel = 7;                            }
-    else                      { tileLevel = s->markerModel->maxLevel()-1; }
-
-    KGEOMAP_ASSERT(tileLevel<=s->markerModel->maxLevel()-1);
+
+    int tileLevel = 0;
+         if (currentZoom== 0) { tileLevel = 1; }
+    else if (currentZoom== 1) { tileLevel = 1; }
+    else if (currentZoom== 2) { tileLevel = 1; }
+    else if (currentZoom== 3) { tileLevel = 2; }
+    else if (currentZoom== 4) { tileLevel = 2; }
+    else if (currentZoom== 5) { tileLevel = 3; }
+    else if (currentZoom== 6) { tileLevel = 3; }
+    else if (currentZoom== 7) { tileLevel = 3; }
+    else if (currentZoom== 8) { tileLevel = 4; }
+    else if (currentZoom== 9) { tileLevel = 4; }
+    else if (currentZoom==10) { tileLevel = 4; }
+    else if (currentZoom==11) { tileLevel = 4; }
+    else if (currentZoom==12) { tileLevel = 4; }
+    else if (currentZoom==13) { tileLevel = 4; }
+    else if (currentZoom==14) { tileLevel = 5; }
+    else if (currentZoom==15) { tileLevel = 5; }
+    else if (currentZoom==16) { tileLevel = 6; }
+    else if (currentZoom==17) { tileLevel = 7; }
+    else if (currentZoom==18) { tileLevel = 7; }
+    else if (currentZoom==19) { tileLevel = 8; }
+    else
+    {
+        tileLevel = TileIndex::MaxLevel;
+    }
+
+    // the tile grouper limits this to the depth of the marker tiler
+    KGEOMAP_ASSERT(tileLevel <= TileIndex::MaxLevel);
 
     return tileLevel;
 }
@@ -520,4 +757,217 @@ GeoCoordinates::PairList BackendOSM::getNormalizedBounds()
     return KGeoMapHelperNormalizeBounds(d->cacheBounds);
 }
 
+void BackendOSM::updateActionAvailability()
+{
+    if ( (!d->activeState) || (!isReady()) )
+    {
+        return;
+    }
+
+    s->worldMapWidget->getControlAction(QLatin1String("zoomin"))->setEnabled(d->cacheZoom < 19);
+    s->worldMapWidget->getControlAction(QLatin1String("zoomout"))->setEnabled(d->cacheZoom > 0);
+}
+
+void BackendOSM::slotThumbnailsAvailable(const QVariantList& indices, const QList<QPixmap>& pixmaps)
+{
+    if (!d->htmlWidget)
+        return;
+
+    const QIntList clusterIndices = clustersRepresentedBy(indices, pixmaps);
+
+    // all new pixmaps are set by one script
+    QString script;
+
+    foreach(const int clusterIndex, clusterIndices)
+    {
+        const int pageId = d->clusterDiff.pageIdForClusterIndex(clusterIndex);
+
+        if (pageId < 0)
+            continue;
+
+        QPoint clusterCenterPoint;
+        const QPixmap clusterPixmap = s->worldMapWidget->getDecoratedPixmapForCluster(clusterIndex, nullptr, nullptr, &clusterCenterPoint);
+
+        script += clusterPixmapScript(pageId, clusterCenterPoint, clusterPixmap);
+    }
+
+    if (!script.isEmpty())
+    {
+        d->htmlWidget->runScript(script);
+    }
+}
+
+/**
+ * @brief Returns the script which sets the pixmap of a cluster, for batching with other scripts
+ */
+QString BackendOSM::clusterPixmapScript(const int clusterId, const QPoint& centerPoint, const QPixmap& clusterPixmap) const
+{
+    QByteArray bytes;
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::WriteOnly);
+    clusterPixmap.save(&buffer, "PNG");
+
+    // http://www.faqs.org/rfcs/rfc2397.html
+    const QString imageData = QString::fromLatin1("data:image/png;base64,%1").arg(QString::fromLatin1(bytes.toBase64()));
+
+    return QString::fromLatin1("kgeomapSetClusterPixmap(%1,%2,%3,%4,%5,'%6');")
+                    .arg(clusterId)
+                    .arg(clusterPixmap.width())
+                    .arg(clusterPixmap.height())
+                    .arg(centerPoint.x())
+                    .arg(centerPoint.y())
+                    .arg(imageData);
+}
+
+bool BackendOSM::eventFilter(QObject* object, QEvent* event)
+{
+    if (object == d->htmlWidgetWrapper)
+    {
+        if (event->type() == QEvent::Resize)
+        {
+            QResizeEvent* const resizeEvent = dynamic_cast<QResizeEvent*>(event);
+
+            if (resizeEvent && d->isReady)
+            {
+                d->htmlWidget->runScript(QString::fromLatin1("kgeomapWidgetResized(%1, %2)").arg(d->htmlWidgetWrapper->width()).arg(d->htmlWidgetWrapper->height()));
+                readMapState();
+            }
+        }
+    }
+
+    return false;
+}
+
+void BackendOSM::regionSelectionChanged()
+{
+    if (!d->htmlWidget)
+    {
+        return;
+    }
+
+    if (s->hasRegionSelection())
+    {
+        d->htmlWidget->setSelectionRectangle(s->selectionRectangle);
+    }
+    else
+    {
+        d->htmlWidget->removeSelectionRectangle();
+    }
+}
+
+void BackendOSM::mouseModeChanged()
+{
+    if (!d->htmlWidget)
+    {
+        return;
+    }
+
+    d->htmlWidget->mouseModeChanged(s->currentMouseMode);
+}
+
+void BackendOSM::slotSelectionHasBeenMade(const KGeoMap::GeoCoordinates::Pair& searchCoordinates)
+{
+    emit signalSelectionHasBeenMade(searchCoordinates);
+}
+
+void BackendOSM::centerOn(const Marble::GeoDataLatLonBox& latLonBox, const bool useSaneZoomLevel)
+{
+    if (!d->htmlWidget)
+    {
+        return;
+    }
+
+    const qreal boxWest  = latLonBox.west(Marble::GeoDataCoordinates::Degree);
+    const qreal boxNorth = latLonBox.north(Marble::GeoDataCoordinates::Degree);
+    const qreal boxEast  = latLonBox.east(Marble::GeoDataCoordinates::Degree);
+    const qreal boxSouth = latLonBox.south(Marble::GeoDataCoordinates::Degree);
+
+    d->htmlWidget->centerOn(boxWest, boxNorth, boxEast, boxSouth, useSaneZoomLevel);
+    readMapState();
+}
+
+void BackendOSM::setActive(const bool state)
+{
+    const bool oldState = d->activeState;
+    d->activeState      = state;
+
+    if (oldState != state)
+    {
+        if ((!state) && d->htmlWidgetWrapper)
+        {
+            // we should share our widget in the list of widgets in the global object
+            KGeoMapInternalWidgetInfo info;
+            info.deleteFunction = deleteInfoFunction;
+            info.widget         = d->htmlWidgetWrapper.data();
+            info.currentOwner   = this;
+            info.backendName    = backendName();
+            info.state          = d->widgetIsDocked ? KGeoMapInternalWidgetInfo::InternalWidgetStillDocked : KGeoMapInternalWidgetInfo::InternalWidgetUndocked;
+
+            OSMInternalWidgetInfo intInfo;
+            intInfo.htmlWidget = d->htmlWidget.data();
+            info.backendData.setValue(intInfo);
+
+            KGeoMapGlobalObject* const go = KGeoMapGlobalObject::instance();
+            go->addMyInternalWidgetToPool(info);
+        }
+
+        if (state && d->htmlWidgetWrapper)
+        {
+            // we should remove our widget from the list of widgets in the global object
+            KGeoMapGlobalObject* const go = KGeoMapGlobalObject::instance();
+            go->removeMyInternalWidgetFromPool(this);
+
+            setCenter(d->cacheCenter);
+        }
+    }
+}
+
+void BackendOSM::releaseWidget(KGeoMapInternalWidgetInfo* const info)
+{
+    disconnect(d->htmlWidget, SIGNAL(signalJavaScriptReady()),
+               this, SLOT(slotHTMLInitialized()));
+
+    disconnect(d->htmlWidget, SIGNAL(signalHTMLEvents(QVariantList)),
+               this, SLOT(slotHTMLEvents(QVariantList)));
+
+    disconnect(d->htmlWidget, SIGNAL(selectionHasBeenMade(KGeoMap::GeoCoordinates::Pair)),
+               this, SLOT(slotSelectionHasBeenMade(KGeoMap::GeoCoordinates::Pair)));
+
+    d->htmlWidget->setSharedKGeoMapObject(nullptr);
+    d->htmlWidgetWrapper->removeEventFilter(this);
+
+    d->htmlWidget        = nullptr;
+    d->htmlWidgetWrapper = nullptr;
+    info->currentOwner   = nullptr;
+    info->state          = KGeoMapInternalWidgetInfo::InternalWidgetReleased;
+    d->isReady           = false;
+    d->clusterDiff.invalidate();
+
+    emit(signalBackendReadyChanged(backendName()));
+}
+
+void BackendOSM::mapWidgetDocked(const bool state)
+{
+    if (d->widgetIsDocked != state)
+    {
+        KGeoMapGlobalObject* const go = KGeoMapGlobalObject::instance();
+        go->updatePooledWidgetState(d->htmlWidgetWrapper, state ? KGeoMapInternalWidgetInfo::InternalWidgetStillDocked : KGeoMapInternalWidgetInfo::InternalWidgetUndocked);
+    }
+
+    d->widgetIsDocked = state;
+}
+
+void BackendOSM::deleteInfoFunction(KGeoMapInternalWidgetInfo* const info)
+{
+    if (info->currentOwner)
+    {
+        qobject_cast<MapBackend*>(info->currentOwner.data())->releaseWidget(info);
+    }
+
+    const OSMInternalWidgetInfo intInfo = info->backendData.value<OSMInternalWidgetInfo>();
+
+    delete intInfo.htmlWidget;
+    delete info->widget.data();
+}
+
 } /* namespace KGeoMap */
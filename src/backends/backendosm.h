@@ -34,58 +34,97 @@
 namespace KGeoMap
 {
 
+/**
+ * @brief OpenStreetMap backend, using OpenLayers in an HTMLWidget
+ *
+ * Markers and clusters are transferred in one script per update, and only the clusters which
+ * changed are re-sent. Screen coordinates are computed in-process from the cached center and
+ * zoom, using the spherical Mercator projection of the tiles.
+ *
+ * The page loads its tiles through TileNetworkAccessManager, which takes them from a local tile
+ * directory, a disk cache of recently used tiles or the tile server set by setTileUrl(), in this
+ * order. Together with a local copy of OpenLayers next to backend-osm.html, a local tile
+ * directory or tile server makes the backend usable without network access.
+ */
 class BackendOSM : public MapBackend
 {
     Q_OBJECT
 
 public:
 
-    explicit BackendOSM(const QExplicitlySharedDataPointer<KGeoMapSharedData>& sharedData, QObject* const parent = 0);
-    virtual ~BackendOSM();
+    explicit BackendOSM(const QExplicitlySharedDataPointer<KGeoMapSharedData>& sharedData, QObject* const parent = nullptr);
+    ~BackendOSM() override;
+
+    QString backendName() const override;
+    QString backendHumanName() const override;
+    QWidget* mapWidget() override;
+    void releaseWidget(KGeoMapInternalWidgetInfo* const info) override;
+    void mapWidgetDocked(const bool state) override;
+
+    GeoCoordinates getCenter() const override;
+    void setCenter(const GeoCoordinates& coordinate) override;
 
-    virtual QString backendName()      const;
-    virtual QString backendHumanName() const;
-    virtual QWidget* mapWidget()       const;
+    bool isReady() const override;
 
-    virtual GeoCoordinates getCenter() const;
-    virtual void setCenter(const GeoCoordinates& coordinate);
+    void zoomIn() override;
+    void zoomOut() override;
 
-    virtual bool isReady() const;
+    void saveSettingsToGroup(KConfigGroup* const group) override;
+    void readSettingsFromGroup(const KConfigGroup* const group) override;
 
-    virtual void zoomIn();
-    virtual void zoomOut();
+    void addActionsToConfigurationMenu(QMenu* const configurationMenu) override;
 
-    virtual void saveSettingsToGroup(KConfigGroup* const group);
-    virtual void readSettingsFromGroup(const KConfigGroup* const group);
+    void updateMarkers() override;
+    void updateClusters() override;
 
-    virtual void addActionsToConfigurationMenu(QMenu* const configurationMenu);
+    bool screenCoordinates(const GeoCoordinates& coordinates, QPoint* const point) override;
+    bool geoCoordinates(const QPoint& point, GeoCoordinates* const coordinates) const override;
+    QSize mapSize() const override;
 
-    virtual void updateMarkers();
-    virtual void updateClusters();
+    void setZoom(const QString& newZoom) override;
+    QString getZoom() const override;
 
-    virtual bool screenCoordinates(const GeoCoordinates& coordinates, QPoint* const point);
-    virtual bool GeoCoordinates(const QPoint& point, GeoCoordinates* const coordinates) const;
-    virtual QSize mapSize() const;
+    int getMarkerModelLevel() override;
+    GeoCoordinates::PairList getNormalizedBounds() override;
 
-    virtual void setZoom(const QString& newZoom);
-    virtual QString getZoom() const;
+    void updateActionAvailability() override;
 
-    virtual int getMarkerModelLevel();
-    virtual GeoCoordinates::PairList getNormalizedBounds();
+    void regionSelectionChanged() override;
+    void mouseModeChanged() override;
+
+    void centerOn(const Marble::GeoDataLatLonBox& latLonBox, const bool useSaneZoomLevel) override;
+    void setActive(const bool state) override;
+
+    QString tileUrl() const;
+    void setTileUrl(const QString& tileUrl);
+    QString localTileDirectory() const;
+    void setLocalTileDirectory(const QString& directory);
+    bool isOffline() const;
+    void setOffline(const bool state);
 
 public Q_SLOTS:
 
-    virtual void slotClustersNeedUpdating();
+    void slotClustersNeedUpdating() override;
+    void slotThumbnailsAvailable(const QVariantList& indices, const QList<QPixmap>& pixmaps) override;
+    void slotUngroupedModelChanged(const int mindex);
+
+protected:
+
+    bool eventFilter(QObject* object, QEvent* event) override;
+    QString clusterPixmapScript(const int clusterId, const QPoint& centerPoint, const QPixmap& clusterPixmap) const;
 
 private Q_SLOTS:
 
     void slotHTMLInitialized();
-    void updateActionsEnabled();
-    void slotHTMLEvents(const QStringList& eventStrings);
+    void slotHTMLEvents(const QVariantList& events);
+    void slotSelectionHasBeenMade(const KGeoMap::GeoCoordinates::Pair& searchCoordinates);
 
 private:
 
-    void loadInitialHTML();
+    void readMapState();
+    QString pageTileUrl() const;
+    void reloadTiles();
+    static void deleteInfoFunction(KGeoMapInternalWidgetInfo* const info);
 
 private:
 
@@ -0,0 +1,261 @@
+/** ===========================================================
+ * @file
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  Incremental transfer of clusters to the pages of the HTML backends
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "htmlclusterdiff.h"
+
+// Qt includes
+
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+
+// local includes
+
+#include "abstractmarkertiler.h"
+#include "mapwidget.h"
+
+namespace KGeoMap
+{
+
+class HtmlClusterDiff::Private
+{
+public:
+
+    Private()
+      : pageClusters(),
+        pageClustersValid(false),
+        pageClustersDisplayState(),
+        nextPageClusterId(0),
+        clusterIndexForPageId(),
+        pageIdForClusterIndex()
+    {
+    }
+
+    /**
+     * @brief A cluster as it is currently shown on the page
+     *
+     * Clusters are identified by their leading tile, which stays the same while the
+     * cluster is re-generated at the same level. The page knows them by their pageId.
+     */
+    class PageCluster
+    {
+    public:
+
+        PageCluster()
+            : pageId(-1),
+              coordinates(),
+              markerCount(0),
+              markerSelectedCount(0),
+              groupState(SelectedNone),
+              globalGroupState(SelectedNone),
+              representativeMarker()
+        {
+        }
+
+        int            pageId;
+        GeoCoordinates coordinates;
+        int            markerCount;
+        int            markerSelectedCount;
+        GroupState     groupState;
+        /// the region selection and positive filter bits, which gray out and cross out thumbnails
+        GroupState     globalGroupState;
+        QVariant       representativeMarker;
+    };
+
+    QHash<QIntList, PageCluster> pageClusters;
+    bool                         pageClustersValid;
+    QString                      pageClustersDisplayState;
+    int                          nextPageClusterId;
+    QHash<int, int>              clusterIndexForPageId;
+    QVector<int>                 pageIdForClusterIndex;
+};
+
+HtmlClusterDiff::HtmlClusterDiff()
+    : d(new Private())
+{
+}
+
+HtmlClusterDiff::~HtmlClusterDiff()
+{
+    delete d;
+}
+
+/**
+ * @brief Makes the next update clear the page and send all clusters again
+ */
+void HtmlClusterDiff::invalidate()
+{
+    d->pageClustersValid = false;
+}
+
+/**
+ * @brief Returns the script which brings the page up to date with s->clusterList
+ *
+ * The indices of the clusters which were added or changed, and therefore need a new
+ * pixmap, are stored in @p redrawnClusters.
+ */
+QString HtmlClusterDiff::updateScript(const QExplicitlySharedDataPointer<KGeoMapSharedData>& s, QIntList* const redrawnClusters)
+{
+    const QString displayState = QString::fromLatin1("%1/%2/%3/%4/%5/%6")
+                                     .arg(s->showThumbnails)
+                                     .arg(s->thumbnailSize)
+                                     .arg(s->showNumbersOnItems)
+                                     .arg(s->previewSingleItems)
+                                     .arg(s->previewGroupedItems)
+                                     .arg(s->sortKey);
+
+    QString script;
+
+    if (!d->pageClustersValid || (displayState != d->pageClustersDisplayState))
+    {
+        script += QLatin1String("kgeomapClearClusters();");
+        script += QString::fromLatin1("kgeomapSetIsInEditMode(%1);").arg(s->showThumbnails?QLatin1String("false" ):QLatin1String("true" ));
+
+        d->pageClusters.clear();
+        d->pageClustersValid        = true;
+        d->pageClustersDisplayState = displayState;
+    }
+
+    const GroupState globalGroupState = s->markerModel ? GroupState(s->markerModel->getGlobalGroupState() &
+                                                                    (RegionSelectedMask | FilteredPositiveMask))
+                                                       : SelectedNone;
+
+    QHash<QIntList, Private::PageCluster> newPageClusters;
+    d->clusterIndexForPageId.clear();
+    d->pageIdForClusterIndex.resize(s->clusterList.size());
+
+    QStringList addedClusterData;
+    QStringList changedClusterData;
+
+    for (int currentIndex = 0; currentIndex < s->clusterList.size(); ++currentIndex)
+    {
+        const KGeoMapCluster& currentCluster = s->clusterList.at(currentIndex);
+        KGEOMAP_ASSERT(!currentCluster.tileIndicesList.isEmpty());
+
+        const QIntList clusterKey = currentCluster.tileIndicesList.isEmpty() ? QIntList()
+                                                                             : currentCluster.tileIndicesList.first().toIntList();
+
+        Private::PageCluster pageCluster;
+        pageCluster.coordinates         = currentCluster.coordinates;
+        pageCluster.markerCount         = currentCluster.markerCount;
+        pageCluster.markerSelectedCount = currentCluster.markerSelectedCount;
+        pageCluster.groupState          = currentCluster.groupState;
+        pageCluster.globalGroupState    = globalGroupState;
+
+        if (s->showThumbnails)
+        {
+            pageCluster.representativeMarker = s->worldMapWidget->getClusterRepresentativeMarker(currentIndex, s->sortKey);
+        }
+
+        bool isNew     = true;
+        bool isChanged = false;
+        const QHash<QIntList, Private::PageCluster>::iterator shownIt = d->pageClusters.find(clusterKey);
+
+        if (shownIt != d->pageClusters.end())
+        {
+            const Private::PageCluster& shownCluster = shownIt.value();
+            isNew              = false;
+            pageCluster.pageId = shownCluster.pageId;
+            isChanged          = (shownCluster.coordinates.lat()    != pageCluster.coordinates.lat())    ||
+                                 (shownCluster.coordinates.lon()    != pageCluster.coordinates.lon())    ||
+                                 (shownCluster.markerCount          != pageCluster.markerCount)          ||
+                                 (shownCluster.markerSelectedCount  != pageCluster.markerSelectedCount)  ||
+                                 (shownCluster.groupState           != pageCluster.groupState)           ||
+                                 (shownCluster.globalGroupState     != pageCluster.globalGroupState)     ||
+                                 (s->showThumbnails && !s->markerModel->indicesEqual(shownCluster.representativeMarker,
+                                                                                     pageCluster.representativeMarker));
+            d->pageClusters.erase(shownIt);
+        }
+        else
+        {
+            pageCluster.pageId = d->nextPageClusterId++;
+        }
+
+        newPageClusters.insertMulti(clusterKey, pageCluster);
+        d->clusterIndexForPageId.insert(pageCluster.pageId, currentIndex);
+        d->pageIdForClusterIndex[currentIndex] = pageCluster.pageId;
+
+        if (!isNew && !isChanged)
+            continue;
+
+        // five values per cluster, see kgeomapAddClusters and kgeomapUpdateClusters
+        QStringList& clusterData = isNew ? addedClusterData : changedClusterData;
+        clusterData << QString::number(pageCluster.pageId)
+                    << currentCluster.coordinates.latString()
+                    << currentCluster.coordinates.lonString()
+                    << QString::number(currentCluster.markerCount)
+                    << QString::number(currentCluster.markerSelectedCount);
+
+        if (redrawnClusters)
+        {
+            *redrawnClusters << currentIndex;
+        }
+    }
+
+    // whatever is left of the previously shown clusters is not shown anymore:
+    if (!d->pageClusters.isEmpty())
+    {
+        QStringList removedClusterIds;
+
+        for (QHash<QIntList, Private::PageCluster>::const_iterator it = d->pageClusters.constBegin();
+             it != d->pageClusters.constEnd(); ++it)
+        {
+            removedClusterIds << QString::number(it.value().pageId);
+        }
+
+        script += QString::fromLatin1("kgeomapRemoveClusters([%1]);").arg(removedClusterIds.join(QLatin1Char(',')));
+    }
+
+    d->pageClusters = newPageClusters;
+
+    if (!changedClusterData.isEmpty())
+    {
+        script += QString::fromLatin1("kgeomapUpdateClusters([%1]);").arg(changedClusterData.join(QLatin1Char(',')));
+    }
+
+    if (!addedClusterData.isEmpty())
+    {
+        script += QString::fromLatin1("kgeomapAddClusters([%1]);").arg(addedClusterData.join(QLatin1Char(',')));
+    }
+
+    return script;
+}
+
+/**
+ * @brief Returns the index in s->clusterList of a cluster on the page, or -1
+ */
+int HtmlClusterDiff::clusterIndexForPageId(const int pageId) const
+{
+    return d->clusterIndexForPageId.value(pageId, -1);
+}
+
+/**
+ * @brief Returns the id on the page of a cluster in s->clusterList, or -1
+ */
+int HtmlClusterDiff::pageIdForClusterIndex(const int clusterIndex) const
+{
+    return d->pageIdForClusterIndex.value(clusterIndex, -1);
+}
+
+} /* namespace KGeoMap */
@@ -0,0 +1,75 @@
+/** ===========================================================
+ * @file
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  Incremental transfer of clusters to the pages of the HTML backends
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef HTML_CLUSTER_DIFF_H
+#define HTML_CLUSTER_DIFF_H
+
+// Qt includes
+
+#include <QtCore/QExplicitlySharedDataPointer>
+#include <QtCore/QString>
+
+// local includes
+
+#include "kgeomap_common.h"
+
+namespace KGeoMap
+{
+
+/**
+ * @brief Keeps track of the clusters shown on an HTML page and computes the script to update them
+ *
+ * The page knows the clusters by ids which are derived from their leading tile and stay the
+ * same across updates. Only the clusters which were added, changed or removed since the last
+ * update are transferred, unless the way clusters are displayed changed or invalidate() was
+ * called, in which case the page is cleared and all clusters are sent again.
+ *
+ * The script calls kgeomapClearClusters, kgeomapSetIsInEditMode, kgeomapRemoveClusters,
+ * kgeomapUpdateClusters and kgeomapAddClusters, which both HTML backends implement.
+ * The pixmaps of the clusters are left to the backends.
+ */
+class HtmlClusterDiff
+{
+public:
+
+    HtmlClusterDiff();
+    ~HtmlClusterDiff();
+
+    void invalidate();
+    QString updateScript(const QExplicitlySharedDataPointer<KGeoMapSharedData>& s, QIntList* const redrawnClusters);
+
+    int clusterIndexForPageId(const int pageId) const;
+    int pageIdForClusterIndex(const int clusterIndex) const;
+
+private:
+
+    class Private;
+    Private* const d;
+
+    Q_DISABLE_COPY(HtmlClusterDiff)
+};
+
+} /* namespace KGeoMap */
+
+#endif /* HTML_CLUSTER_DIFF_H */
@@ -235,6 +235,12 @@ void HTMLWidget::mouseMoveEvent(QMouseEvent *e)
     QWebView::mouseMoveEvent(e);
 }
 
+/**
+ * @brief Reads all events which are waiting on the page, in one call
+ *
+ * The page notifies us at most once per frame. Each event is a list holding the event
+ * type followed by its parameters, see kgeomapPostEvent.
+ */
 void HTMLWidget::slotScanForJSMessages(QString message)
 {
     if (message!=QLatin1String("(event)"))
@@ -242,13 +248,11 @@ void HTMLWidget::slotScanForJSMessages(QString message)
 
 //    qCDebug(LIBKGEOMAP_LOG) << message;
 
-    const QString eventBufferString = runScript(QLatin1String("kgeomapReadEventStrings();")).toString();
+    const QVariantList events = runScript(QLatin1String("kgeomapReadEvents();")).toList();
 
-    if (eventBufferString.isEmpty())
+    if (events.isEmpty())
         return;
 
-    const QStringList events = eventBufferString.split(QLatin1Char( '|' ));
-
     emit(signalHTMLEvents(events));
 }
 
@@ -76,7 +76,7 @@ protected Q_SLOTS:
 
 Q_SIGNALS:
 
-    void signalHTMLEvents(const QStringList& events);
+    void signalHTMLEvents(const QVariantList& events);
     void signalJavaScriptReady();
     void selectionHasBeenMade(const KGeoMap::GeoCoordinates::Pair& coordinatesRect);
 
@@ -26,6 +26,17 @@
 
 #include "mapbackend.h"
 
+// Qt includes
+
+#include <QHash>
+#include <QPixmap>
+#include <QVector>
+
+// local includes
+
+#include "abstractmarkertiler.h"
+#include "mapwidget.h"
+
 namespace KGeoMap
 {
 
@@ -38,10 +49,89 @@ MapBackend::~MapBackend()
 {
 }
 
-void MapBackend::slotThumbnailAvailableForIndex(const QVariant& index, const QPixmap& pixmap)
+/**
+ * @brief Called with all thumbnails which became available during one frame
+ *
+ * @c indices and @c pixmaps have the same length. Use clustersRepresentedBy() to find the
+ * clusters which have to be redrawn.
+ */
+void MapBackend::slotThumbnailsAvailable(const QVariantList& indices, const QList<QPixmap>& pixmaps)
 {
-    Q_UNUSED(index)
-    Q_UNUSED(pixmap)
+    Q_UNUSED(indices)
+    Q_UNUSED(pixmaps)
+}
+
+/**
+ * @brief Returns the clusters whose representative marker received a usable thumbnail
+ *
+ * Null thumbnails and thumbnails which do not have the current thumbnail size are skipped.
+ * The representative markers of the clusters are hashed once, so that each thumbnail is
+ * only compared with the clusters whose representative has the same hash.
+ */
+QIntList MapBackend::clustersRepresentedBy(const QVariantList& indices, const QList<QPixmap>& pixmaps) const
+{
+    QIntList clusterIndices;
+
+    if (!s->markerModel || !s->showThumbnails || indices.isEmpty())
+    {
+        return clusterIndices;
+    }
+
+    // TODO: properly reject pixmaps with the wrong size
+    const int expectedThumbnailSize = s->worldMapWidget->getUndecoratedThumbnailSize();
+    QList<QVariant> usableIndices;
+
+    for (int i = 0; i < indices.count(); ++i)
+    {
+        const QPixmap& pixmap = pixmaps.at(i);
+
+        if (pixmap.isNull() ||
+            ((pixmap.height() != expectedThumbnailSize) && (pixmap.width() != expectedThumbnailSize)))
+        {
+            continue;
+        }
+
+        usableIndices << indices.at(i);
+    }
+
+    if (usableIndices.isEmpty())
+    {
+        return clusterIndices;
+    }
+
+    // hash of the representative marker -> indices of the clusters
+    QMultiHash<uint, int> clustersByRepresentative;
+    QVector<QVariant> representativeMarkers(s->clusterList.count());
+
+    for (int i = 0; i < s->clusterList.count(); ++i)
+    {
+        // TODO: use the right sortkey
+        representativeMarkers[i] = s->worldMapWidget->getClusterRepresentativeMarker(i, s->sortKey);
+        clustersByRepresentative.insert(s->markerModel->indexHash(representativeMarkers.at(i)), i);
+    }
+
+    QVector<bool> clusterFound(s->clusterList.count(), false);
+
+    for (int i = 0; i < usableIndices.count(); ++i)
+    {
+        const QVariant& index = usableIndices.at(i);
+        const uint indexHash  = s->markerModel->indexHash(index);
+
+        for (QMultiHash<uint, int>::const_iterator it = clustersByRepresentative.constFind(indexHash);
+             (it != clustersByRepresentative.constEnd()) && (it.key() == indexHash); ++it)
+        {
+            const int clusterIndex = it.value();
+
+            if (!clusterFound.at(clusterIndex) &&
+                s->markerModel->indicesEqual(index, representativeMarkers.at(clusterIndex)))
+            {
+                clusterFound[clusterIndex] = true;
+                clusterIndices << clusterIndex;
+            }
+        }
+    }
+
+    return clusterIndices;
 }
 
 void MapBackend::slotTrackManagerChanged()
@@ -109,7 +109,7 @@ public:
 public Q_SLOTS:
 
     virtual void slotClustersNeedUpdating() = 0;
-    virtual void slotThumbnailAvailableForIndex(const QVariant& index, const QPixmap& pixmap);
+    virtual void slotThumbnailsAvailable(const QVariantList& indices, const QList<QPixmap>& pixmaps);
     virtual void slotTrackManagerChanged();
 
 Q_SIGNALS:
@@ -120,6 +120,11 @@ Q_SIGNALS:
     void signalMarkersMoved(const QIntList& markerIndices);
     void signalZoomChanged(const QString& newZoom);
     void signalSelectionHasBeenMade(const KGeoMap::GeoCoordinates::Pair& coordinates);
+    void signalTrackUploadProgress(const int uploadedPoints, const int totalPoints);
+
+protected:
+
+    QIntList clustersRepresentedBy(const QVariantList& indices, const QList<QPixmap>& pixmaps) const;
 };
 
 } /* namespace KGeoMap */
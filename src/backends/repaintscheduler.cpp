@@ -0,0 +1,113 @@
+/** ===========================================================
+ * @file
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  Merges repaint requests into at most one repaint per frame
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "repaintscheduler.h"
+
+// Qt includes
+
+#include <QTimer>
+
+namespace KGeoMap
+{
+
+class RepaintScheduler::Private
+{
+public:
+
+    Private()
+      : timer(nullptr),
+        requestCount(0),
+        mergedRequestCount(0)
+    {
+    }
+
+    QTimer* timer;
+    int     requestCount;
+    int     mergedRequestCount;
+};
+
+RepaintScheduler::RepaintScheduler(QObject* const parent)
+    : QObject(parent),
+      d(new Private())
+{
+    d->timer = new QTimer(this);
+    d->timer->setSingleShot(true);
+    d->timer->setInterval(DefaultInterval);
+
+    connect(d->timer, &QTimer::timeout, this, &RepaintScheduler::signalRepaint);
+}
+
+RepaintScheduler::~RepaintScheduler()
+{
+    delete d;
+}
+
+/**
+ * @brief Requests a repaint, it is merged into the repaint of the current frame if there is one
+ */
+void RepaintScheduler::schedule()
+{
+    ++(d->requestCount);
+
+    if (d->timer->isActive())
+    {
+        ++(d->mergedRequestCount);
+        return;
+    }
+
+    d->timer->start();
+}
+
+bool RepaintScheduler::isScheduled() const
+{
+    return d->timer->isActive();
+}
+
+int RepaintScheduler::interval() const
+{
+    return d->timer->interval();
+}
+
+void RepaintScheduler::setInterval(const int milliseconds)
+{
+    d->timer->setInterval(qMax(0, milliseconds));
+}
+
+/**
+ * @brief Number of repaints requested by schedule() so far
+ */
+int RepaintScheduler::requestCount() const
+{
+    return d->requestCount;
+}
+
+/**
+ * @brief Number of requested repaints which were merged into an already scheduled repaint
+ */
+int RepaintScheduler::mergedRequestCount() const
+{
+    return d->mergedRequestCount;
+}
+
+} /* namespace KGeoMap */
@@ -0,0 +1,80 @@
+/** ===========================================================
+ * @file
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  Merges repaint requests into at most one repaint per frame
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef REPAINT_SCHEDULER_H
+#define REPAINT_SCHEDULER_H
+
+// Qt includes
+
+#include <QtCore/QObject>
+
+namespace KGeoMap
+{
+
+/**
+ * @brief Collects repaint requests and announces them at most once per frame interval
+ *
+ * Thumbnails, tracks, markers and clusters often change in bursts. The first request starts
+ * the frame, all requests which arrive before it ends are merged into it, and
+ * signalRepaint() is emitted once when the frame ends.
+ */
+class RepaintScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit RepaintScheduler(QObject* const parent = nullptr);
+    ~RepaintScheduler() override;
+
+    void schedule();
+    bool isScheduled() const;
+
+    int interval() const;
+    void setInterval(const int milliseconds);
+
+    int requestCount() const;
+    int mergedRequestCount() const;
+
+public:
+
+    /// milliseconds between repaints, about one frame at 60 Hz
+    enum
+    {
+        DefaultInterval = 16
+    };
+
+Q_SIGNALS:
+
+    void signalRepaint();
+
+private:
+
+    class Private;
+    Private* const d;
+};
+
+} /* namespace KGeoMap */
+
+#endif /* REPAINT_SCHEDULER_H */
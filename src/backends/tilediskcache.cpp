@@ -0,0 +1,425 @@
+/** ===========================================================
+ * @file
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  A size-bounded on-disk cache for map tiles
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "tilediskcache.h"
+
+// C++ includes
+
+#include <algorithm>
+#include <list>
+
+// Qt includes
+
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QFuture>
+#include <QHash>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QSet>
+#include <QVector>
+#include <QtConcurrent>
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 10, 0) && defined(Q_OS_UNIX)
+#   include <utime.h>
+#endif
+
+// local includes
+
+#include "libkgeomap_debug.h"
+
+namespace KGeoMap
+{
+
+namespace
+{
+
+class FoundTile
+{
+public:
+
+    QDateTime lastModified;
+    QString   key;
+    qint64    size;
+
+    bool operator<(const FoundTile& other) const
+    {
+        return lastModified < other.lastModified;
+    }
+};
+
+/**
+ * @brief Lists the tiles in the cache directory, least recently used first. Runs in a worker thread.
+ */
+QVector<FoundTile> scanTiles(const QString& directory)
+{
+    QVector<FoundTile> foundTiles;
+    const int prefixLength = directory.length() + 1;
+    QDirIterator dirIterator(directory, QDir::Files, QDirIterator::Subdirectories);
+
+    while (dirIterator.hasNext())
+    {
+        dirIterator.next();
+        const QFileInfo fileInfo = dirIterator.fileInfo();
+
+        FoundTile foundTile;
+        foundTile.key          = fileInfo.filePath().mid(prefixLength);
+        foundTile.lastModified = fileInfo.lastModified();
+        foundTile.size         = fileInfo.size();
+
+        // files which can not have been written by insert() are ignored
+        if (TileDiskCache::isValidKey(foundTile.key))
+        {
+            foundTiles << foundTile;
+        }
+    }
+
+    // the tiles whose files were touched last are the ones used last
+    std::stable_sort(foundTiles.begin(), foundTiles.end());
+
+    return foundTiles;
+}
+
+/**
+ * @brief Sets the modification time of a file to now
+ */
+void touchFile(const QString& filePath)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    QFile file(filePath);
+
+    if (file.open(QIODevice::ReadWrite))
+    {
+        file.setFileTime(QDateTime::currentDateTimeUtc(), QFileDevice::FileModificationTime);
+    }
+#elif defined(Q_OS_UNIX)
+    utime(QFile::encodeName(filePath).constData(), nullptr);
+#else
+    Q_UNUSED(filePath)
+#endif
+}
+
+} /* anonymous namespace */
+
+class TileDiskCache::Private
+{
+public:
+
+    Private()
+      : directory(),
+        maxSize(0),
+        size(0),
+        useOrder(),
+        entries(),
+        scan(),
+        scanPending(false),
+        removedDuringScan()
+    {
+    }
+
+    class Entry
+    {
+    public:
+
+        /// position of the key in useOrder
+        std::list<QString>::iterator useIterator;
+        qint64                       size;
+        /// whether the modification time of the file already reflects its use in this session
+        bool                         touched;
+    };
+
+    QString filePath(const QString& key) const
+    {
+        return directory + QLatin1Char('/') + key;
+    }
+
+    void addEntry(const QString& key, const qint64 entrySize, const bool touched,
+                  const std::list<QString>::iterator& position)
+    {
+        Entry entry;
+        entry.size        = entrySize;
+        entry.touched     = touched;
+        entry.useIterator = useOrder.insert(position, key);
+        entries.insert(key, entry);
+        size             += entrySize;
+    }
+
+    void removeEntry(const QHash<QString, Entry>::iterator& it)
+    {
+        QFile::remove(filePath(it.key()));
+
+        if (scanPending)
+        {
+            removedDuringScan.insert(it.key());
+        }
+
+        size -= it.value().size;
+        useOrder.erase(it.value().useIterator);
+        entries.erase(it);
+    }
+
+    void evict()
+    {
+        while ((size > maxSize) && !useOrder.empty())
+        {
+            removeEntry(entries.find(useOrder.front()));
+        }
+    }
+
+    QString                   directory;
+    qint64                    maxSize;
+    qint64                    size;
+
+    /// keys of the cached tiles, least recently used first
+    std::list<QString>        useOrder;
+    QHash<QString, Entry>     entries;
+
+    QFuture<QVector<FoundTile> > scan;
+    bool                      scanPending;
+    /// tiles which the scan may still report, although their files are gone
+    QSet<QString>             removedDuringScan;
+};
+
+TileDiskCache::TileDiskCache(const QString& directory, const qint64 maxSize)
+    : d(new Private())
+{
+    d->directory   = QDir::cleanPath(directory);
+    d->maxSize     = maxSize;
+
+    QDir().mkpath(d->directory);
+
+    d->scan        = QtConcurrent::run(scanTiles, d->directory);
+    d->scanPending = true;
+}
+
+TileDiskCache::~TileDiskCache()
+{
+    // the scan only reads the directory, but the directory may be removed after we are gone
+    d->scan.waitForFinished();
+
+    delete d;
+}
+
+QString TileDiskCache::directory() const
+{
+    return d->directory;
+}
+
+qint64 TileDiskCache::maxSize() const
+{
+    return d->maxSize;
+}
+
+void TileDiskCache::setMaxSize(const qint64 maxSize)
+{
+    d->maxSize = maxSize;
+    finishScan(false);
+    d->evict();
+}
+
+/**
+ * @brief Returns the size of all cached tiles, waits for the scan of the directory
+ */
+qint64 TileDiskCache::size() const
+{
+    finishScan(true);
+
+    return d->size;
+}
+
+/**
+ * @brief Returns the number of cached tiles, waits for the scan of the directory
+ */
+int TileDiskCache::count() const
+{
+    finishScan(true);
+
+    return d->entries.count();
+}
+
+/**
+ * @brief Keys are relative paths made of digits, letters, '.', '-' and '_', like "12/2105/1346"
+ */
+bool TileDiskCache::isValidKey(const QString& key)
+{
+    static const QRegularExpression keyExpression(QLatin1String("^[\\w\\-]+(\\.[\\w\\-]+)*(/[\\w\\-]+(\\.[\\w\\-]+)*)*$"));
+
+    return keyExpression.match(key).hasMatch();
+}
+
+/**
+ * @brief Returns the path of the file holding the tile, or an empty string if it is not cached
+ *
+ * The tile becomes the most recently used one.
+ */
+QString TileDiskCache::lookup(const QString& key)
+{
+    finishScan(false);
+
+    QHash<QString, Private::Entry>::iterator it = d->entries.find(key);
+
+    if (it == d->entries.end())
+    {
+        if (!d->scanPending || !isValidKey(key))
+        {
+            return QString();
+        }
+
+        // the scan did not get to this tile yet, look for it directly
+        const QFileInfo fileInfo(d->filePath(key));
+
+        if (!fileInfo.isFile())
+        {
+            return QString();
+        }
+
+        d->addEntry(key, fileInfo.size(), false, d->useOrder.end());
+        it = d->entries.find(key);
+    }
+    else
+    {
+        // move the key to the end of the use order:
+        d->useOrder.erase(it.value().useIterator);
+        it.value().useIterator = d->useOrder.insert(d->useOrder.end(), key);
+    }
+
+    // once per session is enough to keep the order of use across sessions
+    if (!it.value().touched)
+    {
+        touchFile(d->filePath(key));
+        it.value().touched = true;
+    }
+
+    return d->filePath(key);
+}
+
+bool TileDiskCache::insert(const QString& key, const QByteArray& data)
+{
+    if (!isValidKey(key))
+    {
+        return false;
+    }
+
+    finishScan(false);
+
+    const QHash<QString, Private::Entry>::iterator it = d->entries.find(key);
+
+    if (it != d->entries.end())
+    {
+        d->removeEntry(it);
+    }
+
+    // a tile larger than the whole cache would only evict everything else
+    if (data.size() > d->maxSize)
+    {
+        return false;
+    }
+
+    const QString filePath = d->filePath(key);
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+
+    // QSaveFile makes sure that a partially written tile is never found in the cache
+    QSaveFile file(filePath);
+
+    if (!file.open(QIODevice::WriteOnly) || (file.write(data) != data.size()) || !file.commit())
+    {
+        qCDebug(LIBKGEOMAP_LOG) << "Could not write tile" << filePath << file.errorString();
+        return false;
+    }
+
+    // a tile which the scan reports later is the old version of this one
+    d->removedDuringScan.remove(key);
+    d->addEntry(key, data.size(), true, d->useOrder.end());
+
+    d->evict();
+
+    return true;
+}
+
+void TileDiskCache::remove(const QString& key)
+{
+    finishScan(false);
+
+    const QHash<QString, Private::Entry>::iterator it = d->entries.find(key);
+
+    if (it != d->entries.end())
+    {
+        d->removeEntry(it);
+    }
+    else if (d->scanPending && isValidKey(key))
+    {
+        // the scan did not get to this tile yet
+        QFile::remove(d->filePath(key));
+        d->removedDuringScan.insert(key);
+    }
+}
+
+void TileDiskCache::clear()
+{
+    finishScan(true);
+
+    while (!d->useOrder.empty())
+    {
+        d->removeEntry(d->entries.find(d->useOrder.front()));
+    }
+}
+
+/**
+ * @brief Adds the tiles found by the scan of the directory, once it is finished
+ *
+ * The found tiles were used before all tiles which were used in this session.
+ */
+void TileDiskCache::finishScan(const bool wait) const
+{
+    if (!d->scanPending || (!wait && !d->scan.isFinished()))
+    {
+        return;
+    }
+
+    const QVector<FoundTile> foundTiles = d->scan.result();
+    d->scanPending                      = false;
+
+    const std::list<QString>::iterator sessionBegin = d->useOrder.begin();
+
+    for (int i = 0; i < foundTiles.count(); ++i)
+    {
+        const FoundTile& foundTile = foundTiles.at(i);
+
+        if (d->entries.contains(foundTile.key) || d->removedDuringScan.contains(foundTile.key))
+        {
+            continue;
+        }
+
+        d->addEntry(foundTile.key, foundTile.size, false, sessionBegin);
+    }
+
+    d->removedDuringScan.clear();
+
+    d->evict();
+}
+
+} /* namespace KGeoMap */
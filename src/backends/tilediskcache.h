@@ -0,0 +1,88 @@
+/** ===========================================================
+ * @file
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  A size-bounded on-disk cache for map tiles
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef TILE_DISK_CACHE_H
+#define TILE_DISK_CACHE_H
+
+// Qt includes
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+namespace KGeoMap
+{
+
+/**
+ * @brief Keeps recently used map tiles in a directory, up to a maximum size in bytes
+ *
+ * Tiles are stored as one file each, under their key, for example "12/2105/1346".
+ * When the cache grows beyond its maximum size, the least recently used tiles are removed.
+ * The order of use is kept in memory and in the modification times of the files: the first
+ * lookup of a tile in a session touches its file. When the cache is opened, the directory is
+ * scanned in a worker thread, so that opening a large cache does not block; until the scan
+ * is finished, tiles which are not known yet are looked up on disk directly.
+ *
+ * lookup() only returns the path of a tile, so that the caller can memory-map the file
+ * instead of reading it.
+ */
+class TileDiskCache
+{
+public:
+
+    explicit TileDiskCache(const QString& directory, const qint64 maxSize = DefaultMaxSize);
+    ~TileDiskCache();
+
+    QString directory() const;
+    qint64 maxSize() const;
+    void setMaxSize(const qint64 maxSize);
+    qint64 size() const;
+    int count() const;
+
+    QString lookup(const QString& key);
+    bool insert(const QString& key, const QByteArray& data);
+    void remove(const QString& key);
+    void clear();
+
+    static bool isValidKey(const QString& key);
+
+public:
+
+    enum
+    {
+        DefaultMaxSize = 200 * 1024 * 1024
+    };
+
+private:
+
+    void finishScan(const bool wait) const;
+
+private:
+
+    class Private;
+    Private* const d;
+};
+
+} /* namespace KGeoMap */
+
+#endif /* TILE_DISK_CACHE_H */
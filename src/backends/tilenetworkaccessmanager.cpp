@@ -0,0 +1,386 @@
+/** ===========================================================
+ * @file
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  Serves map tiles to the HTML backends from local sources and a disk cache
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "tilenetworkaccessmanager.h"
+
+// Qt includes
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QRegularExpression>
+#include <QStandardPaths>
+#include <QTimer>
+
+// local includes
+
+#include "tilediskcache.h"
+#include "libkgeomap_debug.h"
+
+namespace KGeoMap
+{
+
+namespace
+{
+
+/**
+ * @brief Reply which serves a tile from memory or from a memory-mapped file
+ */
+class TileReply : public QNetworkReply
+{
+public:
+
+    TileReply(const QNetworkRequest& request, QObject* const parent)
+        : QNetworkReply(parent),
+          file(),
+          content(),
+          readOffset(0)
+    {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(QNetworkAccessManager::GetOperation);
+        open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    }
+
+    void setContent(const QByteArray& data)
+    {
+        content = data;
+        finish();
+    }
+
+    bool setContentFromFile(const QString& filePath)
+    {
+        file.setFileName(filePath);
+
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            return false;
+        }
+
+        const qint64 fileSize = file.size();
+        uchar* const mapped   = (fileSize > 0) ? file.map(0, fileSize) : nullptr;
+
+        if (mapped)
+        {
+            // the mapping stays valid as long as the file is open, which is as long as the reply exists
+            content = QByteArray::fromRawData(reinterpret_cast<const char*>(mapped), fileSize);
+        }
+        else
+        {
+            content = file.readAll();
+        }
+
+        finish();
+
+        return true;
+    }
+
+    void setFailed(const NetworkError errorCode, const QString& errorString)
+    {
+        setError(errorCode, errorString);
+        finish();
+    }
+
+    qint64 bytesAvailable() const override
+    {
+        return (content.size() - readOffset) + QNetworkReply::bytesAvailable();
+    }
+
+    bool isSequential() const override
+    {
+        return true;
+    }
+
+    void abort() override
+    {
+        if (!isFinished())
+        {
+            // also cancels a download, which is a child of this reply
+            qDeleteAll(findChildren<QNetworkReply*>());
+            setFailed(OperationCanceledError, QLatin1String("Operation canceled"));
+        }
+    }
+
+protected:
+
+    qint64 readData(char* data, qint64 maxSize) override
+    {
+        const qint64 count = qMin(maxSize, qint64(content.size()) - readOffset);
+
+        if (count <= 0)
+        {
+            return -1;
+        }
+
+        memcpy(data, content.constData() + readOffset, count);
+        readOffset += count;
+
+        return count;
+    }
+
+private:
+
+    void finish()
+    {
+        setHeader(QNetworkRequest::ContentLengthHeader, content.size());
+        setFinished(true);
+
+        // the receiver expects the signals after the reply was returned to it
+        QTimer::singleShot(0, this, [this]()
+            {
+                emit(metaDataChanged());
+
+                if (error() != NoError)
+                {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+                    emit(errorOccurred(error()));
+#else
+                    emit(error(error()));
+#endif
+                }
+                else if (!content.isEmpty())
+                {
+                    emit(readyRead());
+                }
+
+                emit(finished());
+            }
+        );
+    }
+
+private:
+
+    QFile      file;
+    QByteArray content;
+    qint64     readOffset;
+};
+
+/// the instance, it is destroyed while the application object still exists
+TileNetworkAccessManager* tileNetworkAccessManager = nullptr;
+
+} /* anonymous namespace */
+
+class TileNetworkAccessManager::Private
+{
+public:
+
+    Private()
+      : remoteTileUrl(QLatin1String("https://tile.openstreetmap.org/${z}/${x}/${y}.png")),
+        localTileDirectory(),
+        offline(false),
+        diskCache(nullptr)
+    {
+    }
+
+    /**
+     * @brief Tiles of different servers and styles are cached under different directories
+     */
+    QString cacheKeyPrefix() const
+    {
+        return QString::fromLatin1(QCryptographicHash::hash(remoteTileUrl.toUtf8(), QCryptographicHash::Sha1).toHex().left(16));
+    }
+
+    QString        remoteTileUrl;
+    QString        localTileDirectory;
+    bool           offline;
+    TileDiskCache* diskCache;
+};
+
+TileNetworkAccessManager::TileNetworkAccessManager()
+    : QNetworkAccessManager(),
+      d(new Private())
+{
+}
+
+TileNetworkAccessManager::~TileNetworkAccessManager()
+{
+    delete d->diskCache;
+    delete d;
+}
+
+TileNetworkAccessManager* TileNetworkAccessManager::instance()
+{
+    if (!tileNetworkAccessManager)
+    {
+        tileNetworkAccessManager = new TileNetworkAccessManager();
+
+        // the threads of QNetworkAccessManager can not be shut down after the application object is gone
+        qAddPostRoutine(&TileNetworkAccessManager::destroyInstance);
+    }
+
+    return tileNetworkAccessManager;
+}
+
+void TileNetworkAccessManager::destroyInstance()
+{
+    delete tileNetworkAccessManager;
+    tileNetworkAccessManager = nullptr;
+}
+
+/**
+ * @brief The URL template from which the pages have to load their tiles
+ */
+QString TileNetworkAccessManager::pageTileUrl()
+{
+    return QLatin1String("kgeomaptile:/${z}/${x}/${y}");
+}
+
+QString TileNetworkAccessManager::remoteTileUrl() const
+{
+    return d->remoteTileUrl;
+}
+
+/**
+ * @brief Sets the URL template of the tile server, for example http://localhost:8080/${z}/${x}/${y}.png
+ */
+void TileNetworkAccessManager::setRemoteTileUrl(const QString& remoteTileUrl)
+{
+    d->remoteTileUrl = remoteTileUrl;
+}
+
+QString TileNetworkAccessManager::localTileDirectory() const
+{
+    return d->localTileDirectory;
+}
+
+void TileNetworkAccessManager::setLocalTileDirectory(const QString& directory)
+{
+    d->localTileDirectory = directory;
+}
+
+bool TileNetworkAccessManager::isOffline() const
+{
+    return d->offline;
+}
+
+/**
+ * @brief In offline mode, tiles are only taken from the local tile directory and the disk cache
+ */
+void TileNetworkAccessManager::setOffline(const bool state)
+{
+    d->offline = state;
+}
+
+TileDiskCache* TileNetworkAccessManager::diskCache() const
+{
+    if (!d->diskCache)
+    {
+        // the cache is only opened once the first tile is needed
+        const QString cacheDirectory = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) +
+                                       QLatin1String("/libkgeomap/tiles");
+        d->diskCache                 = new TileDiskCache(cacheDirectory);
+    }
+
+    return d->diskCache;
+}
+
+void TileNetworkAccessManager::setDiskCache(const QString& directory, const qint64 maxSize)
+{
+    delete d->diskCache;
+    d->diskCache = new TileDiskCache(directory, maxSize);
+}
+
+QNetworkReply* TileNetworkAccessManager::createRequest(Operation op, const QNetworkRequest& request, QIODevice* outgoingData)
+{
+    if (request.url().scheme() != QLatin1String("kgeomaptile"))
+    {
+        return QNetworkAccessManager::createRequest(op, request, outgoingData);
+    }
+
+    TileReply* const reply = new TileReply(request, this);
+
+    static const QRegularExpression tilePathExpression(QLatin1String("^/(\\d+)/(\\d+)/(\\d+)$"));
+    const QRegularExpressionMatch tilePath = tilePathExpression.match(request.url().path());
+
+    if ((op != GetOperation) || !tilePath.hasMatch())
+    {
+        reply->setFailed(QNetworkReply::ProtocolInvalidOperationError, QLatin1String("Invalid tile request"));
+        return reply;
+    }
+
+    const QString z   = tilePath.captured(1);
+    const QString x   = tilePath.captured(2);
+    const QString y   = tilePath.captured(3);
+    const QString key = QString::fromLatin1("%1/%2/%3").arg(z).arg(x).arg(y);
+
+    if (!d->localTileDirectory.isEmpty())
+    {
+        const QString localFilePath = QString::fromLatin1("%1/%2.png").arg(d->localTileDirectory).arg(key);
+
+        if (QFile::exists(localFilePath) && reply->setContentFromFile(localFilePath))
+        {
+            return reply;
+        }
+    }
+
+    const QString cacheKey       = d->cacheKeyPrefix() + QLatin1Char('/') + key;
+    const QString cachedFilePath = diskCache()->lookup(cacheKey);
+
+    if (!cachedFilePath.isEmpty() && reply->setContentFromFile(cachedFilePath))
+    {
+        return reply;
+    }
+
+    if (d->offline || d->remoteTileUrl.isEmpty())
+    {
+        reply->setFailed(QNetworkReply::ContentNotFoundError, QLatin1String("Tile is not available offline"));
+        return reply;
+    }
+
+    QString remoteUrl = d->remoteTileUrl;
+    remoteUrl.replace(QLatin1String("${z}"), z);
+    remoteUrl.replace(QLatin1String("${x}"), x);
+    remoteUrl.replace(QLatin1String("${y}"), y);
+
+    QNetworkRequest remoteRequest(QUrl(remoteUrl));
+    remoteRequest.setHeader(QNetworkRequest::UserAgentHeader, QLatin1String("libkgeomap"));
+
+    QNetworkReply* const remoteReply = QNetworkAccessManager::createRequest(GetOperation, remoteRequest, nullptr);
+
+    // deleting the tile reply also cancels the download
+    remoteReply->setParent(reply);
+
+    connect(remoteReply, &QNetworkReply::finished, reply, [this, reply, remoteReply, cacheKey]()
+        {
+            remoteReply->deleteLater();
+
+            if (remoteReply->error() != QNetworkReply::NoError)
+            {
+                qCDebug(LIBKGEOMAP_LOG) << "Could not download tile" << remoteReply->url() << remoteReply->errorString();
+                reply->setFailed(remoteReply->error(), remoteReply->errorString());
+                return;
+            }
+
+            const QByteArray data = remoteReply->readAll();
+            diskCache()->insert(cacheKey, data);
+            reply->setContent(data);
+        }
+    );
+
+    return reply;
+}
+
+} /* namespace KGeoMap */
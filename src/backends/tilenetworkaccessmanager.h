@@ -0,0 +1,89 @@
+/** ===========================================================
+ * @file
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  Serves map tiles to the HTML backends from local sources and a disk cache
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef TILE_NETWORK_ACCESS_MANAGER_H
+#define TILE_NETWORK_ACCESS_MANAGER_H
+
+// Qt includes
+
+#include <QNetworkAccessManager>
+
+namespace KGeoMap
+{
+
+class TileDiskCache;
+
+/**
+ * @brief Network access manager of the HTML pages which resolves tile requests locally
+ *
+ * Pages request their tiles from pageTileUrl(), an URL template with the kgeomaptile scheme.
+ * A tile is looked up in this order:
+ * @li in the local tile directory, laid out as z/x/y.png like the usual tile downloaders do,
+ * @li in the disk cache of recently used tiles, which keeps the tiles of each remote tile
+ *     URL apart, so that switching the server or the style does not show stale tiles,
+ * @li on the remote tile server, unless the manager is offline. Downloaded tiles are added
+ *     to the disk cache.
+ *
+ * Local and cached tiles are memory-mapped instead of read. All other requests of the
+ * pages are handled by QNetworkAccessManager as usual.
+ */
+class TileNetworkAccessManager : public QNetworkAccessManager
+{
+    Q_OBJECT
+
+public:
+
+    static TileNetworkAccessManager* instance();
+    static QString pageTileUrl();
+
+    QString remoteTileUrl() const;
+    void setRemoteTileUrl(const QString& remoteTileUrl);
+    QString localTileDirectory() const;
+    void setLocalTileDirectory(const QString& directory);
+    bool isOffline() const;
+    void setOffline(const bool state);
+
+    TileDiskCache* diskCache() const;
+    void setDiskCache(const QString& directory, const qint64 maxSize);
+
+protected:
+
+    QNetworkReply* createRequest(Operation op, const QNetworkRequest& request, QIODevice* outgoingData) override;
+
+private:
+
+    TileNetworkAccessManager();
+    ~TileNetworkAccessManager() override;
+
+    static void destroyInstance();
+
+    class Private;
+    Private* const d;
+
+    Q_DISABLE_COPY(TileNetworkAccessManager)
+};
+
+} /* namespace KGeoMap */
+
+#endif /* TILE_NETWORK_ACCESS_MANAGER_H */
@@ -0,0 +1,290 @@
+/** ===========================================================
+ * @file
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  Pre-rendered circle markers and label glyphs for clusters
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "circlemarkeratlas.h"
+
+// Qt includes
+
+#include <QCache>
+#include <QFont>
+#include <QFontMetrics>
+#include <QHash>
+#include <QPainter>
+
+namespace KGeoMap
+{
+
+namespace
+{
+
+class BodyKey
+{
+public:
+
+    bool operator==(const BodyKey& other) const
+    {
+        return (radius      == other.radius)      &&
+               (fillColor   == other.fillColor)   &&
+               (strokeColor == other.strokeColor) &&
+               (strokeStyle == other.strokeStyle);
+    }
+
+    int          radius;
+    QRgb         fillColor;
+    QRgb         strokeColor;
+    Qt::PenStyle strokeStyle;
+};
+
+uint qHash(const BodyKey& key)
+{
+    return uint(key.radius) ^ key.fillColor ^ (key.strokeColor << 3) ^ (uint(key.strokeStyle) << 24);
+}
+
+class GlyphKey
+{
+public:
+
+    bool operator==(const GlyphKey& other) const
+    {
+        return (character == other.character) && (labelColor == other.labelColor);
+    }
+
+    ushort character;
+    QRgb   labelColor;
+};
+
+uint qHash(const GlyphKey& key)
+{
+    return uint(key.character) ^ (key.labelColor << 8);
+}
+
+class ComposedKey
+{
+public:
+
+    bool operator==(const ComposedKey& other) const
+    {
+        return (body == other.body) && (labelColor == other.labelColor) && (labelText == other.labelText);
+    }
+
+    BodyKey body;
+    QRgb    labelColor;
+    QString labelText;
+};
+
+uint qHash(const ComposedKey& key)
+{
+    return qHash(key.body) ^ qHash(key.labelText) ^ key.labelColor;
+}
+
+class Glyph
+{
+public:
+
+    QPixmap pixmap;
+    int     advance;
+};
+
+} /* anonymous namespace */
+
+class CircleMarkerAtlas::Private
+{
+public:
+
+    Private()
+      : font(),
+        fontMetrics(font),
+        bodies(),
+        glyphs(),
+        composed(MaxComposedPixmaps)
+    {
+    }
+
+    enum
+    {
+        /// there are only few different labels, so this holds all of them in practice
+        MaxComposedPixmaps = 2000
+    };
+
+    const QPixmap& body(const BodyKey& key)
+    {
+        QHash<BodyKey, QPixmap>::iterator it = bodies.find(key);
+
+        if (it != bodies.end())
+        {
+            return it.value();
+        }
+
+        QPen circlePen;
+        circlePen.setColor(QColor::fromRgba(key.strokeColor));
+        circlePen.setStyle(key.strokeStyle);
+        circlePen.setWidth(2);
+
+        const int pixmapDiameter = 2*(key.radius+1);
+        QPixmap bodyPixmap(pixmapDiameter, pixmapDiameter);
+        bodyPixmap.fill(QColor(0,0,0,0));
+
+        QPainter painter(&bodyPixmap);
+        painter.setPen(circlePen);
+        painter.setBrush(QBrush(QColor::fromRgba(key.fillColor)));
+        painter.drawEllipse(QRect(0, 0, 2*key.radius, 2*key.radius));
+        painter.end();
+
+        return bodies.insert(key, bodyPixmap).value();
+    }
+
+    const Glyph& glyph(const QChar character, const QRgb labelColor)
+    {
+        GlyphKey key;
+        key.character  = character.unicode();
+        key.labelColor = labelColor;
+
+        QHash<GlyphKey, Glyph>::iterator it = glyphs.find(key);
+
+        if (it != glyphs.end())
+        {
+            return it.value();
+        }
+
+        Glyph newGlyph;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+        newGlyph.advance = fontMetrics.horizontalAdvance(character);
+#else
+        newGlyph.advance = fontMetrics.width(character);
+#endif
+        newGlyph.pixmap  = QPixmap(qMax(1, newGlyph.advance), qMax(1, fontMetrics.height()));
+        newGlyph.pixmap.fill(QColor(0,0,0,0));
+
+        QPainter painter(&newGlyph.pixmap);
+        painter.setFont(font);
+        painter.setPen(QColor::fromRgba(labelColor));
+        painter.drawText(0, fontMetrics.ascent(), QString(character));
+        painter.end();
+
+        return glyphs.insert(key, newGlyph).value();
+    }
+
+    QFont                          font;
+    QFontMetrics                   fontMetrics;
+    QHash<BodyKey, QPixmap>        bodies;
+    QHash<GlyphKey, Glyph>         glyphs;
+    QCache<ComposedKey, QPixmap>   composed;
+};
+
+CircleMarkerAtlas::CircleMarkerAtlas()
+    : d(new Private())
+{
+}
+
+CircleMarkerAtlas::~CircleMarkerAtlas()
+{
+    delete d;
+}
+
+/**
+ * @brief Returns a circle of diameter 2*radius with the label centered on it
+ *
+ * The pixmap has a transparent margin of one pixel, like the circles which were painted directly.
+ */
+QPixmap CircleMarkerAtlas::circlePixmap(const int radius,
+                                        const QColor& fillColor,
+                                        const QColor& strokeColor,
+                                        const Qt::PenStyle strokeStyle,
+                                        const QString& labelText,
+                                        const QColor& labelColor)
+{
+    ComposedKey key;
+    key.body.radius      = radius;
+    key.body.fillColor   = fillColor.rgba();
+    key.body.strokeColor = strokeColor.rgba();
+    key.body.strokeStyle = strokeStyle;
+    key.labelColor       = labelColor.rgba();
+    key.labelText        = labelText;
+
+    const QPixmap* const composedPixmap = d->composed.object(key);
+
+    if (composedPixmap)
+    {
+        return *composedPixmap;
+    }
+
+    QPixmap resultPixmap = d->body(key.body).copy();
+
+    if (!labelText.isEmpty())
+    {
+        int labelWidth = 0;
+
+        for (int i = 0; i < labelText.length(); ++i)
+        {
+            labelWidth += d->glyph(labelText.at(i), key.labelColor).advance;
+        }
+
+        // center the label on the circle, like QPainter::drawText with Qt::AlignCenter does
+        int x       = (2*radius - labelWidth) / 2;
+        const int y = (2*radius - d->fontMetrics.height()) / 2;
+
+        QPainter painter(&resultPixmap);
+
+        for (int i = 0; i < labelText.length(); ++i)
+        {
+            const Glyph& labelGlyph = d->glyph(labelText.at(i), key.labelColor);
+            painter.drawPixmap(x, y, labelGlyph.pixmap);
+            x += labelGlyph.advance;
+        }
+
+        painter.end();
+    }
+
+    d->composed.insert(key, new QPixmap(resultPixmap));
+
+    return resultPixmap;
+}
+
+void CircleMarkerAtlas::clear()
+{
+    d->bodies.clear();
+    d->glyphs.clear();
+    d->composed.clear();
+
+    // pick up changes of the application font
+    d->font        = QFont();
+    d->fontMetrics = QFontMetrics(d->font);
+}
+
+int CircleMarkerAtlas::bodyCount() const
+{
+    return d->bodies.count();
+}
+
+int CircleMarkerAtlas::glyphCount() const
+{
+    return d->glyphs.count();
+}
+
+int CircleMarkerAtlas::composedCount() const
+{
+    return d->composed.count();
+}
+
+} /* namespace KGeoMap */
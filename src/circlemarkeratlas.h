@@ -0,0 +1,72 @@
+/** ===========================================================
+ * @file
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  Pre-rendered circle markers and label glyphs for clusters
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef KGEOMAP_CIRCLEMARKERATLAS_H
+#define KGEOMAP_CIRCLEMARKERATLAS_H
+
+// Qt includes
+
+#include <QtGui/QColor>
+#include <QtGui/QPixmap>
+
+namespace KGeoMap
+{
+
+/**
+ * @brief Draws the circles of clusters without thumbnails from pre-rendered parts
+ *
+ * The circle bodies are rendered once per radius, fill color, stroke color and stroke style,
+ * the characters of the labels once per label color. A circle with a label is composed from
+ * these parts and kept, so that a label which was drawn before costs only a lookup.
+ */
+class CircleMarkerAtlas
+{
+public:
+
+    CircleMarkerAtlas();
+    ~CircleMarkerAtlas();
+
+    QPixmap circlePixmap(const int radius,
+                         const QColor& fillColor,
+                         const QColor& strokeColor,
+                         const Qt::PenStyle strokeStyle,
+                         const QString& labelText,
+                         const QColor& labelColor);
+    void clear();
+
+    int bodyCount() const;
+    int glyphCount() const;
+    int composedCount() const;
+
+private:
+
+    class Private;
+    Private* const d;
+
+    Q_DISABLE_COPY(CircleMarkerAtlas)
+};
+
+} /* namespace KGeoMap */
+
+#endif /* KGEOMAP_CIRCLEMARKERATLAS_H */
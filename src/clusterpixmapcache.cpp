@@ -0,0 +1,216 @@
+/** ===========================================================
+ * @file
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  Cache for the decorated pixmaps of clusters
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "clusterpixmapcache.h"
+
+// Qt includes
+
+#include <QCache>
+
+// local includes
+
+#include "abstractmarkertiler.h"
+
+namespace KGeoMap
+{
+
+ClusterPixmapCache::Key::Key(const AbstractMarkerTiler* const tiler,
+                             const QVariant& representativeIndex,
+                             const int thumbnailSize,
+                             const GroupState groupState,
+                             const QString& labelText,
+                             const QColor& strokeColor,
+                             const Qt::PenStyle strokeStyle,
+                             const bool grayOut,
+                             const bool crossOut)
+    : tiler(tiler),
+      representativeIndex(representativeIndex),
+      indexHash(tiler ? tiler->indexHash(representativeIndex) : 0),
+      thumbnailSize(thumbnailSize),
+      groupState(groupState),
+      labelText(labelText),
+      strokeColor(strokeColor.rgba()),
+      strokeStyle(strokeStyle),
+      grayOut(grayOut),
+      crossOut(crossOut)
+{
+}
+
+bool ClusterPixmapCache::Key::operator==(const Key& other) const
+{
+    // compare the cheap values first, the marker tiler decides about the indices
+    return (tiler         == other.tiler)         &&
+           (indexHash     == other.indexHash)     &&
+           (thumbnailSize == other.thumbnailSize) &&
+           (groupState    == other.groupState)    &&
+           (strokeColor   == other.strokeColor)   &&
+           (strokeStyle   == other.strokeStyle)   &&
+           (grayOut       == other.grayOut)       &&
+           (crossOut      == other.crossOut)      &&
+           (labelText     == other.labelText)     &&
+           tiler && tiler->indicesEqual(representativeIndex, other.representativeIndex);
+}
+
+uint qHash(const ClusterPixmapCache::Key& key)
+{
+    return key.indexHash ^ qHash(key.labelText) ^ (uint(key.thumbnailSize) << 8) ^
+           (uint(key.groupState) << 20) ^ (uint(key.grayOut) << 28) ^ (uint(key.crossOut) << 29);
+}
+
+class ClusterPixmapCache::Private
+{
+public:
+
+    Private()
+      : pixmaps(),
+        hits(0),
+        misses(0)
+    {
+    }
+
+    static int pixmapBytes(const QPixmap& pixmap)
+    {
+        return pixmap.width() * pixmap.height() * qMax(1, pixmap.depth() / 8);
+    }
+
+    /// the cost of a pixmap is its size in bytes
+    QCache<Key, QPixmap> pixmaps;
+    int                  hits;
+    int                  misses;
+};
+
+ClusterPixmapCache::ClusterPixmapCache(const int maxBytes)
+    : d(new Private())
+{
+    d->pixmaps.setMaxCost(maxBytes);
+}
+
+ClusterPixmapCache::~ClusterPixmapCache()
+{
+    delete d;
+}
+
+/**
+ * @brief Looks up a pixmap and makes it the most recently used one
+ */
+bool ClusterPixmapCache::find(const Key& key, QPixmap* const pixmap)
+{
+    const QPixmap* const cachedPixmap = d->pixmaps.object(key);
+
+    if (!cachedPixmap)
+    {
+        ++d->misses;
+        return false;
+    }
+
+    ++d->hits;
+
+    if (pixmap)
+    {
+        *pixmap = *cachedPixmap;
+    }
+
+    return true;
+}
+
+void ClusterPixmapCache::insert(const Key& key, const QPixmap& pixmap)
+{
+    // QCache drops pixmaps which are larger than the whole budget
+    d->pixmaps.insert(key, new QPixmap(pixmap), Private::pixmapBytes(pixmap));
+}
+
+/**
+ * @brief Removes all pixmaps of a representative marker, for example because its thumbnail changed
+ */
+void ClusterPixmapCache::removeIndex(const AbstractMarkerTiler* const tiler, const QVariant& representativeIndex)
+{
+    if (!tiler)
+    {
+        return;
+    }
+
+    const uint indexHash  = tiler->indexHash(representativeIndex);
+    const QList<Key> keys = d->pixmaps.keys();
+
+    for (int i = 0; i < keys.count(); ++i)
+    {
+        const Key& key = keys.at(i);
+
+        if ((key.tiler == tiler) && (key.indexHash == indexHash) &&
+            tiler->indicesEqual(key.representativeIndex, representativeIndex))
+        {
+            d->pixmaps.remove(key);
+        }
+    }
+}
+
+void ClusterPixmapCache::clear()
+{
+    d->pixmaps.clear();
+}
+
+int ClusterPixmapCache::maxBytes() const
+{
+    return d->pixmaps.maxCost();
+}
+
+void ClusterPixmapCache::setMaxBytes(const int maxBytes)
+{
+    d->pixmaps.setMaxCost(maxBytes);
+}
+
+int ClusterPixmapCache::bytes() const
+{
+    return d->pixmaps.totalCost();
+}
+
+int ClusterPixmapCache::count() const
+{
+    return d->pixmaps.count();
+}
+
+int ClusterPixmapCache::hits() const
+{
+    return d->hits;
+}
+
+int ClusterPixmapCache::misses() const
+{
+    return d->misses;
+}
+
+qreal ClusterPixmapCache::hitRate() const
+{
+    const int lookups = d->hits + d->misses;
+
+    return (lookups > 0) ? (qreal(d->hits) / qreal(lookups)) : 0.0;
+}
+
+void ClusterPixmapCache::resetCounters()
+{
+    d->hits   = 0;
+    d->misses = 0;
+}
+
+} /* namespace KGeoMap */
@@ -0,0 +1,121 @@
+/** ===========================================================
+ * @file
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  Cache for the decorated pixmaps of clusters
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef KGEOMAP_CLUSTERPIXMAPCACHE_H
+#define KGEOMAP_CLUSTERPIXMAPCACHE_H
+
+// Qt includes
+
+#include <QtCore/QVariant>
+#include <QtGui/QColor>
+#include <QtGui/QPixmap>
+
+// local includes
+
+#include "groupstate.h"
+
+namespace KGeoMap
+{
+
+class AbstractMarkerTiler;
+
+/**
+ * @brief Keeps the most recently used decorated cluster thumbnails, up to a budget in bytes
+ *
+ * A pixmap is stored under everything which goes into its decoration: the representative
+ * marker, the thumbnail size, the group state, the label, the border style and the gray-out
+ * and cross-out flags. Representative markers are compared by the marker tiler.
+ */
+class ClusterPixmapCache
+{
+public:
+
+    class Key
+    {
+    public:
+
+        Key(const AbstractMarkerTiler* const tiler,
+            const QVariant& representativeIndex,
+            const int thumbnailSize,
+            const GroupState groupState,
+            const QString& labelText,
+            const QColor& strokeColor,
+            const Qt::PenStyle strokeStyle,
+            const bool grayOut,
+            const bool crossOut);
+
+        bool operator==(const Key& other) const;
+
+        const AbstractMarkerTiler* tiler;
+        QVariant                   representativeIndex;
+        uint                       indexHash;
+        int                        thumbnailSize;
+        GroupState                 groupState;
+        QString                    labelText;
+        QRgb                       strokeColor;
+        Qt::PenStyle               strokeStyle;
+        bool                       grayOut;
+        bool                       crossOut;
+    };
+
+public:
+
+    explicit ClusterPixmapCache(const int maxBytes = DefaultMaxBytes);
+    ~ClusterPixmapCache();
+
+    bool find(const Key& key, QPixmap* const pixmap);
+    void insert(const Key& key, const QPixmap& pixmap);
+    void removeIndex(const AbstractMarkerTiler* const tiler, const QVariant& representativeIndex);
+    void clear();
+
+    int maxBytes() const;
+    void setMaxBytes(const int maxBytes);
+    int bytes() const;
+    int count() const;
+
+    int hits() const;
+    int misses() const;
+    qreal hitRate() const;
+    void resetCounters();
+
+public:
+
+    enum
+    {
+        DefaultMaxBytes = 32 * 1024 * 1024
+    };
+
+private:
+
+    class Private;
+    Private* const d;
+
+    Q_DISABLE_COPY(ClusterPixmapCache)
+};
+
+uint qHash(const ClusterPixmapCache::Key& key);
+
+} /* namespace KGeoMap */
+
+#endif /* KGEOMAP_CLUSTERPIXMAPCACHE_H */
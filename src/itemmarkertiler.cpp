@@ -26,6 +26,11 @@
 
 #include "itemmarkertiler.h"
 
+// Qt includes
+
+#include <QtNumeric>
+#include <QVector>
+
 // local includes
 
 #include "modelhelper.h"
@@ -96,6 +101,14 @@ void ItemMarkerTiler::MyTile::removeMarkerIndexOrInvalidIndex(const QModelIndex&
 
 // -------------------------------------------------------------------------------------------
 
+namespace
+{
+
+/// tile key of markers without coordinates
+const quint64 NoTileKey = ~quint64(0);
+
+} /* anonymous namespace */
+
 class Q_DECL_HIDDEN ItemMarkerTiler::Private
 {
 public:
@@ -104,14 +117,45 @@ public:
       : modelHelper(nullptr),
         selectionModel(nullptr),
         markerModel(nullptr),
-        activeState(false)
+        activeState(false),
+        latKeys(),
+        lonKeys()
     {
     }
 
+    /**
+     * @brief Looks up the coordinates of a marker, top level markers are read by row from the
+     *        coordinate cache of the model helper
+     */
+    bool markerCoordinates(const int row, const QModelIndex& parentIndex, GeoCoordinates* const coordinates) const
+    {
+        if (!parentIndex.isValid() && (row < modelHelper->cachedRowCount()))
+        {
+            const qreal lat = modelHelper->cachedLatitudes()[row];
+            const qreal lon = modelHelper->cachedLongitudes()[row];
+
+            if (qIsNaN(lat) || qIsNaN(lon))
+            {
+                return false;
+            }
+
+            *coordinates = GeoCoordinates(lat, lon);
+
+            return true;
+        }
+
+        return modelHelper->cachedItemCoordinates(markerModel->index(row, 0, parentIndex), coordinates);
+    }
+
     ModelHelper*         modelHelper;
     QItemSelectionModel* selectionModel;
     QAbstractItemModel*  markerModel;
     bool                 activeState;
+
+    /// keys of the tiles at the maximum level which contain the top level markers, by row,
+    /// so that a marker can be removed from its tiles after its coordinates changed
+    QVector<quint64>     latKeys;
+    QVector<quint64>     lonKeys;
 };
 
 ItemMarkerTiler::ItemMarkerTiler(ModelHelper* const modelHelper, QObject* const parent)
@@ -138,14 +182,15 @@ void ItemMarkerTiler::setMarkerModelHelper(ModelHelper* const modelHelper)
 
     if (d->markerModel != nullptr)
     {
+        // the coordinate cache has to see row insertions before we do
+        d->modelHelper->setCoordinateCacheEnabled(true);
+
         // TODO: disconnect the old model if there was one
         connect(d->markerModel, &QAbstractItemModel::rowsInserted, this, &ItemMarkerTiler::slotSourceModelRowsInserted);
 
         connect(d->markerModel, &QAbstractItemModel::rowsAboutToBeRemoved, this, &ItemMarkerTiler::slotSourceModelRowsAboutToBeRemoved);
 
-        // TODO: this signal now has to be monitored in the model helper
-//         connect(d->markerModel, SIGNAL(dataChanged(QModelIndex,QModelIndex)),
-//                 this, SLOT(slotSourceModelDataChanged(QModelIndex,QModelIndex)));
+        connect(d->markerModel, &QAbstractItemModel::dataChanged, this, &ItemMarkerTiler::slotSourceModelDataChanged);
 
         connect(d->modelHelper, &ModelHelper::signalModelChangedDrastically, this, &ItemMarkerTiler::slotSourceModelReset);
 
@@ -153,6 +198,9 @@ void ItemMarkerTiler::setMarkerModelHelper(ModelHelper* const modelHelper)
 
         connect(d->markerModel, &QAbstractItemModel::layoutChanged, this, &ItemMarkerTiler::slotSourceModelLayoutChanged);
 
+        // the tile keys are stored by row
+        connect(d->markerModel, &QAbstractItemModel::rowsMoved, this, &ItemMarkerTiler::slotSourceModelLayoutChanged);
+
         connect(d->modelHelper, &ModelHelper::signalThumbnailAvailableForIndex, this, &ItemMarkerTiler::slotThumbnailAvailableForIndex);
 
         if (d->selectionModel)
@@ -205,16 +253,17 @@ void ItemMarkerTiler::slotSelectionChanged(const QItemSelection& selected, const
     for (int i = 0; i < selected.count(); ++i)
     {
         const QItemSelectionRange selectionRange = selected.at(i);
+        const QModelIndex parentIndex            = selectionRange.parent();
 
         for (int row = selectionRange.top(); row <= selectionRange.bottom(); ++row)
         {
             // get the coordinates of the item
             GeoCoordinates coordinates;
 
-            if (!d->modelHelper->itemCoordinates(d->markerModel->index(row, 0, selectionRange.parent()), &coordinates))
+            if (!d->markerCoordinates(row, parentIndex, &coordinates))
                 continue;
 
-            for (int l = 0; l <= TileIndex::MaxLevel; ++l)
+            for (int l = 0; l <= maxLevel(); ++l)
             {
                 const TileIndex tileIndex = TileIndex::fromCoordinates(coordinates, l);
                 MyTile* const myTile      = static_cast<MyTile*>(getTile(tileIndex, true));
@@ -235,16 +284,17 @@ void ItemMarkerTiler::slotSelectionChanged(const QItemSelection& selected, const
     for (int i = 0; i < deselected.count(); ++i)
     {
         const QItemSelectionRange selectionRange = deselected.at(i);
+        const QModelIndex parentIndex            = selectionRange.parent();
 
         for (int row = selectionRange.top(); row <= selectionRange.bottom(); ++row)
         {
             // get the coordinates of the item
             GeoCoordinates coordinates;
 
-            if (!d->modelHelper->itemCoordinates(d->markerModel->index(row, 0, selectionRange.parent()), &coordinates))
+            if (!d->markerCoordinates(row, parentIndex, &coordinates))
                 continue;
 
-            for (int l = 0; l <= TileIndex::MaxLevel; ++l)
+            for (int l = 0; l <= maxLevel(); ++l)
             {
                 const TileIndex tileIndex = TileIndex::fromCoordinates(coordinates, l);
                 MyTile* const myTile      = static_cast<MyTile*>(getTile(tileIndex, true));
@@ -264,25 +314,83 @@ void ItemMarkerTiler::slotSelectionChanged(const QItemSelection& selected, const
     emit(signalTilesOrSelectionChanged());
 }
 
+/**
+ * @brief Moves the markers whose coordinates changed to their new tiles
+ */
 void ItemMarkerTiler::slotSourceModelDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight)
 {
-    qCDebug(LIBKGEOMAP_LOG) << topLeft << bottomRight;
-    setDirty();
+    if (isDirty() || topLeft.parent().isValid())
+    {
+        return;
+    }
+
+    if (bottomRight.row() >= d->latKeys.count())
+    {
+        // we are out of sync, read everything again later
+        setDirty();
+        emit(signalTilesOrSelectionChanged());
+        return;
+    }
+
+    bool markersMoved = false;
 
-    if (d->activeState)
-        emit signalTilesOrSelectionChanged();
+    for (int row = topLeft.row(); row <= bottomRight.row(); ++row)
+    {
+        // the coordinate cache was already updated by the model helper
+        quint64 newLatKey = NoTileKey;
+        quint64 newLonKey = NoTileKey;
+        GeoCoordinates coordinates;
 
-    // TODO: if only a few items were changed, try to see whether they are still in the right tiles
+        if (d->markerCoordinates(row, QModelIndex(), &coordinates))
+        {
+            TileIndex::fromCoordinates(coordinates, maxLevel()).toLatLonKeys(&newLatKey, &newLonKey);
+        }
+
+        // most changes of the data do not move the marker out of its tile
+        if ((newLatKey == d->latKeys.at(row)) && (newLonKey == d->lonKeys.at(row)))
+            continue;
+
+        const QPersistentModelIndex markerIndex(d->markerModel->index(row, 0));
+
+        // the marker is found in its old tiles through the stored keys
+        removeMarkerIndexFromGrid(markerIndex);
+        d->latKeys[row] = newLatKey;
+        d->lonKeys[row] = newLonKey;
+
+        if (newLatKey != NoTileKey)
+        {
+            addMarkerIndexToGrid(markerIndex, TileIndex::fromLatLonKeys(newLatKey, newLonKey, maxLevel()));
+        }
+
+        markersMoved = true;
+    }
+
+    if (markersMoved)
+    {
+        emit(signalTilesOrSelectionChanged());
+    }
 }
 
 void ItemMarkerTiler::slotSourceModelRowsInserted(const QModelIndex& parentIndex, int start, int end)
 {
-    if (isDirty())
+    // like regenerateTiles(), only top level items are shown as markers
+    if (isDirty() || parentIndex.isValid())
     {
         // rows will be added once the tiles are regenerated
         return;
     }
 
+    if (start > d->latKeys.count())
+    {
+        setDirty();
+        emit(signalTilesOrSelectionChanged());
+        return;
+    }
+
+    const int count = end - start + 1;
+    d->latKeys.insert(start, count, NoTileKey);
+    d->lonKeys.insert(start, count, NoTileKey);
+
     // sort the new items into our tiles:
     for (int i = start; i <= end; ++i)
     {
@@ -301,7 +409,7 @@ void ItemMarkerTiler::slotSourceModelRowsAboutToBeRemoved(const QModelIndex& par
     setDirty();
     return;
 #else
-    if (isDirty())
+    if (isDirty() || parentIndex.isValid())
     {
         return;
     }
@@ -309,12 +417,22 @@ void ItemMarkerTiler::slotSourceModelRowsAboutToBeRemoved(const QModelIndex& par
     // remove the items from their tiles:
     for (int i = start; i <= end; ++i)
     {
-        const QModelIndex itemIndex = d->markerModel->index(start, 0, parentIndex);
+        const QModelIndex itemIndex = d->markerModel->index(i, 0, parentIndex);
 
         // remove the marker from the grid, but leave the selection count alone because the
         // selection model will send a signal about the deselection of the marker
         removeMarkerIndexFromGrid(itemIndex, true);
     }
+
+    if (end < d->latKeys.count())
+    {
+        d->latKeys.remove(start, end - start + 1);
+        d->lonKeys.remove(start, end - start + 1);
+    }
+    else
+    {
+        setDirty();
+    }
 #endif
 }
 
@@ -355,18 +473,33 @@ void ItemMarkerTiler::removeMarkerIndexFromGrid(const QModelIndex& markerIndex,
         markerIsSelected = d->selectionModel->isSelected(markerIndex);
     }
 
-    // remove the marker from the grid:
-    GeoCoordinates markerCoordinates;
+    // remove the marker from the grid, top level markers are found through the keys of their tiles,
+    // which are still valid if the coordinates of the marker were changed in the meantime:
+    TileIndex tileIndex;
+    const int row = markerIndex.row();
 
-    if (!d->modelHelper->itemCoordinates(markerIndex, &markerCoordinates))
-        return;
+    if (!markerIndex.parent().isValid() && (row < d->latKeys.count()))
+    {
+        if (d->latKeys.at(row) == NoTileKey)
+            return;
+
+        tileIndex = TileIndex::fromLatLonKeys(d->latKeys.at(row), d->lonKeys.at(row), maxLevel());
+    }
+    else
+    {
+        GeoCoordinates markerCoordinates;
+
+        if (!d->modelHelper->cachedItemCoordinates(markerIndex, &markerCoordinates))
+            return;
+
+        tileIndex = TileIndex::fromCoordinates(markerCoordinates, maxLevel());
+    }
 
-    const TileIndex tileIndex = TileIndex::fromCoordinates(markerCoordinates, TileIndex::MaxLevel);
     QList<MyTile*> tiles;
 
     // here l functions as the number of indices that we actually use, therefore we have to go one more up
     // in this case, l==0 returns the root tile
-    for (int l = 0; l <= TileIndex::MaxLevel+1; ++l)
+    for (int l = 0; l <= maxLevel()+1; ++l)
     {
         MyTile* const currentTile = static_cast<MyTile*>(getTile(tileIndex.mid(0, l), true));
 
@@ -403,7 +536,7 @@ int ItemMarkerTiler::getTileMarkerCount(const TileIndex& tileIndex)
         regenerateTiles();
     }
 
-    KGEOMAP_ASSERT(tileIndex.level() <= TileIndex::MaxLevel);
+    KGEOMAP_ASSERT(tileIndex.level() <= maxLevel());
 
     MyTile* const myTile = static_cast<MyTile*>(getTile(tileIndex, true));
 
@@ -422,7 +555,7 @@ int ItemMarkerTiler::getTileSelectedCount(const TileIndex& tileIndex)
         regenerateTiles();
     }
 
-    KGEOMAP_ASSERT(tileIndex.level() <= TileIndex::MaxLevel);
+    KGEOMAP_ASSERT(tileIndex.level() <= maxLevel());
 
     MyTile* const myTile = static_cast<MyTile*>(getTile(tileIndex, true));
 
@@ -441,7 +574,7 @@ GroupState ItemMarkerTiler::getTileGroupState(const TileIndex& tileIndex)
         regenerateTiles();
     }
 
-    KGEOMAP_ASSERT(tileIndex.level() <= TileIndex::MaxLevel);
+    KGEOMAP_ASSERT(tileIndex.level() <= maxLevel());
 
     MyTile* const myTile = static_cast<MyTile*>(getTile(tileIndex, true));
 
@@ -471,7 +604,7 @@ AbstractMarkerTiler::Tile* ItemMarkerTiler::getTile(const TileIndex& tileIndex,
         regenerateTiles();
     }
 
-    KGEOMAP_ASSERT(tileIndex.level() <= TileIndex::MaxLevel);
+    KGEOMAP_ASSERT(tileIndex.level() <= maxLevel());
 
     MyTile* tile = static_cast<MyTile*>(rootTile());
 
@@ -491,14 +624,14 @@ AbstractMarkerTiler::Tile* ItemMarkerTiler::getTile(const TileIndex& tileIndex,
                     const QPersistentModelIndex currentMarkerIndex = tile->markerIndices.at(i);
                     KGEOMAP_ASSERT(currentMarkerIndex.isValid());
 
-                    // get the tile index for this marker:
+                    // get the tile index for this marker, the tiles only contain top level markers:
                     GeoCoordinates currentMarkerCoordinates;
 
-                    if (!d->modelHelper->itemCoordinates(currentMarkerIndex, &currentMarkerCoordinates))
+                    if (!d->markerCoordinates(currentMarkerIndex.row(), QModelIndex(), &currentMarkerCoordinates))
                         continue;
 
                     const TileIndex markerTileIndex = TileIndex::fromCoordinates(currentMarkerCoordinates, level);
-                    const int newTileIndex          = markerTileIndex.toIntList().last();
+                    const int newTileIndex          = markerTileIndex.linearIndex(level);
 
                     MyTile* newTile = static_cast<MyTile*>(tile->getChild(newTileIndex));
 
@@ -548,7 +681,7 @@ QList<QPersistentModelIndex> ItemMarkerTiler::getTileMarkerIndices(const TileInd
         regenerateTiles();
     }
 
-    KGEOMAP_ASSERT(tileIndex.level() <= TileIndex::MaxLevel);
+    KGEOMAP_ASSERT(tileIndex.level() <= maxLevel());
 
     MyTile* const myTile = static_cast<MyTile*>(getTile(tileIndex, true));
 
@@ -571,11 +704,26 @@ void ItemMarkerTiler::addMarkerIndexToGrid(const QPersistentModelIndex& markerIn
 
     GeoCoordinates markerCoordinates;
 
-    if (!d->modelHelper->itemCoordinates(markerIndex, &markerCoordinates))
+    if (!d->modelHelper->cachedItemCoordinates(markerIndex, &markerCoordinates))
         return;
 
-    TileIndex tileIndex = TileIndex::fromCoordinates(markerCoordinates, TileIndex::MaxLevel);
-    KGEOMAP_ASSERT(tileIndex.level() == TileIndex::MaxLevel);
+    const TileIndex tileIndex = TileIndex::fromCoordinates(markerCoordinates, maxLevel());
+    const int row             = markerIndex.row();
+
+    if (!markerIndex.parent().isValid() && (row < d->latKeys.count()))
+    {
+        tileIndex.toLatLonKeys(&d->latKeys[row], &d->lonKeys[row]);
+    }
+
+    addMarkerIndexToGrid(markerIndex, tileIndex);
+}
+
+/**
+ * @brief Adds a marker to the tiles, given the index of its tile at the maximum level
+ */
+void ItemMarkerTiler::addMarkerIndexToGrid(const QPersistentModelIndex& markerIndex, const TileIndex& tileIndex)
+{
+    KGEOMAP_ASSERT(tileIndex.level() == maxLevel());
 
     bool markerIsSelected = false;
 
@@ -587,7 +735,7 @@ void ItemMarkerTiler::addMarkerIndexToGrid(const QPersistentModelIndex& markerIn
     // add the marker to all existing tiles:
     MyTile* currentTile = static_cast<MyTile*>(rootTile());
 
-    for (int l = 0; l <= TileIndex::MaxLevel; ++l)
+    for (int l = 0; l <= maxLevel(); ++l)
     {
         currentTile->markerIndices<<markerIndex;
 
@@ -612,7 +760,7 @@ void ItemMarkerTiler::addMarkerIndexToGrid(const QPersistentModelIndex& markerIn
         }
 
         // if this is the last loop iteration, populate the next tile now:
-        if (l == TileIndex::MaxLevel)
+        if (l == maxLevel())
         {
             nextTile->markerIndices<<markerIndex;
 
@@ -634,15 +782,44 @@ void ItemMarkerTiler::regenerateTiles()
 {
     resetRootTile();
     setDirty(false);
+    d->latKeys.clear();
+    d->lonKeys.clear();
 
     if (!d->markerModel)
         return;
 
-    // read out all existing markers into tiles:
-    for (int row = 0; row < d->markerModel->rowCount(); ++row)
+    const int rowCount            = d->markerModel->rowCount();
+    const qreal* latitudes        = d->modelHelper->cachedLatitudes();
+    const qreal* longitudes       = d->modelHelper->cachedLongitudes();
+    QVector<qreal> readLatitudes;
+    QVector<qreal> readLongitudes;
+
+    if (d->modelHelper->cachedRowCount() != rowCount)
     {
-        const QModelIndex modelIndex = d->markerModel->index(row, 0);
-        addMarkerIndexToGrid(QPersistentModelIndex(modelIndex));
+        // the coordinate cache is not available, read all coordinates at once
+        readLatitudes.resize(rowCount);
+        readLongitudes.resize(rowCount);
+        d->modelHelper->itemCoordinatesBulk(0, rowCount, readLatitudes.data(), readLongitudes.data());
+        latitudes  = readLatitudes.constData();
+        longitudes = readLongitudes.constData();
+    }
+
+    // compute the tiles of all markers at once:
+    d->latKeys.resize(rowCount);
+    d->lonKeys.resize(rowCount);
+    TileIndex::keysFromCoordinates(latitudes, longitudes, rowCount, maxLevel(), d->latKeys.data(), d->lonKeys.data());
+
+    for (int row = 0; row < rowCount; ++row)
+    {
+        if (qIsNaN(latitudes[row]) || qIsNaN(longitudes[row]))
+        {
+            d->latKeys[row] = NoTileKey;
+            d->lonKeys[row] = NoTileKey;
+            continue;
+        }
+
+        addMarkerIndexToGrid(QPersistentModelIndex(d->markerModel->index(row, 0)),
+                             TileIndex::fromLatLonKeys(d->latKeys.at(row), d->lonKeys.at(row), maxLevel()));
     }
 }
 
@@ -651,6 +828,11 @@ bool ItemMarkerTiler::indicesEqual(const QVariant& a, const QVariant& b) const
     return a.value<QPersistentModelIndex>()==b.value<QPersistentModelIndex>();
 }
 
+uint ItemMarkerTiler::indexHash(const QVariant& index) const
+{
+    return qHash(QModelIndex(index.value<QPersistentModelIndex>()));
+}
+
 void ItemMarkerTiler::onIndicesClicked(const ClickInfo& clickInfo)
 {
     QList<QPersistentModelIndex> clickedMarkers;
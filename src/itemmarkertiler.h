@@ -63,6 +63,7 @@ public:
     QVariant bestRepresentativeIndexFromList(const QList<QVariant>& indices, const int sortKey) override;
     QPixmap pixmapFromRepresentativeIndex(const QVariant& index, const QSize& size) override;
     bool indicesEqual(const QVariant& a, const QVariant& b) const override;
+    uint indexHash(const QVariant& index) const override;
     GroupState getTileGroupState(const TileIndex& tileIndex) override;
     GroupState getGlobalGroupState() override;
 
@@ -73,6 +74,7 @@ public:
     void setMarkerModelHelper(ModelHelper* const modelHelper);
     void removeMarkerIndexFromGrid(const QModelIndex& markerIndex, const bool ignoreSelection = false);
     void addMarkerIndexToGrid(const QPersistentModelIndex& markerIndex);
+    QList<QPersistentModelIndex> getTileMarkerIndices(const TileIndex& tileIndex);
 
     void setActive(const bool state) override;
 
@@ -88,7 +90,7 @@ private Q_SLOTS:
 
 private:
 
-    QList<QPersistentModelIndex> getTileMarkerIndices(const TileIndex& tileIndex);
+    void addMarkerIndexToGrid(const QPersistentModelIndex& markerIndex, const TileIndex& tileIndex);
 
 private:
 
@@ -31,9 +31,14 @@
 #include <valgrind/valgrind.h>
 #endif
 
+// C++ includes
+
+#include <cmath>
+
 // Qt includes
 
 #include <QStandardPaths>
+#include <QtMath>
 #include <QUrl>
 
 // local includes
@@ -296,6 +301,42 @@ GeoCoordinates::PairList KGeoMapHelperNormalizeBounds(const GeoCoordinates::Pair
     return boundsList;
 }
 
+/**
+ * @brief Projects coordinates to pixel coordinates of a spherical Mercator world map
+ *
+ * The world map is 256*2^zoom pixels wide and high, like the tiles of OpenStreetMap and
+ * Google Maps. Its upper left corner is at 180 degrees west and 85.0511 degrees north.
+ */
+QPointF KGeoMapHelperMercatorProject(const GeoCoordinates& coordinates, const qreal zoom)
+{
+    const qreal maxLatitude = 85.0511287798;
+    const qreal worldSize   = 256.0 * qPow(2.0, zoom);
+    const qreal latitude    = qDegreesToRadians(qBound(-maxLatitude, coordinates.lat(), maxLatitude));
+
+    const qreal x = (coordinates.lon() + 180.0) / 360.0 * worldSize;
+    const qreal y = (1.0 - qLn(qTan(latitude) + 1.0 / qCos(latitude)) / M_PI) / 2.0 * worldSize;
+
+    return QPointF(x, y);
+}
+
+/**
+ * @brief Inverse of KGeoMapHelperMercatorProject, the longitude is wrapped to [-180, 180)
+ */
+GeoCoordinates KGeoMapHelperMercatorUnproject(const QPointF& worldPoint, const qreal zoom)
+{
+    const qreal worldSize = 256.0 * qPow(2.0, zoom);
+    const qreal n         = M_PI * (1.0 - 2.0 * worldPoint.y() / worldSize);
+    const qreal latitude  = qRadiansToDegrees(qAtan(0.5 * (qExp(n) - qExp(-n))));
+    qreal longitude       = std::fmod(worldPoint.x() / worldSize * 360.0, 360.0);
+
+    if (longitude < 0.0)
+    {
+        longitude += 360.0;
+    }
+
+    return GeoCoordinates(latitude, longitude - 180.0);
+}
+
 void KGeoMapGlobalObject::removeMyInternalWidgetFromPool(const MapBackend* const mapBackend)
 {
     for (int i = 0; i < d->internalMapWidgetsPool.count(); ++i)
@@ -32,6 +32,7 @@
 // Qt includes
 
 #include <QtCore/QPoint>
+#include <QtCore/QPointF>
 #include <QtCore/QPointer>
 #include <QtCore/QSharedData>
 #include <QtCore/QSize>
@@ -184,6 +185,7 @@ public:
 const int KGeoMapMinMarkerGroupingRadius    = 1;
 const int KGeoMapMinThumbnailGroupingRadius = 15;
 const int KGeoMapMinThumbnailSize           = KGeoMapMinThumbnailGroupingRadius * 2;
+const int KGeoMapDefaultSnapRadius          = 10;
 
 /**
  * @brief Helper function, returns the square of the distance between two points
@@ -213,6 +215,7 @@ public:
           thumbnailSize(KGeoMapMinThumbnailSize),
           thumbnailGroupingRadius(KGeoMapMinThumbnailGroupingRadius),
           markerGroupingRadius(KGeoMapMinMarkerGroupingRadius),
+          snapRadius(KGeoMapDefaultSnapRadius),
           previewSingleItems(true),
           previewGroupedItems(true),
           showNumbersOnItems(true),
@@ -251,6 +254,7 @@ public:
     int                       thumbnailSize;
     int                       thumbnailGroupingRadius;
     int                       markerGroupingRadius;
+    int                       snapRadius;
     bool                      previewSingleItems;
     bool                      previewGroupedItems;
     bool                      showNumbersOnItems;
@@ -275,6 +279,8 @@ bool KGeoMapHelperParseLatLonString(const QString& latLonString, GeoCoordinates*
 bool KGeoMapHelperParseXYStringToPoint(const QString& xyString, QPoint* const point);
 bool KGeoMapHelperParseBoundsString(const QString& boundsString, QPair<GeoCoordinates, GeoCoordinates>* const boundsCoordinates);
 GeoCoordinates::PairList KGeoMapHelperNormalizeBounds(const GeoCoordinates::Pair& boundsPair);
+QPointF KGeoMapHelperMercatorProject(const GeoCoordinates& coordinates, const qreal zoom);
+GeoCoordinates KGeoMapHelperMercatorUnproject(const QPointF& worldPoint, const qreal zoom);
 
 void KGeoMap_assert(const char* const condition, const char* const filename, const int lineNumber);
 
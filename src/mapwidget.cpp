@@ -70,9 +70,12 @@
 #include "libkgeomap_version.h"
 #include "libkgeomap_debug.h"
 #include "abstractmarkertiler.h"
+#include "circlemarkeratlas.h"
+#include "clusterpixmapcache.h"
+#include "thumbnailrequestqueue.h"
 #include "backendgooglemaps.h"
 #include "backendmarble.h"
-// #include "backend_map_osm.h"
+#include "backendosm.h"
 
 namespace KGeoMap
 {
@@ -154,7 +157,10 @@ public:
         visibleExtraActions(nullptr),
         actionStickyMode(nullptr),
         buttonStickyMode(nullptr),
-        placeholderWidget(nullptr)
+        placeholderWidget(nullptr),
+        clusterPixmapCache(),
+        circleMarkerAtlas(),
+        thumbnailQueue(nullptr)
     {
     }
 
@@ -217,6 +223,10 @@ public:
 
     // to be sorted later
     PlaceholderWidget*      placeholderWidget;
+
+    ClusterPixmapCache      clusterPixmapCache;
+    CircleMarkerAtlas       circleMarkerAtlas;
+    ThumbnailRequestQueue*  thumbnailQueue;
 };
 
 MapWidget::MapWidget(QWidget* const parent)
@@ -229,6 +239,11 @@ MapWidget::MapWidget(QWidget* const parent)
     s->worldMapWidget = this;
     s->tileGrouper    = new TileGrouper(s, this);
 
+    d->thumbnailQueue = new ThumbnailRequestQueue(this);
+
+    connect(d->thumbnailQueue, &ThumbnailRequestQueue::signalThumbnailsAvailable,
+            this, &MapWidget::slotThumbnailsAvailable);
+
     d->stackedLayout  = new QStackedLayout(this);
     setLayout(d->stackedLayout);
 
@@ -237,7 +252,7 @@ MapWidget::MapWidget(QWidget* const parent)
 
     d->loadedBackends.append(new BackendGoogleMaps(s, this));
     d->loadedBackends.append(new BackendMarble(s, this));
-//     d->loadedBackends.append(new BackendOSM(s, this));
+    d->loadedBackends.append(new BackendOSM(s, this));
     createActionsForBackendSelection();
 
     setAcceptDrops(true);
@@ -435,15 +450,12 @@ bool MapWidget::setBackend(const QString& backendName)
         disconnect(this, SIGNAL(signalUngroupedModelChanged(int)),
                    d->currentBackend, SLOT(slotUngroupedModelChanged(int)));
 
-        if (s->markerModel)
-        {
-            disconnect(s->markerModel, SIGNAL(signalThumbnailAvailableForIndex(QVariant,QPixmap)),
-                       d->currentBackend, SLOT(slotThumbnailAvailableForIndex(QVariant,QPixmap)));
-        }
-
         disconnect(d->currentBackend, SIGNAL(signalSelectionHasBeenMade(KGeoMap::GeoCoordinates::Pair)),
                    this, SLOT(slotNewSelectionFromMap(KGeoMap::GeoCoordinates::Pair)));
 
+        disconnect(d->currentBackend, SIGNAL(signalTrackUploadProgress(int,int)),
+                   this, SIGNAL(signalTrackUploadProgress(int,int)));
+
     }
 
     MapBackend* backend = nullptr;
@@ -471,14 +483,10 @@ bool MapWidget::setBackend(const QString& backendName)
             connect(this, SIGNAL(signalUngroupedModelChanged(int)),
                     d->currentBackend, SLOT(slotUngroupedModelChanged(int)), Qt::QueuedConnection);
 
-            if (s->markerModel)
-            {
-                connect(s->markerModel, SIGNAL(signalThumbnailAvailableForIndex(QVariant,QPixmap)),
-                        d->currentBackend, SLOT(slotThumbnailAvailableForIndex(QVariant,QPixmap)));
-            }
-
             connect(d->currentBackend, &MapBackend::signalSelectionHasBeenMade, this, &MapWidget::slotNewSelectionFromMap);
 
+            connect(d->currentBackend, &MapBackend::signalTrackUploadProgress, this, &MapWidget::signalTrackUploadProgress);
+
             if (s->activeState)
             {
                 setMapWidgetInFrame(d->currentBackend->mapWidget());
@@ -616,6 +624,7 @@ void MapWidget::saveSettingsToGroup(KConfigGroup* const group)
     group->writeEntry("Thumbnail Size",            s->thumbnailSize);
     group->writeEntry("Thumbnail Grouping Radius", s->thumbnailGroupingRadius);
     group->writeEntry("Marker Grouping Radius",    s->markerGroupingRadius);
+    group->writeEntry("Snap Radius",               s->snapRadius);
     group->writeEntry("Show Thumbnails",           s->showThumbnails);
     group->writeEntry("Mouse Mode",                int(s->currentMouseMode));
 
@@ -649,6 +658,7 @@ void MapWidget::readSettingsFromGroup(const KConfigGroup* const group)
     setThumnailSize(group->readEntry("Thumbnail Size",                       2*KGeoMapMinThumbnailSize));
     setThumbnailGroupingRadius(group->readEntry("Thumbnail Grouping Radius", 2*KGeoMapMinThumbnailGroupingRadius));
     setMarkerGroupingRadius(group->readEntry("Edit Grouping Radius",         KGeoMapMinMarkerGroupingRadius));
+    setSnapRadius(group->readEntry("Snap Radius",                            KGeoMapDefaultSnapRadius));
     s->showThumbnails = group->readEntry("Show Thumbnails",                  s->showThumbnails);
     d->actionShowThumbnails->setChecked(s->showThumbnails);
     d->actionStickyMode->setChecked(group->readEntry("Sticky Mode State",    d->actionStickyMode->isChecked()));
@@ -963,6 +973,15 @@ void MapWidget::updateClusters()
 {
     /// @todo Find a better way to tell the TileGrouper about the backend
     s->tileGrouper->setCurrentBackend(d->currentBackend);
+
+    if (s->tileGrouper->getClustersDirty())
+    {
+        // The map was moved or zoomed, the new clusters request their thumbnails again. This has
+        // to happen before the backend is told about them, because the HTML backends request the
+        // thumbnails of the changed clusters right away and do not request them a second time.
+        d->thumbnailQueue->cancelPending();
+    }
+
     s->tileGrouper->updateClusters();
 }
 
@@ -1248,6 +1267,9 @@ void MapWidget::addUngroupedModel(ModelHelper* const modelHelper)
 {
     s->ungroupedModels << modelHelper;
 
+    // the backends read the coordinates of ungrouped items on every repaint
+    modelHelper->setCoordinateCacheEnabled(true);
+
     /// @todo monitor all model signals!
     connect(modelHelper->model(), SIGNAL(dataChanged(QModelIndex,QModelIndex)),
             this, SLOT(slotUngroupedModelChanged()));
@@ -1313,6 +1335,8 @@ void MapWidget::removeUngroupedModel(ModelHelper* const modelHelper)
 void MapWidget::setGroupedModel(AbstractMarkerTiler* const markerModel)
 {
     s->markerModel = markerModel;
+    d->clusterPixmapCache.clear();
+    d->thumbnailQueue->setMarkerModel(markerModel);
 
     if (s->markerModel)
     {
@@ -1322,11 +1346,9 @@ void MapWidget::setGroupedModel(AbstractMarkerTiler* const markerModel)
         connect(s->markerModel, SIGNAL(signalTilesOrSelectionChanged()),
                 this, SLOT(slotRequestLazyReclustering()));
 
-        if (d->currentBackend)
-        {
-            connect(s->markerModel, SIGNAL(signalThumbnailAvailableForIndex(QVariant,QPixmap)),
-                    d->currentBackend, SLOT(slotThumbnailAvailableForIndex(QVariant,QPixmap)));
-        }
+        // thumbnails which are loaded in the background are passed on to the backends once per frame
+        connect(s->markerModel, SIGNAL(signalThumbnailAvailableForIndex(QVariant,QPixmap)),
+                d->thumbnailQueue, SLOT(slotThumbnailAvailableForIndex(QVariant,QPixmap)));
     }
 
     slotRequestLazyReclustering();
@@ -1550,6 +1572,23 @@ void MapWidget::dragLeaveEvent(QDragLeaveEvent* event)
 //     d->currentBackend->updateDragDropMarker(QPoint(), 0);
 }
 
+/**
+ * @brief Renders the cluster labels again when the font changed
+ */
+void MapWidget::changeEvent(QEvent* event)
+{
+    if ((event->type() == QEvent::FontChange) || (event->type() == QEvent::ApplicationFontChange))
+    {
+        // the cached pixmaps contain glyphs of the old font
+        d->circleMarkerAtlas.clear();
+        d->clusterPixmapCache.clear();
+
+        slotRequestLazyReclustering();
+    }
+
+    QWidget::changeEvent(event);
+}
+
 void MapWidget::markClustersAsDirty()
 {
     s->tileGrouper->setClustersDirty();
@@ -1687,7 +1726,48 @@ QPixmap MapWidget::getDecoratedPixmapForCluster(const int clusterId, const Group
     {
         const QVariant representativeMarker = getClusterRepresentativeMarker(clusterId, s->sortKey);
         const int undecoratedThumbnailSize  = getUndecoratedThumbnailSize();
-        QPixmap clusterPixmap               = s->markerModel->pixmapFromRepresentativeIndex(representativeMarker, QSize(undecoratedThumbnailSize, undecoratedThumbnailSize));
+
+        const GroupState globalState = s->markerModel->getGlobalGroupState();
+
+        /// @todo What about partially in the region or positively filtered?
+        const bool clusterIsNotInRegionSelection  = (globalState & RegionSelectedMask) &&
+                                                    ((groupState & RegionSelectedMask) == RegionSelectedNone);
+        const bool clusterIsNotPositivelyFiltered = (globalState & FilteredPositiveMask) &&
+                                                    ((groupState & FilteredPositiveMask) == FilteredPositiveNone);
+
+        const bool shouldGrayOut                  = clusterIsNotInRegionSelection || clusterIsNotPositivelyFiltered;
+        const bool shouldCrossOut                 = clusterIsNotInRegionSelection;
+
+        // the same thumbnail is usually drawn with the same decoration on every repaint:
+        const ClusterPixmapCache::Key pixmapKey(s->markerModel, representativeMarker, undecoratedThumbnailSize,
+                                                groupState, s->showNumbersOnItems ? labelText : QString(),
+                                                strokeColor, strokeStyle, shouldGrayOut, shouldCrossOut);
+        QPixmap cachedPixmap;
+
+        if (d->clusterPixmapCache.find(pixmapKey, &cachedPixmap))
+        {
+            // update the display information stored in the cluster:
+            cluster.pixmapType   = KGeoMapCluster::PixmapImage;
+            cluster.pixmapOffset = QPoint(cachedPixmap.width()/2, cachedPixmap.height()/2);
+            cluster.pixmapSize   = cachedPixmap.size();
+
+            if (centerPoint)
+            {
+                *centerPoint = cluster.pixmapOffset;
+            }
+
+            return cachedPixmap;
+        }
+
+        QPixmap clusterPixmap;
+
+        if (!d->thumbnailQueue->thumbnail(representativeMarker, &clusterPixmap))
+        {
+            // larger clusters get their thumbnails first, draw a circle until it arrives
+            d->thumbnailQueue->request(representativeMarker,
+                                       QSize(undecoratedThumbnailSize, undecoratedThumbnailSize),
+                                       markerCount);
+        }
 
         if (!clusterPixmap.isNull())
         {
@@ -1704,21 +1784,8 @@ QPixmap MapWidget::getDecoratedPixmapForCluster(const int clusterId, const Group
             borderPen.setWidth(borderWidth);
             borderPen.setJoinStyle(Qt::MiterJoin);
 
-            GroupState globalState = s->markerModel->getGlobalGroupState();
-
-            /// @todo What about partially in the region or positively filtered?
-            const bool clusterIsNotInRegionSelection  = (globalState & RegionSelectedMask) &&
-                                                        ((groupState & RegionSelectedMask) == RegionSelectedNone);
-            const bool clusterIsNotPositivelyFiltered = (globalState & FilteredPositiveMask) &&
-                                                        ((groupState & FilteredPositiveMask) == FilteredPositiveNone);
-
-            const bool shouldGrayOut                  = clusterIsNotInRegionSelection || clusterIsNotPositivelyFiltered;
-            const bool shouldCrossOut                 = clusterIsNotInRegionSelection;
-
             if (shouldGrayOut)
             {
-                /// @todo Cache the alphaPixmap!
-
                 QPixmap alphaPixmap(clusterPixmap.size());
                 alphaPixmap.fill(QColor::fromRgb(0x80, 0x80, 0x80));
 
@@ -1793,6 +1860,9 @@ QPixmap MapWidget::getDecoratedPixmapForCluster(const int clusterId, const Group
                 painter.drawText(textRect, Qt::AlignHCenter|Qt::AlignVCenter, labelText);
             }
 
+            painter.end();
+            d->clusterPixmapCache.insert(pixmapKey, resultPixmap);
+
             // update the display information stored in the cluster:
             cluster.pixmapType   = KGeoMapCluster::PixmapImage;
             cluster.pixmapOffset = QPoint(resultPixmap.width()/2, resultPixmap.height()/2);
@@ -1808,29 +1878,9 @@ QPixmap MapWidget::getDecoratedPixmapForCluster(const int clusterId, const Group
     }
 
     // we do not have a thumbnail, draw the circle instead:
-    const int circleRadius = s->thumbnailSize/2;
-    QPen circlePen;
-    circlePen.setColor(strokeColor);
-    circlePen.setStyle(strokeStyle);
-    circlePen.setWidth(2);
-    QBrush circleBrush(fillColor);
-    QPen labelPen;
-    labelPen.setColor(labelColor);
-    const QRect circleRect(0, 0, 2*circleRadius, 2*circleRadius);
-
-    const int pixmapDiameter = 2*(circleRadius+1);
-    QPixmap circlePixmap(pixmapDiameter, pixmapDiameter);
-    /// @todo cache this somehow
-    circlePixmap.fill(QColor(0,0,0,0));
-
-    QPainter circlePainter(&circlePixmap);
-    circlePainter.setPen(circlePen);
-    circlePainter.setBrush(circleBrush);
-    circlePainter.drawEllipse(circleRect);
-
-    circlePainter.setPen(labelPen);
-    circlePainter.setBrush(Qt::NoBrush);
-    circlePainter.drawText(circleRect, Qt::AlignHCenter|Qt::AlignVCenter, labelText);
+    const int circleRadius     = s->thumbnailSize/2;
+    const QPixmap circlePixmap = d->circleMarkerAtlas.circlePixmap(circleRadius, fillColor, strokeColor,
+                                                                   strokeStyle, labelText, labelColor);
 
     // update the display information stored in the cluster:
     cluster.pixmapType = KGeoMapCluster::PixmapCircle;
@@ -1845,10 +1895,32 @@ QPixmap MapWidget::getDecoratedPixmapForCluster(const int clusterId, const Group
     return circlePixmap;
 }
 
+/**
+ * @brief Passes the thumbnails which became available during one frame on to the backend
+ */
+void MapWidget::slotThumbnailsAvailable(const QVariantList& indices, const QList<QPixmap>& pixmaps)
+{
+    // the decorated pixmaps of these markers have to be drawn again
+    for (int i = 0; i < indices.count(); ++i)
+    {
+        d->clusterPixmapCache.removeIndex(s->markerModel, indices.at(i));
+    }
+
+    if (!currentBackendReady())
+    {
+        return;
+    }
+
+    d->currentBackend->slotThumbnailsAvailable(indices, pixmaps);
+}
+
 void MapWidget::setThumnailSize(const int newThumbnailSize)
 {
     s->thumbnailSize = qMax(KGeoMapMinThumbnailSize, newThumbnailSize);
 
+    // the stored thumbnails have the old size
+    d->thumbnailQueue->clear();
+
     // make sure the grouping radius is larger than the thumbnail size
     if (2*s->thumbnailGroupingRadius < newThumbnailSize)
     {
@@ -1872,6 +1944,7 @@ void MapWidget::setThumbnailGroupingRadius(const int newGroupingRadius)
     if (2*s->thumbnailGroupingRadius < s->thumbnailSize)
     {
         s->thumbnailSize = 2*newGroupingRadius;
+        d->thumbnailQueue->clear();
     }
 
     if (s->showThumbnails)
@@ -1894,6 +1967,21 @@ void MapWidget::setMarkerGroupingRadius(const int newGroupingRadius)
     slotUpdateActionsEnabled();
 }
 
+/**
+ * @brief Sets the distance in pixels up to which moved markers snap to the markers of snapping models
+ *
+ * A radius of zero disables snapping.
+ */
+void MapWidget::setSnapRadius(const int newSnapRadius)
+{
+    s->snapRadius = qMax(0, newSnapRadius);
+}
+
+int MapWidget::getSnapRadius() const
+{
+    return s->snapRadius;
+}
+
 void MapWidget::slotDecreaseThumbnailSize()
 {
     if (!s->showThumbnails)
@@ -2172,7 +2260,7 @@ void MapWidget::adjustBoundariesToGroupedMarkers(const bool useSaneZoomLevel)
     Marble::GeoDataLineString tileString;
 
     /// @todo not sure that this is the best way to find the bounding box of all items
-    for (AbstractMarkerTiler::NonEmptyIterator tileIterator(s->markerModel, TileIndex::MaxLevel); !tileIterator.atEnd(); tileIterator.nextIndex())
+    for (AbstractMarkerTiler::NonEmptyIterator tileIterator(s->markerModel, s->markerModel->maxLevel()); !tileIterator.atEnd(); tileIterator.nextIndex())
     {
         const TileIndex tileIndex = tileIterator.currentIndex();
 
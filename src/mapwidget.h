@@ -116,6 +116,8 @@ public:
     void setThumnailSize(const int newThumbnailSize);
     void setThumbnailGroupingRadius(const int newGroupingRadius);
     void setMarkerGroupingRadius(const int newGroupingRadius);
+    void setSnapRadius(const int newSnapRadius);
+    int  getSnapRadius() const;
     int  getThumbnailSize() const;
     int  getUndecoratedThumbnailSize() const;
     void setShowThumbnails(const bool state);
@@ -178,6 +180,14 @@ Q_SIGNALS:
     void signalStickyModeChanged();
     void signalMouseModeChanged(const KGeoMap::MouseModes& currentMouseMode);
 
+    /**
+     * @brief Reports how many points of the tracks have been passed to the map so far
+     *
+     * Backends which draw the tracks in a separate page transfer them in portions. Once
+     * @c uploadedPoints equals @c totalPoints, all tracks are shown.
+     */
+    void signalTrackUploadProgress(const int uploadedPoints, const int totalPoints);
+
 public:
 
     /** Return a string version of LibMarbleWidget release in format "major.minor.patch"
@@ -198,6 +208,7 @@ protected:
     void dragMoveEvent(QDragMoveEvent* event) override;
     void dragEnterEvent(QDragEnterEvent* event) override;
     void dragLeaveEvent(QDragLeaveEvent* event) override;
+    void changeEvent(QEvent* event) override;
     void createActions();
     void createActionsForBackendSelection();
     void setShowPlaceholderWidget(const bool state);
@@ -217,6 +228,7 @@ protected Q_SLOTS:
     void slotItemDisplaySettingsChanged();
     void slotUngroupedModelChanged();
     void slotNewSelectionFromMap(const KGeoMap::GeoCoordinates::Pair& sel);
+    void slotThumbnailsAvailable(const QVariantList& indices, const QList<QPixmap>& pixmaps);
 
     /// @name Mouse modes
     //@{
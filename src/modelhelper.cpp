@@ -26,6 +26,11 @@
 
 #include "modelhelper.h"
 
+// Qt includes
+
+#include <QtNumeric>
+#include <QVector>
+
 namespace KGeoMap
 {
 
@@ -51,15 +56,38 @@ namespace KGeoMap
  * For grouped models which are accessed by @c MarkerModel, the following functions should be implemented:
  * @li bestRepresentativeIndexFromList(): Find the item that should represent a group of items.
  * @li pixmapFromRepresentativeIndex(): Find a thumbnail for an item.
+ *
+ * Models which store their coordinates in arrays anyway can reimplement itemCoordinatesBulk() to
+ * fill the columnar coordinate cache without going through itemCoordinates() for each item.
  */
 
+class Q_DECL_HIDDEN ModelHelper::Private
+{
+public:
+
+    Private()
+      : cacheEnabled(false),
+        cacheDirty(true),
+        latitudes(),
+        longitudes()
+    {
+    }
+
+    bool           cacheEnabled;
+    bool           cacheDirty;
+    QVector<qreal> latitudes;
+    QVector<qreal> longitudes;
+};
+
 ModelHelper::ModelHelper(QObject* const parent)
-    : QObject(parent)
+    : QObject(parent),
+      d(new Private())
 {
 }
 
 ModelHelper::~ModelHelper()
 {
+    delete d;
 }
 
 void ModelHelper::snapItemsTo(const QModelIndex& targetIndex, const QList<QPersistentModelIndex>& snappedIndices)
@@ -141,4 +169,248 @@ void ModelHelper::onIndicesMoved(const QList<QPersistentModelIndex>& movedIndice
     Q_UNUSED(targetSnapIndex);
 }
 
+/**
+ * @brief Returns the coordinates of the top level items in the rows firstRow..firstRow+rowCount-1.
+ *
+ * The default implementation calls itemCoordinates() for each item. Items without coordinates
+ * get NaN as latitude and longitude.
+ *
+ * @param firstRow First row to read.
+ * @param rowCount Number of rows to read.
+ * @param latitudes Array of at least @p rowCount entries which receives the latitudes.
+ * @param longitudes Array of at least @p rowCount entries which receives the longitudes.
+ */
+void ModelHelper::itemCoordinatesBulk(const int firstRow, const int rowCount,
+                                      qreal* const latitudes, qreal* const longitudes) const
+{
+    QAbstractItemModel* const itemModel = model();
+
+    for (int i = 0; i < rowCount; ++i)
+    {
+        GeoCoordinates coordinates;
+
+        if (itemModel && itemCoordinates(itemModel->index(firstRow + i, 0), &coordinates) && coordinates.hasCoordinates())
+        {
+            latitudes[i]  = coordinates.lat();
+            longitudes[i] = coordinates.lon();
+        }
+        else
+        {
+            latitudes[i]  = qQNaN();
+            longitudes[i] = qQNaN();
+        }
+    }
+}
+
+/**
+ * @brief Enables the columnar cache of the coordinates of the top level items.
+ *
+ * While enabled, the latitudes and longitudes of all top level items are kept in flat arrays
+ * which are updated when rows are inserted, removed or changed in the model. Layout changes,
+ * resets and signalModelChangedDrastically() cause the cache to be rebuilt when it is accessed
+ * the next time.
+ *
+ * The cache has to be enabled before other objects connect to the row signals of the model
+ * if they want to read the cache from within their slots.
+ */
+void ModelHelper::setCoordinateCacheEnabled(const bool state)
+{
+    QAbstractItemModel* const itemModel = model();
+
+    if ( (state == d->cacheEnabled) || !itemModel )
+    {
+        return;
+    }
+
+    d->cacheEnabled = state;
+    invalidateCoordinateCache();
+
+    if (state)
+    {
+        connect(itemModel, &QAbstractItemModel::rowsInserted, this, &ModelHelper::slotCoordinateCacheRowsInserted);
+
+        connect(itemModel, &QAbstractItemModel::rowsRemoved, this, &ModelHelper::slotCoordinateCacheRowsRemoved);
+
+        connect(itemModel, &QAbstractItemModel::dataChanged, this, &ModelHelper::slotCoordinateCacheDataChanged);
+
+        connect(itemModel, &QAbstractItemModel::modelReset, this, &ModelHelper::invalidateCoordinateCache);
+
+        connect(itemModel, &QAbstractItemModel::layoutChanged, this, &ModelHelper::invalidateCoordinateCache);
+
+        connect(itemModel, &QAbstractItemModel::rowsMoved, this, &ModelHelper::invalidateCoordinateCache);
+
+        connect(this, &ModelHelper::signalModelChangedDrastically, this, &ModelHelper::invalidateCoordinateCache);
+    }
+    else
+    {
+        disconnect(itemModel, &QAbstractItemModel::rowsInserted, this, &ModelHelper::slotCoordinateCacheRowsInserted);
+
+        disconnect(itemModel, &QAbstractItemModel::rowsRemoved, this, &ModelHelper::slotCoordinateCacheRowsRemoved);
+
+        disconnect(itemModel, &QAbstractItemModel::dataChanged, this, &ModelHelper::slotCoordinateCacheDataChanged);
+
+        disconnect(itemModel, &QAbstractItemModel::modelReset, this, &ModelHelper::invalidateCoordinateCache);
+
+        disconnect(itemModel, &QAbstractItemModel::layoutChanged, this, &ModelHelper::invalidateCoordinateCache);
+
+        disconnect(itemModel, &QAbstractItemModel::rowsMoved, this, &ModelHelper::invalidateCoordinateCache);
+
+        disconnect(this, &ModelHelper::signalModelChangedDrastically, this, &ModelHelper::invalidateCoordinateCache);
+    }
+}
+
+bool ModelHelper::coordinateCacheEnabled() const
+{
+    return d->cacheEnabled;
+}
+
+/**
+ * @brief Drops the cached coordinates, they are read again when the cache is accessed the next time
+ */
+void ModelHelper::invalidateCoordinateCache()
+{
+    d->cacheDirty = true;
+    d->latitudes.clear();
+    d->longitudes.clear();
+}
+
+void ModelHelper::updateCoordinateCache() const
+{
+    if ( (!d->cacheEnabled) || (!d->cacheDirty) )
+    {
+        return;
+    }
+
+    QAbstractItemModel* const itemModel = model();
+    const int rowCount                  = itemModel ? itemModel->rowCount() : 0;
+
+    d->latitudes.resize(rowCount);
+    d->longitudes.resize(rowCount);
+    itemCoordinatesBulk(0, rowCount, d->latitudes.data(), d->longitudes.data());
+
+    d->cacheDirty = false;
+}
+
+/**
+ * @brief Returns the number of rows in the coordinate cache, or 0 if the cache is not enabled
+ */
+int ModelHelper::cachedRowCount() const
+{
+    updateCoordinateCache();
+
+    return d->latitudes.count();
+}
+
+/**
+ * @brief Returns the cached latitudes of the top level items, indexed by row. Items without
+ *        coordinates have NaN as latitude. The pointer is only valid until the model changes.
+ */
+const qreal* ModelHelper::cachedLatitudes() const
+{
+    updateCoordinateCache();
+
+    return d->latitudes.constData();
+}
+
+/**
+ * @brief Returns the cached longitudes of the top level items, indexed by row
+ */
+const qreal* ModelHelper::cachedLongitudes() const
+{
+    updateCoordinateCache();
+
+    return d->longitudes.constData();
+}
+
+/**
+ * @brief Same as itemCoordinates(), but reads top level items from the coordinate cache if it is enabled.
+ *
+ * Note that the cache does not contain altitudes.
+ */
+bool ModelHelper::cachedItemCoordinates(const QModelIndex& index, GeoCoordinates* const coordinates) const
+{
+    if ( d->cacheEnabled && (index.model() == model()) && !index.parent().isValid() )
+    {
+        updateCoordinateCache();
+
+        const int row = index.row();
+
+        if ( (row >= 0) && (row < d->latitudes.count()) )
+        {
+            const qreal lat = d->latitudes.at(row);
+            const qreal lon = d->longitudes.at(row);
+
+            if (qIsNaN(lat) || qIsNaN(lon))
+            {
+                return false;
+            }
+
+            if (coordinates)
+            {
+                *coordinates = GeoCoordinates(lat, lon);
+            }
+
+            return true;
+        }
+    }
+
+    return itemCoordinates(index, coordinates);
+}
+
+void ModelHelper::slotCoordinateCacheRowsInserted(const QModelIndex& parentIndex, int start, int end)
+{
+    if (parentIndex.isValid() || d->cacheDirty)
+    {
+        return;
+    }
+
+    if (start > d->latitudes.count())
+    {
+        // we are out of sync, read everything again later
+        invalidateCoordinateCache();
+        return;
+    }
+
+    const int count = end - start + 1;
+    d->latitudes.insert(start, count, qQNaN());
+    d->longitudes.insert(start, count, qQNaN());
+    itemCoordinatesBulk(start, count, d->latitudes.data() + start, d->longitudes.data() + start);
+}
+
+void ModelHelper::slotCoordinateCacheRowsRemoved(const QModelIndex& parentIndex, int start, int end)
+{
+    if (parentIndex.isValid() || d->cacheDirty)
+    {
+        return;
+    }
+
+    if (end >= d->latitudes.count())
+    {
+        invalidateCoordinateCache();
+        return;
+    }
+
+    const int count = end - start + 1;
+    d->latitudes.remove(start, count);
+    d->longitudes.remove(start, count);
+}
+
+void ModelHelper::slotCoordinateCacheDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight)
+{
+    if (topLeft.parent().isValid() || d->cacheDirty)
+    {
+        return;
+    }
+
+    const int start = qMax(0, topLeft.row());
+    const int end   = qMin(bottomRight.row(), d->latitudes.count() - 1);
+
+    if (end < start)
+    {
+        return;
+    }
+
+    itemCoordinatesBulk(start, end - start + 1, d->latitudes.data() + start, d->longitudes.data() + start);
+}
+
 } /* namespace KGeoMap */
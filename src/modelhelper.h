@@ -87,11 +87,39 @@ public:
     virtual void onIndicesClicked(const QList<QPersistentModelIndex>& clickedIndices);
     virtual void onIndicesMoved(const QList<QPersistentModelIndex>& movedIndices, const GeoCoordinates& targetCoordinates, const QPersistentModelIndex& targetSnapIndex);
 
+    // bulk access to the coordinates of the top level items, can be reimplemented for speed
+    virtual void itemCoordinatesBulk(const int firstRow, const int rowCount,
+                                     qreal* const latitudes, qreal* const longitudes) const;
+
+    // columnar cache of the coordinates of the top level items
+    void setCoordinateCacheEnabled(const bool state);
+    bool coordinateCacheEnabled() const;
+    void invalidateCoordinateCache();
+    int cachedRowCount() const;
+    const qreal* cachedLatitudes() const;
+    const qreal* cachedLongitudes() const;
+    bool cachedItemCoordinates(const QModelIndex& index, GeoCoordinates* const coordinates) const;
+
 Q_SIGNALS:
 
     void signalVisibilityChanged();
     void signalThumbnailAvailableForIndex(const QPersistentModelIndex& index, const QPixmap& pixmap);
     void signalModelChangedDrastically();
+
+private Q_SLOTS:
+
+    void slotCoordinateCacheRowsInserted(const QModelIndex& parentIndex, int start, int end);
+    void slotCoordinateCacheRowsRemoved(const QModelIndex& parentIndex, int start, int end);
+    void slotCoordinateCacheDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight);
+
+private:
+
+    void updateCoordinateCache() const;
+
+private:
+
+    class Private;
+    Private* const d;
 };
 
 } // namespace KGeoMap
@@ -0,0 +1,667 @@
+/** ===========================================================
+ * @file
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-02
+ * @brief  A marker tiler for read-only data sets stored in a precomputed tile file
+ *
+ * @author Copyright (C) 2009-2011 by Michael G. Hansen
+ *         <a href="mailto:mike at mghansen dot de">mike at mghansen dot de</a>
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "staticmarkertiler.h"
+
+// C++ includes
+
+#include <algorithm>
+#include <cstring>
+
+// Qt includes
+
+#include <QDataStream>
+#include <QFile>
+#include <QPixmap>
+#include <QSaveFile>
+#include <QtEndian>
+#include <QtNumeric>
+
+// KDE includes
+
+#include <klocalizedstring.h>
+
+// local includes
+
+#include "libkgeomap_debug.h"
+#include "kgeomap_common.h"
+
+namespace KGeoMap
+{
+
+/**
+ * Layout of a tile file, all values are stored in little endian byte order:
+ *
+ * Header:
+ * @li char[8]: magic string "KGMTILES"
+ * @li quint32: format version
+ * @li quint32: number of levels
+ * @li quint64: number of markers
+ * @li quint32: representative marker of the root tile
+ * @li quint32: reserved
+ * @li for each level: quint64 offset of the first entry, quint64 number of entries
+ *
+ * Entries of a level, sorted by latitude key and then by longitude key:
+ * @li quint64: latitude key
+ * @li quint64: longitude key
+ * @li quint32: number of markers in the tile
+ * @li quint32: representative marker of the tile
+ *
+ * The latitude key of a tile on level l is the number formed by the latitude indices
+ * of the levels 0..l in base TileIndex::Tiling, the longitude key is formed likewise.
+ */
+namespace
+{
+
+const char    TileFileMagic[8]      = { 'K', 'G', 'M', 'T', 'I', 'L', 'E', 'S' };
+const quint32 TileFileVersion       = 1;
+const qint64  TileFileHeaderSize    = 32;
+const qint64  TileFileLevelInfoSize = 16;
+const qint64  TileFileEntrySize     = 24;
+
+class TileFileEntry
+{
+public:
+
+    quint64 latKey;
+    quint64 lonKey;
+    quint32 count;
+    quint32 representative;
+};
+
+bool tileFileEntryLessThan(const TileFileEntry& a, const TileFileEntry& b)
+{
+    return (a.latKey < b.latKey) || ((a.latKey == b.latKey) && (a.lonKey < b.lonKey));
+}
+
+/**
+ * @brief Sort the entries by their keys and merge entries which describe the same tile
+ */
+void mergeTileFileEntries(QVector<TileFileEntry>* const entries)
+{
+    std::sort(entries->begin(), entries->end(), tileFileEntryLessThan);
+
+    int target = -1;
+
+    for (int i = 0; i < entries->count(); ++i)
+    {
+        const TileFileEntry current = entries->at(i);
+
+        if ( (target >= 0)                                  &&
+             (entries->at(target).latKey == current.latKey) &&
+             (entries->at(target).lonKey == current.lonKey) )
+        {
+            TileFileEntry& targetEntry = (*entries)[target];
+            targetEntry.count         += current.count;
+            targetEntry.representative = qMin(targetEntry.representative, current.representative);
+            continue;
+        }
+
+        ++target;
+        (*entries)[target] = current;
+    }
+
+    entries->resize(target + 1);
+}
+
+} // namespace
+
+// -------------------------------------------------------------------------------------------
+
+class StaticMarkerTiler::MyTile : public Tile
+{
+public:
+
+    MyTile()
+        : Tile(),
+          markerCount(0),
+          representative(0)
+    {
+    }
+
+    /**
+     * Note: MyTile is only deleted by StaticMarkerTiler::tileDeleteInternal.
+     */
+    ~MyTile()
+    {
+    }
+
+public:
+
+    quint32 markerCount;
+    quint32 representative;
+};
+
+// -------------------------------------------------------------------------------------------
+
+class Q_DECL_HIDDEN StaticMarkerTiler::Private
+{
+public:
+
+    class LevelInfo
+    {
+    public:
+
+        const uchar* entries;
+        quint64      entryCount;
+    };
+
+public:
+
+    Private()
+      : file(),
+        data(nullptr),
+        markerCount(0),
+        rootRepresentative(0),
+        levels(),
+        errorString(),
+        activeState(false)
+    {
+    }
+
+    bool findEntry(const TileIndex& tileIndex, quint32* const count, quint32* const representative) const;
+    void unmapFile();
+
+public:
+
+    QFile              file;
+    uchar*             data;
+    quint64            markerCount;
+    quint32            rootRepresentative;
+    QVector<LevelInfo> levels;
+    QString            errorString;
+    bool               activeState;
+};
+
+/**
+ * @brief Binary search for the entry of a tile in the mapped file
+ */
+bool StaticMarkerTiler::Private::findEntry(const TileIndex& tileIndex, quint32* const count,
+                                           quint32* const representative) const
+{
+    if (tileIndex.indexCount() == 0)
+    {
+        *count          = quint32(markerCount);
+        *representative = rootRepresentative;
+
+        return markerCount > 0;
+    }
+
+    if (tileIndex.level() >= levels.count())
+    {
+        return false;
+    }
+
+    quint64 latKey;
+    quint64 lonKey;
+    tileIndex.toLatLonKeys(&latKey, &lonKey);
+
+    const LevelInfo& levelInfo = levels.at(tileIndex.level());
+    quint64 first              = 0;
+    quint64 last               = levelInfo.entryCount;
+
+    while (first < last)
+    {
+        const quint64 middle     = first + (last - first) / 2;
+        const uchar* const entry = levelInfo.entries + middle * TileFileEntrySize;
+        const quint64 entryLat   = qFromLittleEndian<quint64>(entry);
+        const quint64 entryLon   = qFromLittleEndian<quint64>(entry + 8);
+
+        if ( (entryLat < latKey) || ((entryLat == latKey) && (entryLon < lonKey)) )
+        {
+            first = middle + 1;
+        }
+        else if ( (entryLat == latKey) && (entryLon == lonKey) )
+        {
+            *count          = qFromLittleEndian<quint32>(entry + 16);
+            *representative = qFromLittleEndian<quint32>(entry + 20);
+
+            return true;
+        }
+        else
+        {
+            last = middle;
+        }
+    }
+
+    return false;
+}
+
+void StaticMarkerTiler::Private::unmapFile()
+{
+    if (data)
+    {
+        file.unmap(data);
+        data = nullptr;
+    }
+
+    file.close();
+    levels.clear();
+    markerCount        = 0;
+    rootRepresentative = 0;
+}
+
+// -------------------------------------------------------------------------------------------
+
+StaticMarkerTiler::StaticMarkerTiler(QObject* const parent)
+    : AbstractMarkerTiler(parent),
+      d(new Private())
+{
+    resetRootTile();
+}
+
+StaticMarkerTiler::~StaticMarkerTiler()
+{
+    // WARNING: we have to call clear! By the time AbstractMarkerTiler calls clear,
+    // this object does not exist any more, and thus the tiles are not correctly destroyed!
+    clear();
+
+    d->unmapFile();
+
+    delete d;
+}
+
+bool StaticMarkerTiler::openFile(const QString& fileName)
+{
+    closeFile();
+
+    d->file.setFileName(fileName);
+
+    if (!d->file.open(QIODevice::ReadOnly))
+    {
+        d->errorString = i18n("Could not open: %1", d->file.errorString());
+        return false;
+    }
+
+    const qint64 fileSize = d->file.size();
+
+    if (fileSize < TileFileHeaderSize)
+    {
+        d->errorString = i18n("File is too small to be a tile file.");
+        d->unmapFile();
+        return false;
+    }
+
+    d->data = d->file.map(0, fileSize);
+
+    if (!d->data)
+    {
+        d->errorString = i18n("Could not map: %1", d->file.errorString());
+        d->unmapFile();
+        return false;
+    }
+
+    const quint32 version    = qFromLittleEndian<quint32>(d->data + 8);
+    const quint32 levelCount = qFromLittleEndian<quint32>(d->data + 12);
+
+    if ( (memcmp(d->data, TileFileMagic, sizeof(TileFileMagic)) != 0) ||
+         (version != TileFileVersion)                                  ||
+         (levelCount == 0) || (levelCount > quint32(TileIndex::MaxIndexCount)) ||
+         (fileSize < TileFileHeaderSize + qint64(levelCount) * TileFileLevelInfoSize) )
+    {
+        d->errorString = i18n("Not a valid tile file.");
+        d->unmapFile();
+        return false;
+    }
+
+    for (quint32 l = 0; l < levelCount; ++l)
+    {
+        const uchar* const levelInfoData = d->data + TileFileHeaderSize + l * TileFileLevelInfoSize;
+        const quint64 offset             = qFromLittleEndian<quint64>(levelInfoData);
+        const quint64 entryCount         = qFromLittleEndian<quint64>(levelInfoData + 8);
+
+        // make sure that all entries are inside the file
+        if ( (offset > quint64(fileSize)) ||
+             (entryCount > (quint64(fileSize) - offset) / TileFileEntrySize) )
+        {
+            d->errorString = i18n("Tile file is truncated.");
+            d->unmapFile();
+            return false;
+        }
+
+        Private::LevelInfo levelInfo;
+        levelInfo.entries    = d->data + offset;
+        levelInfo.entryCount = entryCount;
+        d->levels << levelInfo;
+    }
+
+    d->markerCount        = qFromLittleEndian<quint64>(d->data + 16);
+    d->rootRepresentative = qFromLittleEndian<quint32>(d->data + 24);
+    d->errorString.clear();
+
+    setMaxLevel(int(levelCount) - 1);
+    setDirty();
+
+    return true;
+}
+
+void StaticMarkerTiler::closeFile()
+{
+    d->unmapFile();
+    setDirty();
+}
+
+bool StaticMarkerTiler::isOpen() const
+{
+    return d->data != nullptr;
+}
+
+QString StaticMarkerTiler::errorString() const
+{
+    return d->errorString;
+}
+
+quint64 StaticMarkerTiler::markerCount() const
+{
+    return d->markerCount;
+}
+
+AbstractMarkerTiler::Tile* StaticMarkerTiler::tileNew()
+{
+    return new MyTile();
+}
+
+void StaticMarkerTiler::tileDeleteInternal(AbstractMarkerTiler::Tile* const tile)
+{
+    delete static_cast<MyTile*>(tile);
+}
+
+void StaticMarkerTiler::prepareTiles(const GeoCoordinates& /*upperLeft*/, const GeoCoordinates&, int /*level*/)
+{
+}
+
+void StaticMarkerTiler::regenerateTiles()
+{
+    // the tiles only cache what has been read from the file so far
+    MyTile* const myRootTile = static_cast<MyTile*>(resetRootTile());
+    setDirty(false);
+
+    d->findEntry(TileIndex(), &myRootTile->markerCount, &myRootTile->representative);
+}
+
+AbstractMarkerTiler::Tile* StaticMarkerTiler::getTile(const TileIndex& tileIndex, const bool stopIfEmpty)
+{
+    if (isDirty())
+    {
+        regenerateTiles();
+    }
+
+    KGEOMAP_ASSERT(tileIndex.level() <= maxLevel());
+
+    MyTile* tile = static_cast<MyTile*>(rootTile());
+
+    for (int level = 0; level < tileIndex.indexCount(); ++level)
+    {
+        const int currentIndex = tileIndex.linearIndex(level);
+        MyTile* childTile      = static_cast<MyTile*>(tile->getChild(currentIndex));
+
+        if (childTile == nullptr)
+        {
+            // the tile has not been read from the file yet.
+            // Children of empty tiles are empty, no need to search for them.
+            quint32 tileMarkerCount    = 0;
+            quint32 tileRepresentative = 0;
+            const bool haveEntry       = (tile->markerCount > 0) &&
+                                         d->findEntry(tileIndex.mid(0, level + 1), &tileMarkerCount, &tileRepresentative);
+
+            if (!haveEntry && stopIfEmpty)
+            {
+                // there will be no markers in this tile, therefore stop
+                return nullptr;
+            }
+
+            childTile                 = static_cast<MyTile*>(tileNew());
+            childTile->markerCount    = tileMarkerCount;
+            childTile->representative = tileRepresentative;
+            tile->addChild(currentIndex, childTile);
+        }
+
+        tile = childTile;
+    }
+
+    return tile;
+}
+
+int StaticMarkerTiler::getTileMarkerCount(const TileIndex& tileIndex)
+{
+    MyTile* const myTile = static_cast<MyTile*>(getTile(tileIndex, true));
+
+    if (!myTile)
+    {
+        return 0;
+    }
+
+    return myTile->markerCount;
+}
+
+int StaticMarkerTiler::getTileSelectedCount(const TileIndex& /*tileIndex*/)
+{
+    // the data set is read-only, there is no selection
+    return 0;
+}
+
+QVariant StaticMarkerTiler::getTileRepresentativeMarker(const TileIndex& tileIndex, const int /*sortKey*/)
+{
+    MyTile* const myTile = static_cast<MyTile*>(getTile(tileIndex, true));
+
+    if (!myTile || (myTile->markerCount == 0))
+    {
+        return QVariant();
+    }
+
+    return QVariant::fromValue(myTile->representative);
+}
+
+QVariant StaticMarkerTiler::bestRepresentativeIndexFromList(const QList<QVariant>& indices, const int /*sortKey*/)
+{
+    // the builder uses the marker with the lowest id as representative, do the same here
+    QVariant bestIndex;
+
+    for (int i = 0; i < indices.count(); ++i)
+    {
+        const QVariant& currentIndex = indices.at(i);
+
+        if (!currentIndex.isValid())
+            continue;
+
+        if ( !bestIndex.isValid() || (currentIndex.value<quint32>() < bestIndex.value<quint32>()) )
+        {
+            bestIndex = currentIndex;
+        }
+    }
+
+    return bestIndex;
+}
+
+QPixmap StaticMarkerTiler::pixmapFromRepresentativeIndex(const QVariant& /*index*/, const QSize& /*size*/)
+{
+    return QPixmap();
+}
+
+bool StaticMarkerTiler::indicesEqual(const QVariant& a, const QVariant& b) const
+{
+    return a.isValid() && b.isValid() && (a.value<quint32>() == b.value<quint32>());
+}
+
+uint StaticMarkerTiler::indexHash(const QVariant& index) const
+{
+    return qHash(index.value<quint32>());
+}
+
+GroupState StaticMarkerTiler::getTileGroupState(const TileIndex& /*tileIndex*/)
+{
+    return SelectedNone;
+}
+
+GroupState StaticMarkerTiler::getGlobalGroupState()
+{
+    return SelectedNone;
+}
+
+void StaticMarkerTiler::setActive(const bool state)
+{
+    d->activeState = state;
+}
+
+/**
+ * @brief Precompute the tile pyramid for a set of markers and store it in a tile file
+ * @param fileName    Name of the file to write
+ * @param latitudes   Latitudes of the markers
+ * @param longitudes  Longitudes of the markers, the id of a marker is its position in the arrays
+ * @param maxLevel    Deepest level stored in the file, the tiler will not go deeper
+ * @param errorString Receives a description of the error if the file could not be written
+ */
+bool StaticMarkerTiler::buildTileFile(const QString& fileName,
+                                      const QVector<qreal>& latitudes,
+                                      const QVector<qreal>& longitudes,
+                                      const int maxLevel,
+                                      QString* const errorString)
+{
+    if (latitudes.count() != longitudes.count())
+    {
+        if (errorString)
+        {
+            *errorString = i18n("Different number of latitudes and longitudes.");
+        }
+
+        return false;
+    }
+
+    if ((maxLevel < 0) || (maxLevel > TileIndex::MaxLevel))
+    {
+        if (errorString)
+        {
+            *errorString = i18n("Invalid tile level %1, the maximum is %2.", maxLevel, int(TileIndex::MaxLevel));
+        }
+
+        return false;
+    }
+
+    QVector<QVector<TileFileEntry> > levels(maxLevel + 1);
+    QVector<TileFileEntry>& maxLevelEntries = levels[maxLevel];
+    maxLevelEntries.reserve(latitudes.count());
+    quint64 markerCount                     = 0;
+    quint32 rootRepresentative              = 0;
+
+    QVector<quint64> latKeys(latitudes.count());
+    QVector<quint64> lonKeys(latitudes.count());
+    TileIndex::keysFromCoordinates(latitudes.constData(), longitudes.constData(), latitudes.count(), maxLevel,
+                                   latKeys.data(), lonKeys.data());
+
+    for (int i = 0; i < latitudes.count(); ++i)
+    {
+        if (qIsNaN(latitudes.at(i)) || qIsNaN(longitudes.at(i)))
+            continue;
+
+        TileFileEntry entry;
+        entry.latKey         = latKeys.at(i);
+        entry.lonKey         = lonKeys.at(i);
+        entry.count          = 1;
+        entry.representative = i;
+        maxLevelEntries << entry;
+
+        if (markerCount == 0)
+        {
+            rootRepresentative = i;
+        }
+
+        ++markerCount;
+    }
+
+    mergeTileFileEntries(&maxLevelEntries);
+
+    // the parent of a tile is found by dropping the last digit of both keys
+    for (int l = maxLevel - 1; l >= 0; --l)
+    {
+        QVector<TileFileEntry> entries = levels.at(l + 1);
+
+        for (int i = 0; i < entries.count(); ++i)
+        {
+            entries[i].latKey /= TileIndex::Tiling;
+            entries[i].lonKey /= TileIndex::Tiling;
+        }
+
+        mergeTileFileEntries(&entries);
+        levels[l] = entries;
+    }
+
+    QSaveFile file(fileName);
+
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        if (errorString)
+        {
+            *errorString = i18n("Could not open: %1", file.errorString());
+        }
+
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    stream.writeRawData(TileFileMagic, int(sizeof(TileFileMagic)));
+    stream << TileFileVersion
+           << quint32(levels.count())
+           << markerCount
+           << rootRepresentative
+           << quint32(0);
+
+    quint64 offset = TileFileHeaderSize + levels.count() * TileFileLevelInfoSize;
+
+    for (int l = 0; l < levels.count(); ++l)
+    {
+        stream << offset << quint64(levels.at(l).count());
+        offset += levels.at(l).count() * TileFileEntrySize;
+    }
+
+    for (int l = 0; l < levels.count(); ++l)
+    {
+        const QVector<TileFileEntry>& entries = levels.at(l);
+
+        for (int i = 0; i < entries.count(); ++i)
+        {
+            const TileFileEntry& entry = entries.at(i);
+            stream << entry.latKey << entry.lonKey << entry.count << entry.representative;
+        }
+    }
+
+    if ( (stream.status() != QDataStream::Ok) || !file.commit() )
+    {
+        if (errorString)
+        {
+            *errorString = i18n("Could not write: %1", file.errorString());
+        }
+
+        return false;
+    }
+
+    qCDebug(LIBKGEOMAP_LOG) << "wrote" << markerCount << "markers to" << fileName;
+
+    return true;
+}
+
+} // namespace KGeoMap
@@ -0,0 +1,104 @@
+/** ===========================================================
+ * @file
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-02
+ * @brief  A marker tiler for read-only data sets stored in a precomputed tile file
+ *
+ * @author Copyright (C) 2009-2011 by Michael G. Hansen
+ *         <a href="mailto:mike at mghansen dot de">mike at mghansen dot de</a>
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef KGEOMAP_STATICMARKERTILER_H
+#define KGEOMAP_STATICMARKERTILER_H
+
+// Qt includes
+
+#include <QtCore/QVector>
+
+// local includes
+
+#include "abstractmarkertiler.h"
+
+namespace KGeoMap
+{
+
+/**
+ * @brief A marker tiler for large, read-only collections of markers
+ *
+ * The tile pyramid is precomputed by buildTileFile() (or the kgeomap_tilebuilder tool)
+ * and stored in a file which is memory-mapped by openFile(). For each level, the file
+ * contains the sorted keys of all non-empty tiles, the number of markers in the tile
+ * and the id of a representative marker. Marker ids are the positions of the markers
+ * in the arrays passed to buildTileFile().
+ *
+ * Opening a file only validates its header, tiles are looked up when they are requested.
+ * The depth of the tiler is set to the number of levels stored in the file.
+ * Representative indices are QVariants holding the marker id as quint32. Subclasses can
+ * reimplement pixmapFromRepresentativeIndex() to provide thumbnails for the ids.
+ */
+class KGEOMAP_EXPORT StaticMarkerTiler : public AbstractMarkerTiler
+{
+    Q_OBJECT
+
+public:
+
+    explicit StaticMarkerTiler(QObject* const parent = nullptr);
+    ~StaticMarkerTiler() override;
+
+    bool openFile(const QString& fileName);
+    void closeFile();
+    bool isOpen() const;
+    QString errorString() const;
+    quint64 markerCount() const;
+
+    Tile* tileNew() override;
+    void tileDeleteInternal(Tile* const tile) override;
+    void prepareTiles(const GeoCoordinates& upperLeft, const GeoCoordinates& lowerRight, int level) override;
+    void regenerateTiles() override;
+    Tile* getTile(const TileIndex& tileIndex, const bool stopIfEmpty = false) override;
+    int getTileMarkerCount(const TileIndex& tileIndex) override;
+    int getTileSelectedCount(const TileIndex& tileIndex) override;
+
+    QVariant getTileRepresentativeMarker(const TileIndex& tileIndex, const int sortKey) override;
+    QVariant bestRepresentativeIndexFromList(const QList<QVariant>& indices, const int sortKey) override;
+    QPixmap pixmapFromRepresentativeIndex(const QVariant& index, const QSize& size) override;
+    bool indicesEqual(const QVariant& a, const QVariant& b) const override;
+    uint indexHash(const QVariant& index) const override;
+    GroupState getTileGroupState(const TileIndex& tileIndex) override;
+    GroupState getGlobalGroupState() override;
+
+    void setActive(const bool state) override;
+
+    static bool buildTileFile(const QString& fileName,
+                              const QVector<qreal>& latitudes,
+                              const QVector<qreal>& longitudes,
+                              const int maxLevel = TileIndex::DefaultMaxLevel,
+                              QString* const errorString = nullptr);
+
+private:
+
+    class MyTile;
+
+    class Private;
+    Private* const d;
+};
+
+} // namespace KGeoMap
+
+#endif // KGEOMAP_STATICMARKERTILER_H
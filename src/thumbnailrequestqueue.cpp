@@ -0,0 +1,432 @@
+/** ===========================================================
+ * @file
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  Asynchronous loading of the thumbnails of representative markers
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "thumbnailrequestqueue.h"
+
+// C++ includes
+
+#include <algorithm>
+
+// Qt includes
+
+#include <QCache>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPair>
+#include <QPointer>
+#include <QTimer>
+#include <QVector>
+
+// local includes
+
+#include "abstractmarkertiler.h"
+
+namespace KGeoMap
+{
+
+namespace
+{
+
+class IndexKey
+{
+public:
+
+    IndexKey(const AbstractMarkerTiler* const tiler, const QVariant& index)
+        : tiler(tiler),
+          index(index),
+          indexHash(tiler ? tiler->indexHash(index) : 0)
+    {
+    }
+
+    bool operator==(const IndexKey& other) const
+    {
+        // the marker tiler decides whether two indices refer to the same marker
+        return (tiler == other.tiler) && (indexHash == other.indexHash) &&
+               tiler && tiler->indicesEqual(index, other.index);
+    }
+
+    const AbstractMarkerTiler* tiler;
+    QVariant                   index;
+    uint                       indexHash;
+};
+
+uint qHash(const IndexKey& key)
+{
+    return key.indexHash;
+}
+
+class PendingRequest
+{
+public:
+
+    PendingRequest()
+        : size(),
+          priority(0)
+    {
+    }
+
+    QSize size;
+    int   priority;
+};
+
+} /* anonymous namespace */
+
+class ThumbnailRequestQueue::Private
+{
+public:
+
+    Private()
+      : markerModel(),
+        pending(),
+        waiting(),
+        thumbnails(DefaultMaxBytes),
+        deliveredIndices(),
+        deliveredPixmaps(),
+        frameTimer(nullptr),
+        frameBudget(DefaultFrameBudget),
+        waitingTimeout(DefaultWaitingTimeout),
+        clock()
+    {
+        clock.start();
+    }
+
+    static int pixmapBytes(const QPixmap& pixmap)
+    {
+        return pixmap.width() * pixmap.height() * qMax(1, pixmap.depth() / 8);
+    }
+
+    QPointer<AbstractMarkerTiler>  markerModel;
+
+    /// requests which were not passed to the marker tiler yet
+    QHash<IndexKey, PendingRequest> pending;
+
+    /// requests for which the marker tiler will emit the thumbnail later, with the time they were made
+    QHash<IndexKey, qint64>         waiting;
+
+    /// the cost of a thumbnail is its size in bytes
+    QCache<IndexKey, QPixmap>       thumbnails;
+
+    /// thumbnails which are announced at the end of the current frame
+    QVariantList                    deliveredIndices;
+    QList<QPixmap>                  deliveredPixmaps;
+
+    QTimer*                         frameTimer;
+    int                             frameBudget;
+    int                             waitingTimeout;
+    QElapsedTimer                   clock;
+};
+
+ThumbnailRequestQueue::ThumbnailRequestQueue(QObject* const parent)
+    : QObject(parent),
+      d(new Private())
+{
+    d->frameTimer = new QTimer(this);
+    d->frameTimer->setSingleShot(true);
+    d->frameTimer->setInterval(DefaultFrameInterval);
+
+    connect(d->frameTimer, &QTimer::timeout, this, &ThumbnailRequestQueue::slotProcessFrame);
+}
+
+ThumbnailRequestQueue::~ThumbnailRequestQueue()
+{
+    delete d;
+}
+
+/**
+ * @brief Sets the marker tiler which loads the thumbnails, all requests and thumbnails are dropped
+ */
+void ThumbnailRequestQueue::setMarkerModel(AbstractMarkerTiler* const markerModel)
+{
+    clear();
+    d->markerModel = markerModel;
+}
+
+AbstractMarkerTiler* ThumbnailRequestQueue::markerModel() const
+{
+    return d->markerModel;
+}
+
+/**
+ * @brief Looks up the thumbnail of a representative marker, without requesting it
+ */
+bool ThumbnailRequestQueue::thumbnail(const QVariant& index, QPixmap* const pixmap) const
+{
+    const QPixmap* const storedPixmap = d->thumbnails.object(IndexKey(d->markerModel, index));
+
+    if (!storedPixmap)
+    {
+        return false;
+    }
+
+    if (pixmap)
+    {
+        *pixmap = *storedPixmap;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Asks for the thumbnail of a representative marker, it is loaded during one of the next frames
+ *
+ * Requests with a higher priority are passed to the marker tiler first. Requesting a marker
+ * which is already pending raises its priority if necessary, markers whose thumbnail is
+ * available or already being loaded by the marker tiler are not requested again.
+ */
+void ThumbnailRequestQueue::request(const QVariant& index, const QSize& size, const int priority)
+{
+    if (!d->markerModel)
+    {
+        return;
+    }
+
+    const IndexKey key(d->markerModel, index);
+
+    if (d->thumbnails.contains(key))
+    {
+        return;
+    }
+
+    const QHash<IndexKey, qint64>::iterator waitingIt = d->waiting.find(key);
+
+    if (waitingIt != d->waiting.end())
+    {
+        // the tiler is still loading the thumbnail, unless it took too long to be true
+        if (d->clock.elapsed() - waitingIt.value() < d->waitingTimeout)
+        {
+            return;
+        }
+
+        d->waiting.erase(waitingIt);
+    }
+
+    QHash<IndexKey, PendingRequest>::iterator it = d->pending.find(key);
+
+    if (it == d->pending.end())
+    {
+        it           = d->pending.insert(key, PendingRequest());
+        it->priority = priority;
+    }
+    else
+    {
+        it->priority = qMax(it->priority, priority);
+    }
+
+    it->size = size;
+
+    if (!d->frameTimer->isActive())
+    {
+        d->frameTimer->start();
+    }
+}
+
+/**
+ * @brief Drops all requests which have not been passed to the marker tiler yet
+ *
+ * Requests which the marker tiler is already working on can not be canceled. They are kept,
+ * so that they are not passed to the tiler a second time, and their thumbnails are stored
+ * when they arrive. Only the ones older than the waiting timeout are dropped.
+ */
+void ThumbnailRequestQueue::cancelPending()
+{
+    d->pending.clear();
+
+    // forget the requests whose thumbnails will probably never arrive
+    const qint64 now = d->clock.elapsed();
+
+    for (QHash<IndexKey, qint64>::iterator it = d->waiting.begin(); it != d->waiting.end(); )
+    {
+        if (now - it.value() >= d->waitingTimeout)
+        {
+            it = d->waiting.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+/**
+ * @brief Drops all requests and all stored thumbnails, for example because the thumbnail size changed
+ */
+void ThumbnailRequestQueue::clear()
+{
+    cancelPending();
+    d->waiting.clear();
+    d->thumbnails.clear();
+    d->deliveredIndices.clear();
+    d->deliveredPixmaps.clear();
+    d->frameTimer->stop();
+}
+
+int ThumbnailRequestQueue::pendingCount() const
+{
+    return d->pending.count();
+}
+
+int ThumbnailRequestQueue::waitingCount() const
+{
+    return d->waiting.count();
+}
+
+int ThumbnailRequestQueue::storedCount() const
+{
+    return d->thumbnails.count();
+}
+
+int ThumbnailRequestQueue::frameInterval() const
+{
+    return d->frameTimer->interval();
+}
+
+void ThumbnailRequestQueue::setFrameInterval(const int milliseconds)
+{
+    d->frameTimer->setInterval(qMax(0, milliseconds));
+}
+
+int ThumbnailRequestQueue::frameBudget() const
+{
+    return d->frameBudget;
+}
+
+void ThumbnailRequestQueue::setFrameBudget(const int milliseconds)
+{
+    d->frameBudget = qMax(0, milliseconds);
+}
+
+int ThumbnailRequestQueue::waitingTimeout() const
+{
+    return d->waitingTimeout;
+}
+
+/**
+ * @brief Sets after how long a marker whose thumbnail did not arrive may be requested again
+ */
+void ThumbnailRequestQueue::setWaitingTimeout(const int milliseconds)
+{
+    d->waitingTimeout = qMax(0, milliseconds);
+}
+
+/**
+ * @brief Stores a thumbnail which the marker tiler loaded in the background
+ */
+void ThumbnailRequestQueue::slotThumbnailAvailableForIndex(const QVariant& index, const QPixmap& pixmap)
+{
+    if (!d->markerModel || (sender() && (sender() != d->markerModel)))
+    {
+        return;
+    }
+
+    const IndexKey key(d->markerModel, index);
+    d->waiting.remove(key);
+    d->pending.remove(key);
+
+    if (pixmap.isNull())
+    {
+        return;
+    }
+
+    d->thumbnails.insert(key, new QPixmap(pixmap), Private::pixmapBytes(pixmap));
+    d->deliveredIndices << index;
+    d->deliveredPixmaps << pixmap;
+
+    if (!d->frameTimer->isActive())
+    {
+        d->frameTimer->start();
+    }
+}
+
+void ThumbnailRequestQueue::slotProcessFrame()
+{
+    if (d->markerModel && !d->pending.isEmpty())
+    {
+        // the most important requests first, the rest has to wait for the next frame
+        QVector<QPair<int, IndexKey> > requests;
+        requests.reserve(d->pending.count());
+
+        for (QHash<IndexKey, PendingRequest>::const_iterator it = d->pending.constBegin();
+             it != d->pending.constEnd(); ++it)
+        {
+            requests << qMakePair(it->priority, it.key());
+        }
+
+        std::stable_sort(requests.begin(), requests.end(),
+                         [](const QPair<int, IndexKey>& a, const QPair<int, IndexKey>& b)
+                         {
+                             return a.first > b.first;
+                         }
+                        );
+
+        QElapsedTimer frameTime;
+        frameTime.start();
+
+        for (int i = 0; i < requests.count(); ++i)
+        {
+            // always handle at least one request per frame
+            if ((i > 0) && (frameTime.elapsed() >= d->frameBudget))
+            {
+                break;
+            }
+
+            const IndexKey& key          = requests.at(i).second;
+            const PendingRequest request = d->pending.take(key);
+            const QPixmap pixmap         = d->markerModel->pixmapFromRepresentativeIndex(key.index, request.size);
+
+            // the tiler may have emitted the thumbnail or been replaced while we waited for it
+            if (!d->markerModel)
+            {
+                break;
+            }
+
+            if (pixmap.isNull())
+            {
+                d->waiting.insert(key, d->clock.elapsed());
+            }
+            else
+            {
+                d->thumbnails.insert(key, new QPixmap(pixmap), Private::pixmapBytes(pixmap));
+                d->deliveredIndices << key.index;
+                d->deliveredPixmaps << pixmap;
+            }
+        }
+    }
+
+    if (!d->deliveredIndices.isEmpty())
+    {
+        const QVariantList indices   = d->deliveredIndices;
+        const QList<QPixmap> pixmaps = d->deliveredPixmaps;
+        d->deliveredIndices.clear();
+        d->deliveredPixmaps.clear();
+
+        emit(signalThumbnailsAvailable(indices, pixmaps));
+    }
+
+    if (!d->pending.isEmpty() && !d->frameTimer->isActive())
+    {
+        d->frameTimer->start();
+    }
+}
+
+} /* namespace KGeoMap */
@@ -0,0 +1,119 @@
+/** ===========================================================
+ * @file
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  Asynchronous loading of the thumbnails of representative markers
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef KGEOMAP_THUMBNAILREQUESTQUEUE_H
+#define KGEOMAP_THUMBNAILREQUESTQUEUE_H
+
+// Qt includes
+
+#include <QtCore/QObject>
+#include <QtCore/QSize>
+#include <QtCore/QVariant>
+#include <QtGui/QPixmap>
+
+namespace KGeoMap
+{
+
+class AbstractMarkerTiler;
+
+/**
+ * @brief Loads the thumbnails of representative markers outside of the paint path
+ *
+ * Clusters request the thumbnail of their representative marker with request() and draw
+ * a placeholder until it is available. Requests for the same marker are merged, keeping the
+ * highest priority. Once per frame, the pending requests are passed to the marker tiler in
+ * order of priority until the time budget of the frame is used up; the remaining ones are
+ * kept for the next frame. Thumbnails which the tiler loads in the background arrive in
+ * slotThumbnailAvailableForIndex().
+ *
+ * All thumbnails which became available during a frame are announced together by
+ * signalThumbnailsAvailable() and kept until the budget of the store is used up.
+ * cancelPending() drops the requests which were not passed to the tiler yet, for example
+ * because the clusters were regenerated after the map was moved. Markers which the tiler is
+ * still loading are not requested again until their waiting timeout expired.
+ */
+class ThumbnailRequestQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit ThumbnailRequestQueue(QObject* const parent = nullptr);
+    ~ThumbnailRequestQueue() override;
+
+    void setMarkerModel(AbstractMarkerTiler* const markerModel);
+    AbstractMarkerTiler* markerModel() const;
+
+    bool thumbnail(const QVariant& index, QPixmap* const pixmap) const;
+    void request(const QVariant& index, const QSize& size, const int priority);
+    void cancelPending();
+    void clear();
+
+    int pendingCount() const;
+    int waitingCount() const;
+    int storedCount() const;
+
+    int frameInterval() const;
+    void setFrameInterval(const int milliseconds);
+    int frameBudget() const;
+    void setFrameBudget(const int milliseconds);
+    int waitingTimeout() const;
+    void setWaitingTimeout(const int milliseconds);
+
+public:
+
+    enum
+    {
+        DefaultFrameInterval  = 16,
+        DefaultFrameBudget    = 8,
+        DefaultWaitingTimeout = 10000,
+        DefaultMaxBytes       = 32 * 1024 * 1024
+    };
+
+public Q_SLOTS:
+
+    void slotThumbnailAvailableForIndex(const QVariant& index, const QPixmap& pixmap);
+
+Q_SIGNALS:
+
+    /**
+     * @brief Announces the thumbnails which became available during one frame
+     *
+     * @c indices and @c pixmaps have the same length.
+     */
+    void signalThumbnailsAvailable(const QVariantList& indices, const QList<QPixmap>& pixmaps);
+
+private Q_SLOTS:
+
+    void slotProcessFrame();
+
+private:
+
+    class Private;
+    Private* const d;
+};
+
+} /* namespace KGeoMap */
+
+#endif /* KGEOMAP_THUMBNAILREQUESTQUEUE_H */
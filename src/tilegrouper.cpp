@@ -124,7 +124,9 @@ void TileGrouper::updateClusters()
 
     s->clusterList.clear();
 
-    const int markerLevel                                   = d->currentBackend->getMarkerModelLevel();
+    // the backend knows how fine the map is, the tiler how deep it can go
+    const int markerLevel                                   = qMin(d->currentBackend->getMarkerModelLevel(),
+                                                                   s->markerModel->maxLevel());
     QList<QPair<GeoCoordinates, GeoCoordinates> > mapBounds = d->currentBackend->getNormalizedBounds();
 
 //     // debug output for tile level diagnostics:
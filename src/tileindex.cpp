@@ -27,9 +27,214 @@
 #include "tileindex.h"
 #include "kgeomap_common.h"
 
+// C++ includes
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#   define KGEOMAP_TILEINDEX_HAVE_SSE2
+#   include <emmintrin.h>
+#endif
+
+#if defined(KGEOMAP_TILEINDEX_HAVE_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   define KGEOMAP_TILEINDEX_HAVE_AVX2
+#   include <immintrin.h>
+#endif
+
 namespace KGeoMap
 {
-    
+
+namespace
+{
+
+/**
+ * Number of tiles along one axis for keys with the given number of indices, Tiling^indexCount.
+ */
+inline qreal keyScale(const int indexCount)
+{
+    static const qreal scales[TileIndex::MaxIndexCount + 1] =
+        { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13 };
+
+    KGEOMAP_ASSERT(indexCount <= TileIndex::MaxIndexCount);
+
+    return scales[indexCount];
+}
+
+/**
+ * @brief Coordinate of the lower border of the tile with the given key
+ *
+ * The border of tile key is origin + span * key / scale. For scales up to
+ * Tiling^MaxIndexCount, key * span and origin * scale are integers below 2^53,
+ * thus exact in double precision, and the only rounding
+ * happens in the final division. The border of a tile is therefore the same at
+ * all levels, and borders grow monotonically with the key.
+ */
+inline qreal tileBorder(const qreal key, const qreal origin, const qreal span, const qreal scale)
+{
+    return (key * span + origin * scale) / scale;
+}
+
+/**
+ * @brief Key of the tile containing value, i.e. tileBorder(key) <= value < tileBorder(key + 1)
+ *
+ * Values outside of the map, and NaN, are clamped to the first or the last tile.
+ * The estimate is at most one tile off, which is corrected by comparing with
+ * the borders themselves, so that the result is consistent with toCoordinates().
+ */
+inline qreal keyFromCoordinate(const qreal value, const qreal origin, const qreal span, const qreal scale)
+{
+    const qreal maxKey = scale - 1.0;
+    qreal key          = (value - origin) / span * scale;
+    key                = (key >= 0.0) ? std::floor(qMin(key, maxKey)) : 0.0;
+
+    if ((key > 0.0) && (tileBorder(key, origin, span, scale) > value))
+    {
+        key -= 1.0;
+    }
+
+    if ((key < maxKey) && (tileBorder(key + 1.0, origin, span, scale) <= value))
+    {
+        key += 1.0;
+    }
+
+    return key;
+}
+
+void keysFromCoordinatesScalar(const qreal* const latitudes, const qreal* const longitudes, const int count,
+                               const qreal scale, quint64* const latKeys, quint64* const lonKeys)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        latKeys[i] = quint64(keyFromCoordinate(latitudes[i], -90.0, 180.0, scale));
+        lonKeys[i] = quint64(keyFromCoordinate(longitudes[i], -180.0, 360.0, scale));
+    }
+}
+
+#ifdef KGEOMAP_TILEINDEX_HAVE_SSE2
+
+/**
+ * Same as keyFromCoordinate(), two values at a time. SSE2 has no floor instruction,
+ * adding and subtracting 2^52 rounds the clamped estimate to an integer instead.
+ */
+inline __m128d keyFromCoordinateSSE2(const __m128d value, const double origin, const double span, const double scale)
+{
+    const __m128d vOrigin = _mm_set1_pd(origin);
+    const __m128d vSpan   = _mm_set1_pd(span);
+    const __m128d vScale  = _mm_set1_pd(scale);
+    const __m128d offset  = _mm_set1_pd(origin * scale);
+    const __m128d maxKey  = _mm_set1_pd(scale - 1.0);
+    const __m128d one     = _mm_set1_pd(1.0);
+    const __m128d zero    = _mm_setzero_pd();
+    const __m128d toInt   = _mm_set1_pd(4503599627370496.0);
+
+    __m128d key = _mm_mul_pd(_mm_div_pd(_mm_sub_pd(value, vOrigin), vSpan), vScale);
+    // _mm_max_pd returns its second operand if the first one is NaN
+    key         = _mm_min_pd(_mm_max_pd(key, zero), maxKey);
+
+    __m128d rounded = _mm_sub_pd(_mm_add_pd(key, toInt), toInt);
+    key             = _mm_sub_pd(rounded, _mm_and_pd(_mm_cmpgt_pd(rounded, key), one));
+
+    const __m128d border = _mm_div_pd(_mm_add_pd(_mm_mul_pd(key, vSpan), offset), vScale);
+    const __m128d lower  = _mm_and_pd(_mm_cmpgt_pd(key, zero), _mm_cmpgt_pd(border, value));
+    key                  = _mm_sub_pd(key, _mm_and_pd(lower, one));
+
+    const __m128d next   = _mm_add_pd(key, one);
+    const __m128d upper  = _mm_and_pd(_mm_cmplt_pd(key, maxKey),
+                                      _mm_cmple_pd(_mm_div_pd(_mm_add_pd(_mm_mul_pd(next, vSpan), offset), vScale), value));
+
+    return _mm_add_pd(key, _mm_and_pd(upper, one));
+}
+
+int keysFromCoordinatesSSE2(const qreal* const latitudes, const qreal* const longitudes, const int count,
+                            const double scale, quint64* const latKeys, quint64* const lonKeys)
+{
+    int i = 0;
+
+    for ( ; i + 2 <= count; i += 2)
+    {
+        double latKeyValues[2];
+        double lonKeyValues[2];
+        _mm_storeu_pd(latKeyValues, keyFromCoordinateSSE2(_mm_loadu_pd(latitudes + i), -90.0, 180.0, scale));
+        _mm_storeu_pd(lonKeyValues, keyFromCoordinateSSE2(_mm_loadu_pd(longitudes + i), -180.0, 360.0, scale));
+
+        for (int j = 0; j < 2; ++j)
+        {
+            latKeys[i + j] = quint64(latKeyValues[j]);
+            lonKeys[i + j] = quint64(lonKeyValues[j]);
+        }
+    }
+
+    return i;
+}
+
+#endif // KGEOMAP_TILEINDEX_HAVE_SSE2
+
+#ifdef KGEOMAP_TILEINDEX_HAVE_AVX2
+
+/**
+ * Same as keyFromCoordinate(), four values at a time.
+ */
+__attribute__((target("avx2")))
+inline __m256d keyFromCoordinateAVX2(const __m256d value, const double origin, const double span, const double scale)
+{
+    const __m256d vOrigin = _mm256_set1_pd(origin);
+    const __m256d vSpan   = _mm256_set1_pd(span);
+    const __m256d vScale  = _mm256_set1_pd(scale);
+    const __m256d offset  = _mm256_set1_pd(origin * scale);
+    const __m256d maxKey  = _mm256_set1_pd(scale - 1.0);
+    const __m256d one     = _mm256_set1_pd(1.0);
+    const __m256d zero    = _mm256_setzero_pd();
+
+    // no fused multiply-add here, the scalar code rounds after each operation
+    __m256d key = _mm256_mul_pd(_mm256_div_pd(_mm256_sub_pd(value, vOrigin), vSpan), vScale);
+    key         = _mm256_floor_pd(_mm256_min_pd(_mm256_max_pd(key, zero), maxKey));
+
+    const __m256d border = _mm256_div_pd(_mm256_add_pd(_mm256_mul_pd(key, vSpan), offset), vScale);
+    const __m256d lower  = _mm256_and_pd(_mm256_cmp_pd(key, zero, _CMP_GT_OQ), _mm256_cmp_pd(border, value, _CMP_GT_OQ));
+    key                  = _mm256_sub_pd(key, _mm256_and_pd(lower, one));
+
+    const __m256d next   = _mm256_add_pd(key, one);
+    const __m256d nextBorder = _mm256_div_pd(_mm256_add_pd(_mm256_mul_pd(next, vSpan), offset), vScale);
+    const __m256d upper  = _mm256_and_pd(_mm256_cmp_pd(key, maxKey, _CMP_LT_OQ), _mm256_cmp_pd(nextBorder, value, _CMP_LE_OQ));
+
+    return _mm256_add_pd(key, _mm256_and_pd(upper, one));
+}
+
+__attribute__((target("avx2")))
+int keysFromCoordinatesAVX2(const qreal* const latitudes, const qreal* const longitudes, const int count,
+                            const double scale, quint64* const latKeys, quint64* const lonKeys)
+{
+    int i = 0;
+
+    for ( ; i + 4 <= count; i += 4)
+    {
+        double latKeyValues[4];
+        double lonKeyValues[4];
+        _mm256_storeu_pd(latKeyValues, keyFromCoordinateAVX2(_mm256_loadu_pd(latitudes + i), -90.0, 180.0, scale));
+        _mm256_storeu_pd(lonKeyValues, keyFromCoordinateAVX2(_mm256_loadu_pd(longitudes + i), -180.0, 360.0, scale));
+
+        for (int j = 0; j < 4; ++j)
+        {
+            latKeys[i + j] = quint64(latKeyValues[j]);
+            lonKeys[i + j] = quint64(lonKeyValues[j]);
+        }
+    }
+
+    return i;
+}
+
+bool cpuHasAVX2()
+{
+    static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+    return hasAVX2;
+}
+
+#endif // KGEOMAP_TILEINDEX_HAVE_AVX2
+
+} // namespace
+
+// -------------------------------------------------------------------------------------------
+
 TileIndex::TileIndex()
     : m_indicesCount(0)
 {
@@ -124,6 +329,81 @@ QIntList TileIndex::toIntList() const
     return result;
 }
 
+/**
+ * @brief Packs the lat and lon indices of all levels into two base-Tiling numbers
+ *
+ * The index of the first level is the most significant digit. The keys of the parent
+ * tile are obtained by dividing both keys by Tiling.
+ */
+void TileIndex::toLatLonKeys(quint64* const latKey, quint64* const lonKey) const
+{
+    *latKey = 0;
+    *lonKey = 0;
+
+    for (int l = 0; l < m_indicesCount; ++l)
+    {
+        *latKey = *latKey * Tiling + indexLat(l);
+        *lonKey = *lonKey * Tiling + indexLon(l);
+    }
+}
+
+/**
+ * @brief Reverse of toLatLonKeys(), @p getLevel is the level of the tile the keys describe
+ */
+TileIndex TileIndex::fromLatLonKeys(const quint64 latKey, const quint64 lonKey, const int getLevel)
+{
+    KGEOMAP_ASSERT(getLevel<=MaxLevel);
+
+    TileIndex result;
+    result.m_indicesCount = getLevel + 1;
+    quint64 latRest       = latKey;
+    quint64 lonRest       = lonKey;
+
+    for (int l = getLevel; l >= 0; --l)
+    {
+        result.m_indices[l] = int(latRest % Tiling) * Tiling + int(lonRest % Tiling);
+        latRest            /= Tiling;
+        lonRest            /= Tiling;
+    }
+
+    return result;
+}
+
+/**
+ * @brief Computes the keys of the tiles at getLevel containing the given coordinates
+ *
+ * The result for each coordinate is bit-for-bit identical to
+ * fromCoordinates(GeoCoordinates(lat, lon), getLevel).toLatLonKeys(), including the
+ * clamping of coordinates at and beyond the borders of the map. The keys of lower
+ * levels are obtained by dividing by powers of Tiling. Coordinates are
+ * processed four (AVX2) or two (SSE2) at a time where the CPU supports it.
+ * Unlike fromCoordinates(), NaN is not detected: callers have to skip markers
+ * without coordinates themselves.
+ */
+void TileIndex::keysFromCoordinates(const qreal* const latitudes, const qreal* const longitudes, const int count,
+                                    const int getLevel, quint64* const latKeys, quint64* const lonKeys)
+{
+    KGEOMAP_ASSERT(getLevel<=MaxLevel);
+
+    const qreal scale = keyScale(getLevel + 1);
+    int done          = 0;
+
+#ifdef KGEOMAP_TILEINDEX_HAVE_AVX2
+    if (cpuHasAVX2())
+    {
+        done = keysFromCoordinatesAVX2(latitudes, longitudes, count, scale, latKeys, lonKeys);
+    }
+#endif
+
+#ifdef KGEOMAP_TILEINDEX_HAVE_SSE2
+    done += keysFromCoordinatesSSE2(latitudes + done, longitudes + done, count - done, scale,
+                                    latKeys + done, lonKeys + done);
+#endif
+
+    keysFromCoordinatesScalar(latitudes + done, longitudes + done, count - done, scale,
+                              latKeys + done, lonKeys + done);
+}
+
 TileIndex TileIndex::fromIntList(const QIntList& intList)
 {
     TileIndex result;
@@ -190,157 +470,45 @@ TileIndex TileIndex::fromCoordinates(const KGeoMap::GeoCoordinates& coordinate,
     if (!coordinate.hasCoordinates())
         return TileIndex();
 
-    qreal tileLatBL     = -90.0;
-    qreal tileLonBL     = -180.0;
-    qreal tileLatHeight = 180.0;
-    qreal tileLonWidth  = 360.0;
-
-    TileIndex resultIndex;
+    const qreal scale = keyScale(getLevel + 1);
 
-    for (int l = 0; l <= getLevel; ++l)
-    {
-        // how many tiles at this level?
-        const qreal latDivisor = TileIndex::Tiling;
-        const qreal lonDivisor = TileIndex::Tiling;
-
-        const qreal dLat       = tileLatHeight / latDivisor;
-        const qreal dLon       = tileLonWidth / lonDivisor;
-
-        int latIndex           = int( (coordinate.lat() - tileLatBL ) / dLat );
-        int lonIndex           = int( (coordinate.lon() - tileLonBL ) / dLon );
-
-        // protect against invalid indices due to rounding errors
-        bool haveRoundingErrors = false;
-
-        if (latIndex < 0)
-        {
-            haveRoundingErrors = true;
-            latIndex           = 0;
-        }
-
-        if (lonIndex < 0)
-        {
-            haveRoundingErrors = true;
-            lonIndex           = 0;
-        }
-
-        if (latIndex >= latDivisor)
-        {
-            haveRoundingErrors = true;
-            latIndex           = latDivisor-1;
-        }
-
-        if (lonIndex >= lonDivisor)
-        {
-            haveRoundingErrors = true;
-            lonIndex           = lonDivisor-1;
-        }
-
-        if (haveRoundingErrors)
-        {
-//             qCDebug(LIBKGEOMAP_LOG) << QString::fromLatin1("Rounding errors at level %1!").arg(l);
-        }
-
-        resultIndex.appendLatLonIndex(latIndex, lonIndex);
-
-        // update the start position for the next tile:
-        // TODO: rounding errors
-        tileLatBL     += latIndex*dLat;
-        tileLonBL     += lonIndex*dLon;
-        tileLatHeight /= latDivisor;
-        tileLonWidth  /= lonDivisor;
-    }
-
-    return resultIndex;
+    return fromLatLonKeys(quint64(keyFromCoordinate(coordinate.lat(), -90.0, 180.0, scale)),
+                          quint64(keyFromCoordinate(coordinate.lon(), -180.0, 360.0, scale)),
+                          getLevel);
 }
 
 GeoCoordinates TileIndex::toCoordinates() const
 {
-    // TODO: safeguards against rounding errors!
-    qreal tileLatBL     = -90.0;
-    qreal tileLonBL     = -180.0;
-    qreal tileLatHeight = 180.0;
-    qreal tileLonWidth  = 360.0;
-
-    for (int l = 0; l < m_indicesCount; ++l)
-    {
-        // how many tiles are at this level?
-        const qreal latDivisor = TileIndex::Tiling;
-        const qreal lonDivisor = TileIndex::Tiling;
-
-        const qreal dLat       = tileLatHeight / latDivisor;
-        const qreal dLon       = tileLonWidth / lonDivisor;
-
-        const int latIndex     = indexLat(l);
-        const int lonIndex     = indexLon(l);
-
-        // update the start position for the next tile:
-        tileLatBL             += latIndex*dLat;
-        tileLonBL             += lonIndex*dLon;
-        tileLatHeight         /= latDivisor;
-        tileLonWidth          /= lonDivisor;
-    }
-
-    return GeoCoordinates(tileLatBL, tileLonBL);
+    return toCoordinates(CornerNW);
 }
 
-
+/**
+ * @brief Returns a corner of the tile
+ *
+ * The corners are computed from the keys of the tile in one step, so that a tile and
+ * its neighbors share their borders exactly and fromCoordinates() maps the
+ * CornerNW of a tile back to the tile itself.
+ */
 GeoCoordinates TileIndex::toCoordinates(const CornerPosition ofCorner) const
 {
-    // TODO: safeguards against rounding errors!
-    qreal tileLatBL     = -90.0;
-    qreal tileLonBL     = -180.0;
-    qreal tileLatHeight = 180.0;
-    qreal tileLonWidth  = 360.0;
+    quint64 latKey = 0;
+    quint64 lonKey = 0;
+    toLatLonKeys(&latKey, &lonKey);
 
-    for (int l = 0; l < m_indicesCount; ++l)
+    if ((ofCorner == CornerSW) || (ofCorner == CornerSE))
     {
-        // how many tiles are at this level?
-        const qreal latDivisor = TileIndex::Tiling;
-        const qreal lonDivisor = TileIndex::Tiling;
-
-        const qreal dLat       = tileLatHeight / latDivisor;
-        const qreal dLon       = tileLonWidth / lonDivisor;
-
-        const int latIndex     = indexLat(l);
-        const int lonIndex     = indexLon(l);
-
-        // update the start position for the next tile:
-        if ((l+1) >= m_indicesCount)
-        {
-            if (ofCorner == CornerNW)
-            {
-                tileLatBL += latIndex*dLat;
-                tileLonBL += lonIndex*dLon;
-            }
-            else if (ofCorner == CornerSW)
-            {
-                tileLatBL += (latIndex+1)*dLat;
-                tileLonBL += lonIndex*dLon;
-            }
-            else if (ofCorner == CornerNE)
-            {
-                tileLatBL += latIndex*dLat;
-                tileLonBL += (lonIndex+1)*dLon;
-            }
-            else if (ofCorner == CornerSE)
-            {
-                tileLatBL += (latIndex+1)*dLat;
-                tileLonBL += (lonIndex+1)*dLon;
-            }
-        }
-        else
-        {
-            // update the start position for the next tile:
-            tileLatBL += latIndex*dLat;
-            tileLonBL += lonIndex*dLon;
-        }
+        ++latKey;
+    }
 
-        tileLatHeight /= latDivisor;
-        tileLonWidth  /= lonDivisor;
+    if ((ofCorner == CornerNE) || (ofCorner == CornerSE))
+    {
+        ++lonKey;
     }
 
-    return GeoCoordinates(tileLatBL, tileLonBL);
+    const qreal scale = keyScale(m_indicesCount);
+
+    return GeoCoordinates(tileBorder(latKey, -90.0, 180.0, scale),
+                          tileBorder(lonKey, -180.0, 360.0, scale));
 }
 
 QDebug operator<<(QDebug debugOut, const KGeoMap::TileIndex& tileIndex)
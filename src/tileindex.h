@@ -47,12 +47,17 @@ class KGEOMAP_EXPORT TileIndex
 {
 public:
 
+    /**
+     * MaxLevel is the deepest level for which keys and corners are computed exactly,
+     * see AbstractMarkerTiler::setMaxLevel() for the depth actually used by a tiler.
+     */
     enum Constants
     {
-        MaxLevel       = 9,
-        MaxIndexCount  = MaxLevel+1,
-        Tiling         = 10,
-        MaxLinearIndex = Tiling*Tiling
+        MaxLevel        = 12,
+        MaxIndexCount   = MaxLevel+1,
+        DefaultMaxLevel = 9,
+        Tiling          = 10,
+        MaxLinearIndex  = Tiling*Tiling
     };
 
     enum CornerPosition
@@ -86,6 +91,8 @@ public:
 
     QIntList toIntList() const;
 
+    void toLatLonKeys(quint64* const latKey, quint64* const lonKey) const;
+
     GeoCoordinates toCoordinates()                              const;
     GeoCoordinates toCoordinates(const CornerPosition ofCorner) const;
 
@@ -94,6 +101,9 @@ public:
 
     static TileIndex fromCoordinates(const KGeoMap::GeoCoordinates& coordinate, const int getLevel);
     static TileIndex fromIntList(const QIntList& intList);
+    static TileIndex fromLatLonKeys(const quint64 latKey, const quint64 lonKey, const int getLevel);
+    static void keysFromCoordinates(const qreal* const latitudes, const qreal* const longitudes, const int count,
+                                    const int getLevel, quint64* const latKeys, quint64* const lonKeys);
     static bool indicesEqual(const TileIndex& a, const TileIndex& b, const int upToLevel);
     static QList<QIntList> listToIntListList(const QList<TileIndex>& tileIndexList);
 
@@ -334,6 +334,10 @@ TrackReader::TrackReadResult TrackReader::loadTrackFile(const QUrl& url)
     // the correlation algorithm relies on sorted data, therefore sort now
     qSort(parsedData.track.points.begin(), parsedData.track.points.end(), TrackManager::TrackPoint::EarlierThan);
 
+    // prepare the simplification of the track while we are still in the worker thread
+    parsedData.track.pointTolerances = TrackManager::computePointTolerances(parsedData.track.points);
+    parsedData.track.segments        = TrackManager::computeSegments(parsedData.track.points);
+
     return parsedData;
 }
 
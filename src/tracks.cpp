@@ -26,11 +26,18 @@
 
 #include "tracks.h"
 
+// C++ includes
+
+#include <algorithm>
+#include <limits>
+
 // Qt includes
 
 #include <QtConcurrent/QtConcurrentMap>
 #include <QFuture>
 #include <QFutureWatcher>
+#include <QSet>
+#include <QtMath>
 
 // KDE includes
 
@@ -38,11 +45,49 @@
 
 // local includes
 
+#include "tileindex.h"
 #include "trackreader.h"
 
+namespace
+{
+
+/// number of points in a track segment, without the point shared with the next segment
+const int TrackSegmentPointCount = 256;
+
+/// The segment index uses the tiles of this level as cells, which makes a grid of 100 x 100 cells.
+const int SegmentGridLevel       = 1;
+const int SegmentGridSize        = 100;
+
+/// segments which cover more cells are not put into the grid, but are always checked
+const int MaxSegmentGridCells    = 64;
+
+void segmentGridCells(const qreal latMin, const qreal lonMin, const qreal latMax, const qreal lonMax,
+                      quint64* const latKeyMin, quint64* const lonKeyMin,
+                      quint64* const latKeyMax, quint64* const lonKeyMax)
+{
+    using KGeoMap::GeoCoordinates;
+    using KGeoMap::TileIndex;
+
+    TileIndex::fromCoordinates(GeoCoordinates(latMin, lonMin), SegmentGridLevel).toLatLonKeys(latKeyMin, lonKeyMin);
+    TileIndex::fromCoordinates(GeoCoordinates(latMax, lonMax), SegmentGridLevel).toLatLonKeys(latKeyMax, lonKeyMax);
+}
+
+} // namespace
+
 namespace KGeoMap
 {
 
+// TrackManager::TrackSegment -------------------------------------------------
+
+/**
+ * @brief Checks whether the bounding box of the segment intersects normalized bounds
+ */
+bool TrackManager::TrackSegment::intersects(const GeoCoordinates::Pair& bounds) const
+{
+    return (latMin <= bounds.second.lat()) && (latMax >= bounds.first.lat()) &&
+           (lonMin <= bounds.second.lon()) && (lonMax >= bounds.first.lon());
+}
+
 // TrackManager::TrackPoint ---------------------------------------------------
 
 bool TrackManager::TrackPoint::EarlierThan(const TrackPoint& a, const TrackPoint& b)
@@ -63,10 +108,47 @@ public:
         loadErrorFiles(),
         nextTrackId(1),
         nextTrackColor(0),
-        visibility(true)
+        visibility(true),
+        segmentGrid(),
+        largeSegments()
     {
     }
 
+    void rebuildSegmentIndex()
+    {
+        segmentGrid.clear();
+        largeSegments.clear();
+
+        for (int trackIdx = 0; trackIdx < trackList.count(); ++trackIdx)
+        {
+            const TrackSegment::List& segments = trackList.at(trackIdx).segments;
+
+            for (int segmentIdx = 0; segmentIdx < segments.count(); ++segmentIdx)
+            {
+                const TrackSegment& segment = segments.at(segmentIdx);
+                const SegmentReference reference(trackIdx, segmentIdx);
+
+                quint64 latKeyMin, lonKeyMin, latKeyMax, lonKeyMax;
+                segmentGridCells(segment.latMin, segment.lonMin, segment.latMax, segment.lonMax,
+                                 &latKeyMin, &lonKeyMin, &latKeyMax, &lonKeyMax);
+
+                if ((latKeyMax - latKeyMin + 1) * (lonKeyMax - lonKeyMin + 1) > quint64(MaxSegmentGridCells))
+                {
+                    largeSegments << reference;
+                    continue;
+                }
+
+                for (quint64 latKey = latKeyMin; latKey <= latKeyMax; ++latKey)
+                {
+                    for (quint64 lonKey = lonKeyMin; lonKey <= lonKeyMax; ++lonKey)
+                    {
+                        segmentGrid[latKey * SegmentGridSize + lonKey] << reference;
+                    }
+                }
+            }
+        }
+    }
+
     QFutureWatcher<TrackReader::TrackReadResult>* trackLoadFutureWatcher;
     QFuture<TrackReader::TrackReadResult>         trackLoadFuture;
     TrackManager::Track::List                     trackPendingList;
@@ -76,6 +158,10 @@ public:
     Id                                            nextTrackId;
     int                                           nextTrackColor;
     bool                                          visibility;
+
+    /// segments of all tracks, by cell of the grid
+    QHash<quint64, QVector<SegmentReference> >    segmentGrid;
+    QVector<SegmentReference>                     largeSegments;
 };
 
 TrackManager::TrackManager(QObject* const parent)
@@ -108,6 +194,7 @@ void TrackManager::clear()
 {
     /// @todo send a signal
     d->trackList.clear();
+    d->rebuildSegmentIndex();
 }
 
 const TrackManager::Track& TrackManager::getTrack(const int index) const
@@ -145,6 +232,12 @@ void TrackManager::slotTrackFilesReadyAt(int beginIndex, int endIndex)
             Track nextTrack = nextFile.track;
             nextTrack.id    = getNextFreeTrackId();
             nextTrack.color = getNextFreeTrackColor();
+
+            if (nextTrack.segments.isEmpty())
+            {
+                nextTrack.segments = computeSegments(nextTrack.points);
+            }
+
             d->trackPendingList << nextTrack;
         }
         else
@@ -159,6 +252,7 @@ void TrackManager::slotTrackFilesFinished()
     d->trackLoadFutureWatcher->deleteLater();
 
     d->trackList << d->trackPendingList;
+    d->rebuildSegmentIndex();
     QList<TrackChanges> trackChanges;
 
     Q_FOREACH(const Track& track, d->trackPendingList)
@@ -211,6 +305,245 @@ TrackManager::Track TrackManager::getTrackById(const quint64 trackId) const
     return TrackManager::Track();
 }
 
+/**
+ * @brief Computes a Douglas-Peucker hierarchy for the points of a track
+ *
+ * For each point, the result holds the largest tolerance in degrees at which the
+ * Douglas-Peucker algorithm still keeps the point. Simplifying the track for any
+ * tolerance is then a matter of selecting the points above it, see simplifiedPointIndices().
+ * The tolerance of a point never exceeds the tolerance of the points which split the
+ * track before it, so the simplified tracks are nested. The first and the last point
+ * are always kept.
+ *
+ * Distances are measured in the latitude/longitude plane, which is good enough to
+ * decide which points can be seen on screen.
+ */
+QVector<qreal> TrackManager::computePointTolerances(const TrackPoint::List& points)
+{
+    const int pointCount = points.count();
+    QVector<qreal> tolerances(pointCount, 0.0);
+
+    if (pointCount == 0)
+    {
+        return tolerances;
+    }
+
+    QVector<qreal> lats(pointCount);
+    QVector<qreal> lons(pointCount);
+
+    for (int i = 0; i < pointCount; ++i)
+    {
+        const GeoCoordinates& coordinates = points.at(i).coordinates;
+        lats[i]                           = coordinates.lat();
+        lons[i]                           = coordinates.lon();
+    }
+
+    const qreal maxTolerance = std::numeric_limits<qreal>::max();
+    tolerances[0]            = maxTolerance;
+    tolerances[pointCount-1] = maxTolerance;
+
+    // split the track iteratively, tracks can have far too many points for recursion
+    class Range
+    {
+    public:
+
+        int   first;
+        int   last;
+        qreal tolerance;
+    };
+
+    QVector<Range> ranges;
+    const Range fullRange = { 0, pointCount-1, maxTolerance };
+    ranges << fullRange;
+
+    while (!ranges.isEmpty())
+    {
+        const Range range = ranges.takeLast();
+
+        if (range.last - range.first < 2)
+        {
+            continue;
+        }
+
+        const qreal lat0         = lats.at(range.first);
+        const qreal lon0         = lons.at(range.first);
+        const qreal dLat         = lats.at(range.last) - lat0;
+        const qreal dLon         = lons.at(range.last) - lon0;
+        const qreal lengthSquare = dLat*dLat + dLon*dLon;
+
+        int   splitIndex          = range.first + 1;
+        qreal splitDistanceSquare = -1.0;
+
+        for (int i = range.first + 1; i < range.last; ++i)
+        {
+            qreal pLat = lats.at(i) - lat0;
+            qreal pLon = lons.at(i) - lon0;
+
+            if (lengthSquare > 0.0)
+            {
+                // distance to the closest point on the segment between the end points
+                const qreal t = qBound(0.0, (pLat*dLat + pLon*dLon) / lengthSquare, 1.0);
+                pLat         -= t*dLat;
+                pLon         -= t*dLon;
+            }
+
+            const qreal distanceSquare = pLat*pLat + pLon*pLon;
+
+            if (distanceSquare > splitDistanceSquare)
+            {
+                splitIndex          = i;
+                splitDistanceSquare = distanceSquare;
+            }
+        }
+
+        const qreal splitTolerance = qMin(qSqrt(splitDistanceSquare), range.tolerance);
+        tolerances[splitIndex]     = splitTolerance;
+
+        const Range firstPart  = { range.first, splitIndex, splitTolerance };
+        const Range secondPart = { splitIndex, range.last, splitTolerance };
+        ranges << firstPart << secondPart;
+    }
+
+    return tolerances;
+}
+
+/**
+ * @brief Returns the indices of the points of a track simplified for a tolerance in degrees
+ *
+ * All points are returned if the tolerances of the track have not been computed.
+ */
+QList<int> TrackManager::simplifiedPointIndices(const Track& track, const qreal tolerance)
+{
+    QList<int> result;
+    const int pointCount = track.points.count();
+
+    if (track.pointTolerances.count() != pointCount)
+    {
+        for (int i = 0; i < pointCount; ++i)
+        {
+            result << i;
+        }
+
+        return result;
+    }
+
+    for (int i = 0; i < pointCount; ++i)
+    {
+        if ((track.pointTolerances.at(i) > tolerance) || (i == 0) || (i == pointCount-1))
+        {
+            result << i;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief Splits a track into segments of a fixed number of points and computes their bounding boxes
+ */
+TrackManager::TrackSegment::List TrackManager::computeSegments(const TrackPoint::List& points)
+{
+    TrackSegment::List segments;
+    const int pointCount = points.count();
+
+    for (int firstPoint = 0; firstPoint < pointCount - 1; firstPoint += TrackSegmentPointCount)
+    {
+        TrackSegment segment;
+        segment.firstPoint = firstPoint;
+        segment.lastPoint  = qMin(firstPoint + TrackSegmentPointCount, pointCount - 1);
+        segment.latMin     = points.at(firstPoint).coordinates.lat();
+        segment.latMax     = segment.latMin;
+        segment.lonMin     = points.at(firstPoint).coordinates.lon();
+        segment.lonMax     = segment.lonMin;
+
+        for (int i = firstPoint + 1; i <= segment.lastPoint; ++i)
+        {
+            const GeoCoordinates& coordinates = points.at(i).coordinates;
+            segment.latMin                    = qMin(segment.latMin, coordinates.lat());
+            segment.latMax                    = qMax(segment.latMax, coordinates.lat());
+            segment.lonMin                    = qMin(segment.lonMin, coordinates.lon());
+            segment.lonMax                    = qMax(segment.lonMax, coordinates.lon());
+        }
+
+        segments << segment;
+    }
+
+    return segments;
+}
+
+/**
+ * @brief Returns the segments of all tracks which intersect the given normalized regions
+ *
+ * The result is sorted by track and segment, so consecutive segments of a track can
+ * be drawn as one line.
+ */
+QList<TrackManager::SegmentReference> TrackManager::segmentsInRegions(const GeoCoordinates::PairList& regions) const
+{
+    // segments can be in several cells and regions, the set is only used to report them once
+    QSet<SegmentReference> found;
+    QList<SegmentReference> result;
+
+    Q_FOREACH(const GeoCoordinates::Pair& region, regions)
+    {
+        quint64 latKeyMin, lonKeyMin, latKeyMax, lonKeyMax;
+        segmentGridCells(region.first.lat(), region.first.lon(), region.second.lat(), region.second.lon(),
+                         &latKeyMin, &lonKeyMin, &latKeyMax, &lonKeyMax);
+
+        QList<const QVector<SegmentReference>*> candidates;
+        const quint64 regionCellCount = (latKeyMax - latKeyMin + 1) * (lonKeyMax - lonKeyMin + 1);
+
+        if (regionCellCount > quint64(d->segmentGrid.count()))
+        {
+            // the region is large, it is faster to look at the cells which are in use
+            for (QHash<quint64, QVector<SegmentReference> >::const_iterator it = d->segmentGrid.constBegin();
+                 it != d->segmentGrid.constEnd(); ++it)
+            {
+                const quint64 latKey = it.key() / SegmentGridSize;
+                const quint64 lonKey = it.key() % SegmentGridSize;
+
+                if ((latKey >= latKeyMin) && (latKey <= latKeyMax) && (lonKey >= lonKeyMin) && (lonKey <= lonKeyMax))
+                {
+                    candidates << &it.value();
+                }
+            }
+        }
+        else
+        {
+            for (quint64 latKey = latKeyMin; latKey <= latKeyMax; ++latKey)
+            {
+                for (quint64 lonKey = lonKeyMin; lonKey <= lonKeyMax; ++lonKey)
+                {
+                    QHash<quint64, QVector<SegmentReference> >::const_iterator it = d->segmentGrid.constFind(latKey * SegmentGridSize + lonKey);
+
+                    if (it != d->segmentGrid.constEnd())
+                    {
+                        candidates << &it.value();
+                    }
+                }
+            }
+        }
+
+        candidates << &d->largeSegments;
+
+        Q_FOREACH(const QVector<SegmentReference>* const references, candidates)
+        {
+            Q_FOREACH(const SegmentReference& reference, *references)
+            {
+                if (!found.contains(reference) &&
+                    d->trackList.at(reference.first).segments.at(reference.second).intersects(region))
+                {
+                    found  << reference;
+                    result << reference;
+                }
+            }
+        }
+    }
+
+    std::sort(result.begin(), result.end());
+
+    return result;
+}
+
 QColor TrackManager::getNextFreeTrackColor()
 {
     QList<QColor> colorList;
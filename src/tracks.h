@@ -32,6 +32,7 @@
 #include <QtGui/QColor>
 #include <QtCore/QDateTime>
 #include <QtCore/QUrl>
+#include <QtCore/QVector>
 
 // local includes
 
@@ -85,6 +86,42 @@ public:
     // We assume here that we will never load more than uint32_max tracks.
     typedef quint32 Id;
 
+    /**
+     * @brief A consecutive part of a track and its bounding box
+     *
+     * The last point of a segment is the first point of the next segment.
+     */
+    class TrackSegment
+    {
+    public:
+
+        TrackSegment()
+          : firstPoint(0),
+            lastPoint(0),
+            latMin(0.0),
+            latMax(0.0),
+            lonMin(0.0),
+            lonMax(0.0)
+        {
+        }
+
+        bool intersects(const GeoCoordinates::Pair& bounds) const;
+
+    public:
+
+        int                         firstPoint;
+        int                         lastPoint;
+        qreal                       latMin;
+        qreal                       latMax;
+        qreal                       lonMin;
+        qreal                       lonMax;
+
+        typedef QVector<TrackSegment> List;
+    };
+
+    /// index of a track in the track list and index of a segment of that track
+    typedef QPair<int, int> SegmentReference;
+
     class Track
     {
     public:
@@ -103,7 +140,9 @@ public:
             points(),
             id(0),
             color(Qt::red),
-            flags(FlagDefault)
+            flags(FlagDefault),
+            pointTolerances(),
+            segments()
         {
         }
 
@@ -113,6 +152,10 @@ public:
         Id                   id;
         QColor               color;
         Flags                flags;
+        /// Douglas-Peucker tolerance in degrees up to which each point is kept, see computePointTolerances()
+        QVector<qreal>       pointTolerances;
+        /// see computeSegments()
+        TrackSegment::List   segments;
 
         typedef QList<Track> List;
     };
@@ -148,6 +191,12 @@ public:
     void setVisibility(const bool value);
     bool getVisibility() const;
 
+    QList<SegmentReference> segmentsInRegions(const GeoCoordinates::PairList& regions) const;
+
+    static QVector<qreal> computePointTolerances(const TrackPoint::List& points);
+    static QList<int> simplifiedPointIndices(const Track& track, const qreal tolerance);
+    static TrackSegment::List computeSegments(const TrackPoint::List& points);
+
 Q_SIGNALS:
 
     void signalTrackFilesReadyAt(const int startIndex, const int endIndex);
@@ -0,0 +1,85 @@
+/** ===========================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  Test the KGeoMap::CircleMarkerAtlas class
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "test_circlemarkeratlas.h"
+
+// local includes
+
+#include "circlemarkeratlas.h"
+
+using namespace KGeoMap;
+
+void TestCircleMarkerAtlas::testNoOp()
+{
+}
+
+void TestCircleMarkerAtlas::testCircleSize()
+{
+    CircleMarkerAtlas atlas;
+
+    // the circle has a margin of one pixel
+    const QPixmap circle = atlas.circlePixmap(24, Qt::red, Qt::black, Qt::SolidLine, QLatin1String("12"), Qt::black);
+    QCOMPARE(circle.size(), QSize(50, 50));
+
+    // the corners are outside of the circle
+    const QImage circleImage = circle.toImage();
+    QCOMPARE(qAlpha(circleImage.pixel(0, 0)), 0);
+    QCOMPARE(qAlpha(circleImage.pixel(49, 49)), 0);
+
+    // the center is covered by the circle or its label
+    QVERIFY(qAlpha(circleImage.pixel(25, 25)) > 0);
+}
+
+void TestCircleMarkerAtlas::testReuse()
+{
+    CircleMarkerAtlas atlas;
+
+    const QPixmap circle1 = atlas.circlePixmap(15, Qt::red, Qt::black, Qt::SolidLine, QLatin1String("12"), Qt::black);
+    QCOMPARE(atlas.bodyCount(), 1);
+    QCOMPARE(atlas.glyphCount(), 2);
+    QCOMPARE(atlas.composedCount(), 1);
+
+    // a circle which was drawn before is returned again
+    const QPixmap circle2 = atlas.circlePixmap(15, Qt::red, Qt::black, Qt::SolidLine, QLatin1String("12"), Qt::black);
+    QCOMPARE(circle2.cacheKey(), circle1.cacheKey());
+    QCOMPARE(atlas.composedCount(), 1);
+
+    // a new label re-uses the body and the known glyphs
+    atlas.circlePixmap(15, Qt::red, Qt::black, Qt::SolidLine, QLatin1String("21"), Qt::black);
+    atlas.circlePixmap(15, Qt::red, Qt::black, Qt::SolidLine, QLatin1String("13"), Qt::black);
+    QCOMPARE(atlas.bodyCount(), 1);
+    QCOMPARE(atlas.glyphCount(), 3);
+    QCOMPARE(atlas.composedCount(), 3);
+
+    // a new style needs a new body
+    atlas.circlePixmap(15, Qt::red, Qt::blue, Qt::DotLine, QLatin1String("12"), Qt::black);
+    QCOMPARE(atlas.bodyCount(), 2);
+    QCOMPARE(atlas.glyphCount(), 3);
+
+    atlas.clear();
+    QCOMPARE(atlas.bodyCount(), 0);
+    QCOMPARE(atlas.glyphCount(), 0);
+    QCOMPARE(atlas.composedCount(), 0);
+}
+
+QTEST_MAIN(TestCircleMarkerAtlas)
@@ -0,0 +1,144 @@
+/** ===========================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  Test the KGeoMap::ClusterPixmapCache class
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "test_clusterpixmapcache.h"
+
+// local includes
+
+#include "clusterpixmapcache.h"
+#include "staticmarkertiler.h"
+
+using namespace KGeoMap;
+
+namespace
+{
+
+/// the representative indices of StaticMarkerTiler are marker ids
+ClusterPixmapCache::Key makeKey(const AbstractMarkerTiler* const tiler, const quint32 markerId,
+                                const QString& labelText = QLatin1String("5"), const bool grayOut = false)
+{
+    return ClusterPixmapCache::Key(tiler, QVariant::fromValue(markerId), 64, SelectedNone,
+                                   labelText, QColor(Qt::black), Qt::SolidLine, grayOut, false);
+}
+
+QPixmap makePixmap(const int size)
+{
+    QPixmap pixmap(size, size);
+    pixmap.fill(Qt::white);
+
+    return pixmap;
+}
+
+} /* anonymous namespace */
+
+void TestClusterPixmapCache::testNoOp()
+{
+}
+
+void TestClusterPixmapCache::testKeys()
+{
+    StaticMarkerTiler tiler;
+
+    QVERIFY(makeKey(&tiler, 1) == makeKey(&tiler, 1));
+    QCOMPARE(qHash(makeKey(&tiler, 1)), qHash(makeKey(&tiler, 1)));
+
+    // everything which changes the decoration makes a different key
+    QVERIFY(!(makeKey(&tiler, 1) == makeKey(&tiler, 2)));
+    QVERIFY(!(makeKey(&tiler, 1) == makeKey(&tiler, 1, QLatin1String("6"))));
+    QVERIFY(!(makeKey(&tiler, 1) == makeKey(&tiler, 1, QLatin1String("5"), true)));
+
+    StaticMarkerTiler otherTiler;
+    QVERIFY(!(makeKey(&tiler, 1) == makeKey(&otherTiler, 1)));
+}
+
+void TestClusterPixmapCache::testCounters()
+{
+    StaticMarkerTiler tiler;
+    ClusterPixmapCache cache;
+    QPixmap pixmap;
+
+    QVERIFY(!cache.find(makeKey(&tiler, 1), &pixmap));
+    QCOMPARE(cache.misses(), 1);
+    QCOMPARE(cache.hits(), 0);
+
+    cache.insert(makeKey(&tiler, 1), makePixmap(10));
+    QVERIFY(cache.find(makeKey(&tiler, 1), &pixmap));
+    QVERIFY(cache.find(makeKey(&tiler, 1), &pixmap));
+    QCOMPARE(pixmap.size(), QSize(10, 10));
+    QCOMPARE(cache.hits(), 2);
+    QCOMPARE(cache.misses(), 1);
+    QCOMPARE(cache.hitRate(), 2.0/3.0);
+
+    cache.resetCounters();
+    QCOMPARE(cache.hits(), 0);
+    QCOMPARE(cache.hitRate(), 0.0);
+}
+
+void TestClusterPixmapCache::testBudget()
+{
+    StaticMarkerTiler tiler;
+    const int pixmapBytes = makePixmap(10).width() * makePixmap(10).height() * qMax(1, makePixmap(10).depth() / 8);
+    ClusterPixmapCache cache(3 * pixmapBytes);
+
+    cache.insert(makeKey(&tiler, 1), makePixmap(10));
+    cache.insert(makeKey(&tiler, 2), makePixmap(10));
+    cache.insert(makeKey(&tiler, 3), makePixmap(10));
+    QCOMPARE(cache.count(), 3);
+    QCOMPARE(cache.bytes(), 3 * pixmapBytes);
+
+    // using pixmap 1 makes pixmap 2 the least recently used one
+    QVERIFY(cache.find(makeKey(&tiler, 1), nullptr));
+    cache.insert(makeKey(&tiler, 4), makePixmap(10));
+
+    QCOMPARE(cache.count(), 3);
+    QVERIFY(cache.find(makeKey(&tiler, 1), nullptr));
+    QVERIFY(!cache.find(makeKey(&tiler, 2), nullptr));
+    QVERIFY(cache.find(makeKey(&tiler, 3), nullptr));
+    QVERIFY(cache.find(makeKey(&tiler, 4), nullptr));
+
+    // pixmaps larger than the budget are not kept
+    cache.insert(makeKey(&tiler, 5), makePixmap(100));
+    QVERIFY(!cache.find(makeKey(&tiler, 5), nullptr));
+}
+
+void TestClusterPixmapCache::testRemoveIndex()
+{
+    StaticMarkerTiler tiler;
+    ClusterPixmapCache cache;
+
+    cache.insert(makeKey(&tiler, 1), makePixmap(10));
+    cache.insert(makeKey(&tiler, 1, QLatin1String("6")), makePixmap(10));
+    cache.insert(makeKey(&tiler, 2), makePixmap(10));
+    QCOMPARE(cache.count(), 3);
+
+    // all decorations of marker 1 are removed
+    cache.removeIndex(&tiler, QVariant::fromValue(quint32(1)));
+    QCOMPARE(cache.count(), 1);
+    QVERIFY(cache.find(makeKey(&tiler, 2), nullptr));
+
+    cache.clear();
+    QCOMPARE(cache.count(), 0);
+    QCOMPARE(cache.bytes(), 0);
+}
+
+QTEST_MAIN(TestClusterPixmapCache)
@@ -0,0 +1,44 @@
+/** ===========================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  Test the KGeoMap::ClusterPixmapCache class
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef TEST_CLUSTERPIXMAPCACHE_H
+#define TEST_CLUSTERPIXMAPCACHE_H
+
+// Qt includes
+
+#include <QtTest/QtTest>
+
+class TestClusterPixmapCache : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+
+    void testNoOp();
+    void testKeys();
+    void testCounters();
+    void testBudget();
+    void testRemoveIndex();
+};
+
+#endif /* TEST_CLUSTERPIXMAPCACHE_H */
@@ -124,7 +124,7 @@ void TestItemMarkerTiler::testAddMarkers1()
     QScopedPointer<QStandardItemModel> itemModel(new QStandardItemModel());
     ItemMarkerTiler mm(new MarkerModelHelper(itemModel.data(), nullptr));
 
-    const int maxLevel = TileIndex::MaxLevel;
+    const int maxLevel = TileIndex::DefaultMaxLevel;
 
     // there should be no tiles in the model yet:
     for (int l = 0; l <= maxLevel; ++l)
@@ -161,7 +161,7 @@ void TestItemMarkerTiler::testRemoveMarkers2()
     QScopedPointer<QStandardItemModel> itemModel(new QStandardItemModel());
     ItemMarkerTiler mm(new MarkerModelHelper(itemModel.data(), nullptr));
 
-    const int maxLevel = TileIndex::MaxLevel;
+    const int maxLevel = TileIndex::DefaultMaxLevel;
 
     itemModel->appendRow(MakeItemAt(coord_50_60));
     QStandardItem* const item2 = MakeItemAt(coord_50_60);
@@ -192,7 +192,7 @@ void TestItemMarkerTiler::testMoveMarkers1()
 {
     QScopedPointer<QStandardItemModel> itemModel(new QStandardItemModel());
     ItemMarkerTiler mm(new MarkerModelHelper(itemModel.data(), nullptr));
-    const int maxLevel  = TileIndex::MaxLevel;
+    const int maxLevel  = TileIndex::DefaultMaxLevel;
     const int fillLevel = maxLevel - 2;
 
     // add a marker to the model and create tiles up to a certain level:
@@ -237,7 +237,7 @@ void TestItemMarkerTiler::testMoveMarkers2()
 {
     QScopedPointer<QStandardItemModel> itemModel(new QStandardItemModel());
     ItemMarkerTiler mm(new MarkerModelHelper(itemModel.data(), nullptr));
-    const int maxLevel = TileIndex::MaxLevel;
+    const int maxLevel = TileIndex::DefaultMaxLevel;
 
     const int fillLevel = maxLevel - 2;
 
@@ -303,7 +303,7 @@ void TestItemMarkerTiler::testIteratorWholeWorldNoBackingModel()
 {
     QScopedPointer<QStandardItemModel> itemModel(new QStandardItemModel());
     ItemMarkerTiler mm(new MarkerModelHelper(itemModel.data(), nullptr));
-    const int maxLevel = TileIndex::MaxLevel;
+    const int maxLevel = TileIndex::DefaultMaxLevel;
 
     for (int l = 0; l <= maxLevel; ++l)
     {
@@ -316,7 +316,7 @@ void TestItemMarkerTiler::testIteratorWholeWorld()
 {
     QScopedPointer<QStandardItemModel> itemModel(new QStandardItemModel());
     ItemMarkerTiler mm(new MarkerModelHelper(itemModel.data(), nullptr));
-    const int maxLevel = TileIndex::MaxLevel;
+    const int maxLevel = TileIndex::DefaultMaxLevel;
 
     for (int l = 0; l <= maxLevel; ++l)
     {
@@ -339,7 +339,7 @@ void TestItemMarkerTiler::testIteratorPartial1()
 {
     QScopedPointer<QStandardItemModel> itemModel(new QStandardItemModel());
     ItemMarkerTiler mm(new MarkerModelHelper(itemModel.data(), nullptr));
-    const int maxLevel = TileIndex::MaxLevel;
+    const int maxLevel = TileIndex::DefaultMaxLevel;
 
     itemModel->appendRow(MakeItemAt(coord_1_2));
     itemModel->appendRow(MakeItemAt(coord_50_60));
@@ -407,7 +407,7 @@ void TestItemMarkerTiler::testIteratorPartial2()
 {
     QScopedPointer<QStandardItemModel> itemModel(new QStandardItemModel());
     ItemMarkerTiler mm(new MarkerModelHelper(itemModel.data(), nullptr));
-    const int maxLevel = TileIndex::MaxLevel;
+    const int maxLevel = TileIndex::DefaultMaxLevel;
 
     GeoCoordinates::PairList boundsList;
     boundsList << GeoCoordinates::makePair(0.55, 1.55, 0.56, 1.56);
@@ -434,7 +434,7 @@ void TestItemMarkerTiler::testRemoveMarkers1()
 {
     QScopedPointer<QStandardItemModel> itemModel(new QStandardItemModel());
     ItemMarkerTiler mm(new MarkerModelHelper(itemModel.data(), nullptr));
-    const int maxLevel = TileIndex::MaxLevel;
+    const int maxLevel = TileIndex::DefaultMaxLevel;
 
     for (int l = 0; l <= maxLevel; ++l)
     {
@@ -480,7 +480,7 @@ void TestItemMarkerTiler::testPreExistingMarkers()
     itemModel->appendRow(MakeItemAt(coord_50_60));
     ItemMarkerTiler mm(new MarkerModelHelper(itemModel.data(), nullptr));
 
-    const int maxLevel = TileIndex::MaxLevel;
+    const int maxLevel = TileIndex::DefaultMaxLevel;
 
     for (int l = 0; l <= maxLevel; ++l)
     {
@@ -496,7 +496,7 @@ void TestItemMarkerTiler::testSelectionState1()
     QItemSelectionModel* const selectionModel = new QItemSelectionModel(itemModel.data());
     ItemMarkerTiler mm(new MarkerModelHelper(itemModel.data(), selectionModel));
 
-    const int maxLevel         = TileIndex::MaxLevel;
+    const int maxLevel         = TileIndex::DefaultMaxLevel;
 
     QStandardItem* const item1 = MakeItemAt(coord_50_60);
     item1->setSelectable(true);
@@ -638,6 +638,118 @@ void TestItemMarkerTiler::testSelectionState1()
     //       this is currently implemented by simply setting the tiles as dirty
 }
 
+void TestItemMarkerTiler::testCoordinateCache()
+{
+    QScopedPointer<QStandardItemModel> itemModel(new QStandardItemModel());
+    itemModel->appendRow(MakeItemAt(coord_1_2));
+    MarkerModelHelper* const helper = new MarkerModelHelper(itemModel.data(), nullptr);
+    ItemMarkerTiler mm(helper);
+
+    // the tiler enables the cache:
+    QVERIFY(helper->coordinateCacheEnabled());
+    QCOMPARE(helper->cachedRowCount(), 1);
+    QCOMPARE(helper->cachedLatitudes()[0], coord_1_2.lat());
+    QCOMPARE(helper->cachedLongitudes()[0], coord_1_2.lon());
+
+    // insert rows in front of and after the existing row:
+    itemModel->insertRow(0, MakeItemAt(coord_50_60));
+    itemModel->appendRow(new QStandardItem(QLatin1String("no coordinates")));
+    itemModel->appendRow(MakeItemAt(coord_m50_m60));
+    QCOMPARE(helper->cachedRowCount(), 4);
+    QCOMPARE(helper->cachedLatitudes()[0], coord_50_60.lat());
+    QCOMPARE(helper->cachedLatitudes()[1], coord_1_2.lat());
+    QVERIFY(qIsNaN(helper->cachedLatitudes()[2]));
+    QCOMPARE(helper->cachedLongitudes()[3], coord_m50_m60.lon());
+
+    GeoCoordinates coordinates;
+    QVERIFY(helper->cachedItemCoordinates(itemModel->index(3, 0), &coordinates));
+    QCOMPARE(coordinates.lat(), coord_m50_m60.lat());
+    QVERIFY(!helper->cachedItemCoordinates(itemModel->index(2, 0), &coordinates));
+
+    // remove a row:
+    itemModel->removeRow(1);
+    QCOMPARE(helper->cachedRowCount(), 3);
+    QCOMPARE(helper->cachedLatitudes()[0], coord_50_60.lat());
+    QVERIFY(qIsNaN(helper->cachedLatitudes()[1]));
+
+    // change the coordinates of an item:
+    itemModel->item(0)->setData(QVariant::fromValue(coord_1_2), CoordinatesRole);
+    QCOMPARE(helper->cachedLatitudes()[0], coord_1_2.lat());
+    QCOMPARE(helper->cachedLongitudes()[0], coord_1_2.lon());
+
+    // the tiles see the cached coordinates:
+    QCOMPARE(mm.getTileMarkerCount(TileIndex::fromCoordinates(coord_1_2, TileIndex::DefaultMaxLevel)), 1);
+    QCOMPARE(mm.getTileMarkerCount(TileIndex::fromCoordinates(coord_m50_m60, TileIndex::DefaultMaxLevel)), 1);
+    QCOMPARE(mm.getTileMarkerCount(TileIndex()), 2);
+
+    // regenerating the tiles reads all rows from the cache at once, the item without coordinates is left out:
+    mm.setDirty();
+
+    for (int l = 0; l <= TileIndex::DefaultMaxLevel; ++l)
+    {
+        QCOMPARE(mm.getTileMarkerCount(TileIndex::fromCoordinates(coord_1_2, l)), 1);
+        QCOMPARE(mm.getTileMarkerCount(TileIndex::fromCoordinates(coord_m50_m60, l)), 1);
+    }
+
+    QCOMPARE(mm.getTileMarkerCount(TileIndex()), 2);
+
+    // disabling the cache falls back to itemCoordinates:
+    helper->setCoordinateCacheEnabled(false);
+    QCOMPARE(helper->cachedRowCount(), 0);
+    QVERIFY(helper->cachedItemCoordinates(itemModel->index(0, 0), &coordinates));
+    QCOMPARE(coordinates.lat(), coord_1_2.lat());
+}
+
+void TestItemMarkerTiler::testCoordinatesChanged()
+{
+    QScopedPointer<QStandardItemModel> itemModel(new QStandardItemModel());
+    QItemSelectionModel* const selectionModel = new QItemSelectionModel(itemModel.data());
+    itemModel->appendRow(MakeItemAt(coord_1_2));
+    itemModel->appendRow(MakeItemAt(coord_50_60));
+    MarkerModelHelper* const helper = new MarkerModelHelper(itemModel.data(), selectionModel);
+
+    // the helper reports every change as drastic, the tiler has to follow the changes itself here
+    QVERIFY(QObject::disconnect(itemModel.data(), SIGNAL(dataChanged(QModelIndex,QModelIndex)),
+                                helper, SLOT(slotDataChanged(QModelIndex,QModelIndex))));
+
+    ItemMarkerTiler mm(helper);
+    const int maxLevel = mm.maxLevel();
+    selectionModel->select(itemModel->index(1, 0), QItemSelectionModel::Select);
+    QCOMPARE(mm.getTileMarkerCount(TileIndex()), 2);
+    QCOMPARE(mm.getTileSelectedCount(TileIndex()), 1);
+
+    QSignalSpy spy(&mm, SIGNAL(signalTilesOrSelectionChanged()));
+
+    // move the selected marker, the tiles are updated without regenerating them:
+    itemModel->item(1)->setData(QVariant::fromValue(coord_m50_m60), CoordinatesRole);
+    QVERIFY(!mm.isDirty());
+    QCOMPARE(spy.count(), 1);
+
+    for (int l = 0; l <= maxLevel; ++l)
+    {
+        QVERIFY(mm.getTile(TileIndex::fromCoordinates(coord_50_60, l), true) == nullptr);
+
+        const TileIndex tileIndex = TileIndex::fromCoordinates(coord_m50_m60, l);
+        QCOMPARE(mm.getTileMarkerCount(tileIndex), 1);
+        QCOMPARE(mm.getTileSelectedCount(tileIndex), 1);
+    }
+
+    QCOMPARE(mm.getTileMarkerCount(TileIndex()), 2);
+    QCOMPARE(mm.getTileSelectedCount(TileIndex()), 1);
+
+    // changing other data does not move the marker:
+    itemModel->item(0)->setData(QLatin1String("renamed"), Qt::DisplayRole);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(mm.getTileMarkerCount(TileIndex::fromCoordinates(coord_1_2, maxLevel)), 1);
+
+    // a marker which loses its coordinates is removed from the tiles:
+    itemModel->item(0)->setData(QVariant(), CoordinatesRole);
+    QVERIFY(!mm.isDirty());
+    QCOMPARE(spy.count(), 2);
+    QVERIFY(mm.getTile(TileIndex::fromCoordinates(coord_1_2, 0), true) == nullptr);
+    QCOMPARE(mm.getTileMarkerCount(TileIndex()), 1);
+}
+
 void TestItemMarkerTiler::benchmarkIteratorWholeWorld()
 {
     return;
@@ -646,7 +758,7 @@ void TestItemMarkerTiler::benchmarkIteratorWholeWorld()
     {
         QScopedPointer<QStandardItemModel> itemModel(new QStandardItemModel());
         ItemMarkerTiler mm(new MarkerModelHelper(itemModel.data(), 0));
-        const int maxLevel = TileIndex::MaxLevel;
+        const int maxLevel = TileIndex::DefaultMaxLevel;
 
         {
             int l = maxLevel-1;
@@ -679,4 +791,54 @@ void TestItemMarkerTiler::benchmarkIteratorWholeWorld()
 #endif
 }
 
+void TestItemMarkerTiler::testMaxLevel()
+{
+    QScopedPointer<QStandardItemModel> itemModel(new QStandardItemModel());
+    ItemMarkerTiler mm(new MarkerModelHelper(itemModel.data(), nullptr));
+    QCOMPARE(mm.maxLevel(), int(TileIndex::DefaultMaxLevel));
+
+    // two markers closer to each other than the tiles at the default depth
+    const GeoCoordinates coord_a(51.99999999, 6.000000001);
+    const GeoCoordinates coord_b(51.999999995, 6.000000005);
+    QVERIFY(TileIndex::indicesEqual(TileIndex::fromCoordinates(coord_a, TileIndex::DefaultMaxLevel),
+                                    TileIndex::fromCoordinates(coord_b, TileIndex::DefaultMaxLevel),
+                                    TileIndex::DefaultMaxLevel));
+    QVERIFY(!TileIndex::indicesEqual(TileIndex::fromCoordinates(coord_a, TileIndex::MaxLevel),
+                                     TileIndex::fromCoordinates(coord_b, TileIndex::MaxLevel),
+                                     TileIndex::MaxLevel));
+
+    itemModel->appendRow(MakeItemAt(coord_a));
+    itemModel->appendRow(MakeItemAt(coord_b));
+
+    QCOMPARE(mm.getTileMarkerCount(TileIndex::fromCoordinates(coord_a, TileIndex::DefaultMaxLevel)), 2);
+
+    // going deeper separates the markers
+    mm.setMaxLevel(TileIndex::MaxLevel);
+    QVERIFY(mm.isDirty());
+
+    for (int l = 0; l <= TileIndex::MaxLevel; ++l)
+    {
+        const TileIndex index_a = TileIndex::fromCoordinates(coord_a, l);
+        const TileIndex index_b = TileIndex::fromCoordinates(coord_b, l);
+
+        if (TileIndex::indicesEqual(index_a, index_b, l))
+        {
+            QCOMPARE(mm.getTileMarkerCount(index_a), 2);
+        }
+        else
+        {
+            QVERIFY(l > TileIndex::DefaultMaxLevel);
+            QCOMPARE(mm.getTileMarkerCount(index_a), 1);
+            QCOMPARE(mm.getTileMarkerCount(index_b), 1);
+        }
+    }
+
+    QCOMPARE(CountMarkersInIterator(new AbstractMarkerTiler::NonEmptyIterator(&mm, TileIndex::MaxLevel)), 2);
+
+    // a third marker is sorted into the existing deep tiles
+    itemModel->appendRow(MakeItemAt(coord_b));
+    QCOMPARE(mm.getTileMarkerCount(TileIndex::fromCoordinates(coord_b, TileIndex::MaxLevel)), 2);
+    QCOMPARE(mm.getTileMarkerCount(TileIndex::fromCoordinates(coord_a, TileIndex::MaxLevel)), 1);
+}
+
 QTEST_GUILESS_MAIN(TestItemMarkerTiler)
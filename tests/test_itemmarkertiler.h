@@ -77,6 +77,9 @@ private Q_SLOTS:
     void testIteratorPartial2();
     void testPreExistingMarkers();
     void testSelectionState1();
+    void testCoordinateCache();
+    void testCoordinatesChanged();
+    void testMaxLevel();
     void benchmarkIteratorWholeWorld();
 };
 
@@ -195,6 +195,32 @@ void TestPrimitives::testNormalizeBounds()
     QTEST(KGeoMapHelperNormalizeBounds(bounds), "nbounds");
 }
 
+void TestPrimitives::testMercatorProjection()
+{
+    // the center of the map:
+    QCOMPARE(KGeoMapHelperMercatorProject(GeoCoordinates(0.0, 0.0), 0), QPointF(128.0, 128.0));
+    QCOMPARE(KGeoMapHelperMercatorProject(GeoCoordinates(0.0, 0.0), 2), QPointF(512.0, 512.0));
+
+    // the corners of the map, latitudes beyond the Mercator limit are clamped:
+    const QPointF upperLeft = KGeoMapHelperMercatorProject(GeoCoordinates(89.0, -180.0), 1);
+    QCOMPARE(upperLeft.x(), 0.0);
+    QVERIFY(qAbs(upperLeft.y()) < 1e-6);
+
+    const QPointF lowerRight = KGeoMapHelperMercatorProject(GeoCoordinates(-85.0511287798, 180.0), 1);
+    QCOMPARE(lowerRight.x(), 512.0);
+    QVERIFY(qAbs(lowerRight.y() - 512.0) < 1e-6);
+
+    // projecting and unprojecting should give the same coordinates:
+    const GeoCoordinates coordinates(52.5, 6.5);
+    const GeoCoordinates roundTrip = KGeoMapHelperMercatorUnproject(KGeoMapHelperMercatorProject(coordinates, 10), 10);
+    QVERIFY(qAbs(roundTrip.lat() - coordinates.lat()) < 1e-9);
+    QVERIFY(qAbs(roundTrip.lon() - coordinates.lon()) < 1e-9);
+
+    // points beyond the edges of the map wrap around:
+    QVERIFY(qAbs(KGeoMapHelperMercatorUnproject(QPointF(-10.0, 128.0), 0).lon() - 165.9375) < 1e-9);
+    QVERIFY(qAbs(KGeoMapHelperMercatorUnproject(QPointF(266.0, 128.0), 0).lon() + 165.9375) < 1e-9);
+}
+
 void TestPrimitives::testGroupStateComputer()
 {
     {
@@ -40,6 +40,7 @@ private Q_SLOTS:
     void testParseBoundsString();
     void testNormalizeBounds_data();
     void testNormalizeBounds();
+    void testMercatorProjection();
     void testGroupStateComputer();
 };
 
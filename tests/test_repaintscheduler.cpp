@@ -0,0 +1,67 @@
+/** ===========================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  Test the KGeoMap::RepaintScheduler class
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "test_repaintscheduler.h"
+
+// local includes
+
+#include "backends/repaintscheduler.h"
+
+using namespace KGeoMap;
+
+void TestRepaintScheduler::testNoOp()
+{
+}
+
+void TestRepaintScheduler::testMerge()
+{
+    RepaintScheduler scheduler;
+    QCOMPARE(scheduler.interval(), int(RepaintScheduler::DefaultInterval));
+
+    QSignalSpy spy(&scheduler, SIGNAL(signalRepaint()));
+
+    // all requests within one frame are merged into one repaint
+    for (int i = 0; i < 5; ++i)
+    {
+        scheduler.schedule();
+    }
+
+    QVERIFY(scheduler.isScheduled());
+    QCOMPARE(spy.count(), 0);
+    QCOMPARE(scheduler.requestCount(), 5);
+    QCOMPARE(scheduler.mergedRequestCount(), 4);
+
+    QVERIFY(spy.wait());
+    QVERIFY(!scheduler.isScheduled());
+    QTest::qWait(3 * RepaintScheduler::DefaultInterval);
+    QCOMPARE(spy.count(), 1);
+
+    // the next request starts a new frame
+    scheduler.schedule();
+    QVERIFY(spy.wait());
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(scheduler.requestCount(), 6);
+    QCOMPARE(scheduler.mergedRequestCount(), 4);
+}
+
+QTEST_GUILESS_MAIN(TestRepaintScheduler)
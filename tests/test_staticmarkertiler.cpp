@@ -0,0 +1,210 @@
+/** ===========================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-02
+ * @brief  Test the KGeoMap::StaticMarkerTiler class
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "test_staticmarkertiler.h"
+
+// Qt includes
+
+#include <QTemporaryDir>
+
+// local includes
+
+#include "staticmarkertiler.h"
+
+using namespace KGeoMap;
+
+namespace
+{
+
+void makeTestData(QVector<qreal>* const latitudes, QVector<qreal>* const longitudes)
+{
+    *latitudes  << 52.0 << 52.0 << 52.1   << -10.0 << 90.0  << -90.0  << qQNaN() << 0.0   << 50.0  << 52.0;
+    *longitudes << 6.0  << 6.0  << 6.0001 << 170.0 << 180.0 << -180.0 << 10.0    << 0.0   << 60.0  << 6.0;
+}
+
+int countMarkersInIterator(AbstractMarkerTiler::NonEmptyIterator* const it)
+{
+    int markerCount = 0;
+
+    while (!it->atEnd())
+    {
+        markerCount += it->model()->getTileMarkerCount(it->currentIndex());
+        it->nextIndex();
+    }
+
+    return markerCount;
+}
+
+} // namespace
+
+void TestStaticMarkerTiler::testNoOp()
+{
+}
+
+void TestStaticMarkerTiler::testTileCounts()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    const QString fileName = tempDir.path() + QLatin1String("/test.tiles");
+
+    QVector<qreal> latitudes;
+    QVector<qreal> longitudes;
+    makeTestData(&latitudes, &longitudes);
+
+    QString errorString;
+    QVERIFY2(StaticMarkerTiler::buildTileFile(fileName, latitudes, longitudes, TileIndex::DefaultMaxLevel, &errorString), qPrintable(errorString));
+
+    StaticMarkerTiler tiler;
+    QVERIFY2(tiler.openFile(fileName), qPrintable(tiler.errorString()));
+    QVERIFY(tiler.isOpen());
+
+    // one marker has invalid coordinates
+    QCOMPARE(tiler.markerCount(), quint64(latitudes.count() - 1));
+    QCOMPARE(tiler.getTileMarkerCount(TileIndex()), latitudes.count() - 1);
+
+    for (int l = 0; l <= TileIndex::DefaultMaxLevel; ++l)
+    {
+        for (int i = 0; i < latitudes.count(); ++i)
+        {
+            if (qIsNaN(latitudes.at(i)))
+                continue;
+
+            const TileIndex tileIndex = TileIndex::fromCoordinates(GeoCoordinates(latitudes.at(i), longitudes.at(i)), l);
+            int expectedCount         = 0;
+
+            for (int j = 0; j < latitudes.count(); ++j)
+            {
+                if (qIsNaN(latitudes.at(j)))
+                    continue;
+
+                const TileIndex otherIndex = TileIndex::fromCoordinates(GeoCoordinates(latitudes.at(j), longitudes.at(j)), l);
+
+                if (TileIndex::indicesEqual(tileIndex, otherIndex, l))
+                {
+                    ++expectedCount;
+                }
+            }
+
+            QCOMPARE(tiler.getTileMarkerCount(tileIndex), expectedCount);
+            QCOMPARE(tiler.getTileSelectedCount(tileIndex), 0);
+        }
+    }
+
+    // a tile without markers:
+    const TileIndex emptyIndex = TileIndex::fromCoordinates(GeoCoordinates(-45.0, -45.0), TileIndex::DefaultMaxLevel);
+    QCOMPARE(tiler.getTileMarkerCount(emptyIndex), 0);
+    QVERIFY(tiler.getTile(emptyIndex, true) == nullptr);
+    QVERIFY(!tiler.getTileRepresentativeMarker(emptyIndex, 0).isValid());
+
+    tiler.closeFile();
+    QVERIFY(!tiler.isOpen());
+    QCOMPARE(tiler.getTileMarkerCount(TileIndex()), 0);
+}
+
+void TestStaticMarkerTiler::testRepresentatives()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    const QString fileName = tempDir.path() + QLatin1String("/test.tiles");
+
+    QVector<qreal> latitudes;
+    QVector<qreal> longitudes;
+    makeTestData(&latitudes, &longitudes);
+    QVERIFY(StaticMarkerTiler::buildTileFile(fileName, latitudes, longitudes));
+
+    StaticMarkerTiler tiler;
+    QVERIFY(tiler.openFile(fileName));
+
+    // the marker with the lowest id represents a tile
+    QCOMPARE(tiler.getTileRepresentativeMarker(TileIndex(), 0).value<quint32>(), quint32(0));
+
+    const TileIndex index_52_6 = TileIndex::fromCoordinates(GeoCoordinates(52.0, 6.0), TileIndex::DefaultMaxLevel);
+    QCOMPARE(tiler.getTileRepresentativeMarker(index_52_6, 0).value<quint32>(), quint32(0));
+
+    const TileIndex index_50_60 = TileIndex::fromCoordinates(GeoCoordinates(50.0, 60.0), TileIndex::DefaultMaxLevel);
+    QCOMPARE(tiler.getTileRepresentativeMarker(index_50_60, 0).value<quint32>(), quint32(8));
+
+    const QVariant best = tiler.bestRepresentativeIndexFromList(QList<QVariant>()
+                                                                << QVariant::fromValue(quint32(8))
+                                                                << QVariant()
+                                                                << QVariant::fromValue(quint32(3)),
+                                                                0);
+    QVERIFY(tiler.indicesEqual(best, QVariant::fromValue(quint32(3))));
+}
+
+void TestStaticMarkerTiler::testIterator()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    const QString fileName = tempDir.path() + QLatin1String("/test.tiles");
+
+    QVector<qreal> latitudes;
+    QVector<qreal> longitudes;
+    makeTestData(&latitudes, &longitudes);
+    QVERIFY(StaticMarkerTiler::buildTileFile(fileName, latitudes, longitudes));
+
+    StaticMarkerTiler tiler;
+    QVERIFY(tiler.openFile(fileName));
+
+    for (int l = 0; l <= TileIndex::DefaultMaxLevel; ++l)
+    {
+        AbstractMarkerTiler::NonEmptyIterator it(&tiler, l);
+        QCOMPARE(countMarkersInIterator(&it), latitudes.count() - 1);
+    }
+}
+
+void TestStaticMarkerTiler::testInvalidFiles()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+
+    StaticMarkerTiler tiler;
+    QVERIFY(!tiler.openFile(tempDir.path() + QLatin1String("/doesnotexist.tiles")));
+    QVERIFY(!tiler.errorString().isEmpty());
+
+    // a file which is not a tile file:
+    const QString garbageFileName = tempDir.path() + QLatin1String("/garbage.tiles");
+    QFile garbageFile(garbageFileName);
+    QVERIFY(garbageFile.open(QIODevice::WriteOnly));
+    garbageFile.write(QByteArray(100, 'x'));
+    garbageFile.close();
+    QVERIFY(!tiler.openFile(garbageFileName));
+    QVERIFY(!tiler.isOpen());
+
+    // a truncated tile file:
+    const QString fileName = tempDir.path() + QLatin1String("/truncated.tiles");
+    QVector<qreal> latitudes;
+    QVector<qreal> longitudes;
+    makeTestData(&latitudes, &longitudes);
+    QVERIFY(StaticMarkerTiler::buildTileFile(fileName, latitudes, longitudes));
+
+    QFile truncatedFile(fileName);
+    QVERIFY(truncatedFile.resize(truncatedFile.size() - 1));
+    QVERIFY(!tiler.openFile(fileName));
+    QCOMPARE(tiler.getTileMarkerCount(TileIndex()), 0);
+
+    // mismatching input arrays:
+    QVERIFY(!StaticMarkerTiler::buildTileFile(fileName, latitudes, QVector<qreal>()));
+}
+
+QTEST_GUILESS_MAIN(TestStaticMarkerTiler)
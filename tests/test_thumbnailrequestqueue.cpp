@@ -0,0 +1,256 @@
+/** ===========================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  Test the KGeoMap::ThumbnailRequestQueue class
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "test_thumbnailrequestqueue.h"
+
+// local includes
+
+#include "staticmarkertiler.h"
+#include "thumbnailrequestqueue.h"
+
+using namespace KGeoMap;
+
+namespace
+{
+
+/**
+ * @brief Returns thumbnails for even marker ids right away, odd ones are "loaded in the background"
+ */
+class ThumbnailTiler : public StaticMarkerTiler
+{
+public:
+
+    QPixmap pixmapFromRepresentativeIndex(const QVariant& index, const QSize& size) override
+    {
+        const quint32 markerId = index.value<quint32>();
+        requestedIds << markerId;
+
+        if (markerId % 2)
+        {
+            return QPixmap();
+        }
+
+        QPixmap pixmap(size);
+        pixmap.fill(Qt::white);
+
+        return pixmap;
+    }
+
+    QList<quint32> requestedIds;
+};
+
+QVariant markerIndex(const quint32 markerId)
+{
+    return QVariant::fromValue(markerId);
+}
+
+void startQueue(ThumbnailRequestQueue* const queue, ThumbnailTiler* const tiler)
+{
+    queue->setMarkerModel(tiler);
+    queue->setFrameInterval(0);
+
+    QObject::connect(tiler, SIGNAL(signalThumbnailAvailableForIndex(QVariant,QPixmap)),
+                     queue, SLOT(slotThumbnailAvailableForIndex(QVariant,QPixmap)));
+}
+
+} /* anonymous namespace */
+
+void TestThumbnailRequestQueue::testNoOp()
+{
+}
+
+void TestThumbnailRequestQueue::testWithoutMarkerModel()
+{
+    ThumbnailRequestQueue queue;
+
+    // without a marker tiler, nothing is requested
+    queue.request(markerIndex(2), QSize(10, 10), 1);
+    QCOMPARE(queue.pendingCount(), 0);
+    QVERIFY(!queue.thumbnail(markerIndex(2), nullptr));
+}
+
+void TestThumbnailRequestQueue::testPriority()
+{
+    ThumbnailTiler tiler;
+    ThumbnailRequestQueue queue;
+    startQueue(&queue, &tiler);
+
+    QSignalSpy spy(&queue, SIGNAL(signalThumbnailsAvailable(QVariantList,QList<QPixmap>)));
+
+    queue.request(markerIndex(2), QSize(10, 10), 1);
+    queue.request(markerIndex(4), QSize(10, 10), 50);
+    queue.request(markerIndex(6), QSize(10, 10), 5);
+    QCOMPARE(queue.pendingCount(), 3);
+
+    // all thumbnails of the frame are announced together, the largest clusters first
+    QVERIFY(spy.wait());
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(tiler.requestedIds, QList<quint32>() << 4 << 6 << 2);
+    QCOMPARE(spy.at(0).at(0).toList().count(), 3);
+    QCOMPARE(queue.pendingCount(), 0);
+
+    QPixmap pixmap;
+    QVERIFY(queue.thumbnail(markerIndex(4), &pixmap));
+    QCOMPARE(pixmap.size(), QSize(10, 10));
+}
+
+void TestThumbnailRequestQueue::testDeduplication()
+{
+    ThumbnailTiler tiler;
+    ThumbnailRequestQueue queue;
+    startQueue(&queue, &tiler);
+
+    QSignalSpy spy(&queue, SIGNAL(signalThumbnailsAvailable(QVariantList,QList<QPixmap>)));
+
+    // requesting a marker twice keeps the higher priority
+    queue.request(markerIndex(2), QSize(10, 10), 1);
+    queue.request(markerIndex(4), QSize(10, 10), 5);
+    queue.request(markerIndex(2), QSize(10, 10), 10);
+    QCOMPARE(queue.pendingCount(), 2);
+
+    QVERIFY(spy.wait());
+    QCOMPARE(tiler.requestedIds, QList<quint32>() << 2 << 4);
+
+    // available thumbnails and thumbnails which are being loaded are not requested again
+    queue.request(markerIndex(2), QSize(10, 10), 1);
+    queue.request(markerIndex(3), QSize(10, 10), 1);
+    QCOMPARE(queue.pendingCount(), 1);
+
+    QTest::qWait(50);
+    QCOMPARE(queue.waitingCount(), 1);
+
+    queue.request(markerIndex(3), QSize(10, 10), 1);
+    QCOMPARE(queue.pendingCount(), 0);
+    QCOMPARE(tiler.requestedIds, QList<quint32>() << 2 << 4 << 3);
+}
+
+void TestThumbnailRequestQueue::testCancel()
+{
+    ThumbnailTiler tiler;
+    ThumbnailRequestQueue queue;
+    startQueue(&queue, &tiler);
+
+    queue.request(markerIndex(2), QSize(10, 10), 1);
+    queue.request(markerIndex(4), QSize(10, 10), 1);
+    queue.cancelPending();
+    QCOMPARE(queue.pendingCount(), 0);
+
+    QTest::qWait(50);
+    QVERIFY(tiler.requestedIds.isEmpty());
+    QCOMPARE(queue.storedCount(), 0);
+
+    queue.request(markerIndex(2), QSize(10, 10), 1);
+    QTest::qWait(50);
+    QCOMPARE(queue.storedCount(), 1);
+
+    // the stored thumbnails are dropped when they are no longer valid
+    queue.clear();
+    QCOMPARE(queue.storedCount(), 0);
+}
+
+void TestThumbnailRequestQueue::testRequestDuringReclustering()
+{
+    ThumbnailTiler tiler;
+    ThumbnailRequestQueue queue;
+    startQueue(&queue, &tiler);
+
+    QSignalSpy spy(&queue, SIGNAL(signalThumbnailsAvailable(QVariantList,QList<QPixmap>)));
+
+    // a request of the old clusters is dropped when the map is moved
+    queue.request(markerIndex(2), QSize(10, 10), 1);
+
+    // MapWidget::updateClusters(): the pending requests are canceled first, then the backend
+    // is told about the new clusters and requests their thumbnails while it draws them
+    const auto updateClusters = [&queue]()
+    {
+        queue.cancelPending();
+        queue.request(markerIndex(4), QSize(10, 10), 1);
+    };
+
+    updateClusters();
+    QCOMPARE(queue.pendingCount(), 1);
+
+    // the thumbnail requested during the update is delivered, so that the cluster can be redrawn
+    QVERIFY(spy.wait());
+    QCOMPARE(tiler.requestedIds, QList<quint32>() << 4);
+    QCOMPARE(spy.at(0).at(0).toList(), QVariantList() << markerIndex(4));
+    QVERIFY(queue.thumbnail(markerIndex(4), nullptr));
+    QVERIFY(!queue.thumbnail(markerIndex(2), nullptr));
+}
+
+void TestThumbnailRequestQueue::testWaitingTimeout()
+{
+    ThumbnailTiler tiler;
+    ThumbnailRequestQueue queue;
+    startQueue(&queue, &tiler);
+
+    queue.request(markerIndex(1), QSize(10, 10), 1);
+    QTest::qWait(50);
+    QCOMPARE(queue.waitingCount(), 1);
+
+    // canceling the pending requests does not ask the tiler again for thumbnails it is loading
+    queue.cancelPending();
+    QCOMPARE(queue.waitingCount(), 1);
+    queue.request(markerIndex(1), QSize(10, 10), 1);
+    QCOMPARE(queue.pendingCount(), 0);
+
+    // but once the thumbnail is overdue, it is requested again
+    queue.setWaitingTimeout(0);
+    queue.request(markerIndex(1), QSize(10, 10), 1);
+    QCOMPARE(queue.pendingCount(), 1);
+
+    QTest::qWait(50);
+    QCOMPARE(tiler.requestedIds, QList<quint32>() << 1 << 1);
+
+    queue.cancelPending();
+    QCOMPARE(queue.waitingCount(), 0);
+}
+
+void TestThumbnailRequestQueue::testBackgroundThumbnails()
+{
+    ThumbnailTiler tiler;
+    ThumbnailRequestQueue queue;
+    startQueue(&queue, &tiler);
+
+    QSignalSpy spy(&queue, SIGNAL(signalThumbnailsAvailable(QVariantList,QList<QPixmap>)));
+
+    queue.request(markerIndex(1), QSize(10, 10), 1);
+    queue.request(markerIndex(3), QSize(10, 10), 1);
+    QTest::qWait(50);
+    QCOMPARE(queue.waitingCount(), 2);
+    QCOMPARE(spy.count(), 0);
+
+    // thumbnails which the tiler emits later are announced together
+    QPixmap pixmap(10, 10);
+    pixmap.fill(Qt::white);
+    emit(tiler.signalThumbnailAvailableForIndex(markerIndex(1), pixmap));
+    emit(tiler.signalThumbnailAvailableForIndex(markerIndex(3), pixmap));
+
+    QVERIFY(spy.wait());
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.at(0).at(0).toList().count(), 2);
+    QCOMPARE(queue.waitingCount(), 0);
+    QVERIFY(queue.thumbnail(markerIndex(3), nullptr));
+}
+
+QTEST_MAIN(TestThumbnailRequestQueue)
@@ -0,0 +1,219 @@
+/** ===========================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-18
+ * @brief  Test the KGeoMap::TileDiskCache class
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "test_tilediskcache.h"
+
+// Qt includes
+
+#include <QFile>
+#include <QTemporaryDir>
+
+// local includes
+
+#include "backends/tilediskcache.h"
+
+using namespace KGeoMap;
+
+namespace
+{
+
+QByteArray readFile(const QString& filePath)
+{
+    QFile file(filePath);
+
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return QByteArray();
+    }
+
+    return file.readAll();
+}
+
+} /* anonymous namespace */
+
+void TestTileDiskCache::testNoOp()
+{
+}
+
+void TestTileDiskCache::testKeys()
+{
+    QVERIFY(TileDiskCache::isValidKey(QLatin1String("12/2105/1346")));
+    QVERIFY(TileDiskCache::isValidKey(QLatin1String("0/0/0.png")));
+    QVERIFY(!TileDiskCache::isValidKey(QString()));
+    QVERIFY(!TileDiskCache::isValidKey(QLatin1String("/12/2105/1346")));
+    QVERIFY(!TileDiskCache::isValidKey(QLatin1String("12/../1346")));
+    QVERIFY(!TileDiskCache::isValidKey(QLatin1String("12//1346")));
+    QVERIFY(!TileDiskCache::isValidKey(QLatin1String("12/2105/")));
+}
+
+void TestTileDiskCache::testInsertLookup()
+{
+    QTemporaryDir cacheDir;
+    QVERIFY(cacheDir.isValid());
+
+    TileDiskCache cache(cacheDir.path(), 1000);
+    QCOMPARE(cache.count(), 0);
+    QCOMPARE(cache.size(), qint64(0));
+    QVERIFY(cache.lookup(QLatin1String("1/0/0")).isEmpty());
+
+    const QByteArray tileData("tile 1/0/0");
+    QVERIFY(cache.insert(QLatin1String("1/0/0"), tileData));
+    QCOMPARE(cache.count(), 1);
+    QCOMPARE(cache.size(), qint64(tileData.size()));
+
+    const QString filePath = cache.lookup(QLatin1String("1/0/0"));
+    QVERIFY(!filePath.isEmpty());
+    QCOMPARE(readFile(filePath), tileData);
+
+    // replacing a tile does not count it twice
+    const QByteArray newTileData("new tile 1/0/0");
+    QVERIFY(cache.insert(QLatin1String("1/0/0"), newTileData));
+    QCOMPARE(cache.count(), 1);
+    QCOMPARE(cache.size(), qint64(newTileData.size()));
+    QCOMPARE(readFile(cache.lookup(QLatin1String("1/0/0"))), newTileData);
+
+    // invalid keys and tiles larger than the cache are rejected
+    QVERIFY(!cache.insert(QLatin1String("../outside"), tileData));
+    QVERIFY(!cache.insert(QLatin1String("1/0/1"), QByteArray(1001, 'x')));
+    QCOMPARE(cache.count(), 1);
+
+    cache.remove(QLatin1String("1/0/0"));
+    QCOMPARE(cache.count(), 0);
+    QCOMPARE(cache.size(), qint64(0));
+    QVERIFY(!QFile::exists(filePath));
+}
+
+void TestTileDiskCache::testEviction()
+{
+    QTemporaryDir cacheDir;
+    QVERIFY(cacheDir.isValid());
+
+    TileDiskCache cache(cacheDir.path(), 300);
+    const QByteArray tileData(100, 'x');
+
+    QVERIFY(cache.insert(QLatin1String("2/0/0"), tileData));
+    QVERIFY(cache.insert(QLatin1String("2/0/1"), tileData));
+    QVERIFY(cache.insert(QLatin1String("2/0/2"), tileData));
+    QCOMPARE(cache.size(), qint64(300));
+
+    // using 2/0/0 makes 2/0/1 the least recently used tile
+    QVERIFY(!cache.lookup(QLatin1String("2/0/0")).isEmpty());
+    QVERIFY(cache.insert(QLatin1String("2/0/3"), tileData));
+
+    QCOMPARE(cache.count(), 3);
+    QCOMPARE(cache.size(), qint64(300));
+    QVERIFY(cache.lookup(QLatin1String("2/0/1")).isEmpty());
+    QVERIFY(!cache.lookup(QLatin1String("2/0/0")).isEmpty());
+    QVERIFY(!cache.lookup(QLatin1String("2/0/2")).isEmpty());
+    QVERIFY(!cache.lookup(QLatin1String("2/0/3")).isEmpty());
+
+    // shrinking the cache evicts the least recently used tiles: 2/0/0 and 2/0/2
+    cache.setMaxSize(100);
+    QCOMPARE(cache.count(), 1);
+    QVERIFY(!cache.lookup(QLatin1String("2/0/3")).isEmpty());
+
+    cache.clear();
+    QCOMPARE(cache.count(), 0);
+    QCOMPARE(cache.size(), qint64(0));
+}
+
+void TestTileDiskCache::testReopen()
+{
+    QTemporaryDir cacheDir;
+    QVERIFY(cacheDir.isValid());
+
+    {
+        TileDiskCache cache(cacheDir.path(), 1000);
+        QVERIFY(cache.insert(QLatin1String("3/1/1"), QByteArray(100, 'a')));
+        QVERIFY(cache.insert(QLatin1String("3/1/2"), QByteArray(200, 'b')));
+    }
+
+    // the tiles are found again when the cache is opened
+    {
+        TileDiskCache cache(cacheDir.path(), 1000);
+        QCOMPARE(cache.count(), 2);
+        QCOMPARE(cache.size(), qint64(300));
+        QCOMPARE(readFile(cache.lookup(QLatin1String("3/1/2"))), QByteArray(200, 'b'));
+    }
+
+    // and evicted down to the size of the cache
+    {
+        TileDiskCache cache(cacheDir.path(), 250);
+        QCOMPARE(cache.count(), 1);
+        QVERIFY(cache.size() <= 250);
+    }
+}
+
+void TestTileDiskCache::testReopenUseOrder()
+{
+    QTemporaryDir cacheDir;
+    QVERIFY(cacheDir.isValid());
+
+    {
+        TileDiskCache cache(cacheDir.path(), 1000);
+        QVERIFY(cache.insert(QLatin1String("4/1/1"), QByteArray(100, 'a')));
+        QVERIFY(cache.insert(QLatin1String("4/1/2"), QByteArray(100, 'b')));
+    }
+
+    // make sure the modification time of the file changes, even on coarse file systems
+    QTest::qSleep(1100);
+
+    // using the older tile in one session makes it the most recently used one in the next
+    {
+        TileDiskCache cache(cacheDir.path(), 1000);
+        QCOMPARE(cache.count(), 2);
+        QVERIFY(!cache.lookup(QLatin1String("4/1/1")).isEmpty());
+    }
+
+    {
+        TileDiskCache cache(cacheDir.path(), 150);
+        QCOMPARE(cache.count(), 1);
+        QVERIFY(!cache.lookup(QLatin1String("4/1/1")).isEmpty());
+        QVERIFY(cache.lookup(QLatin1String("4/1/2")).isEmpty());
+    }
+}
+
+void TestTileDiskCache::testLookupDuringScan()
+{
+    QTemporaryDir cacheDir;
+    QVERIFY(cacheDir.isValid());
+
+    {
+        TileDiskCache cache(cacheDir.path(), 1000);
+        QVERIFY(cache.insert(QLatin1String("5/1/1"), QByteArray(100, 'a')));
+        QVERIFY(cache.insert(QLatin1String("5/1/2"), QByteArray(100, 'b')));
+    }
+
+    // tiles can be used and replaced right away, whether or not the scan is finished
+    TileDiskCache cache(cacheDir.path(), 1000);
+    QCOMPARE(readFile(cache.lookup(QLatin1String("5/1/1"))), QByteArray(100, 'a'));
+    QVERIFY(cache.insert(QLatin1String("5/1/2"), QByteArray(50, 'c')));
+    cache.remove(QLatin1String("5/1/1"));
+
+    QCOMPARE(cache.count(), 1);
+    QCOMPARE(cache.size(), qint64(50));
+    QVERIFY(cache.lookup(QLatin1String("5/1/1")).isEmpty());
+    QCOMPARE(readFile(cache.lookup(QLatin1String("5/1/2"))), QByteArray(50, 'c'));
+}
+
+QTEST_GUILESS_MAIN(TestTileDiskCache)
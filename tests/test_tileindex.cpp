@@ -23,6 +23,10 @@
 
 #include "test_tileindex.h"
 
+// C++ includes
+
+#include <cmath>
+
 // local includes
 
 #include "tileindex.h"
@@ -156,4 +160,163 @@ void TestTileIndex::testMovable()
 //     }
 }
 
+void TestTileIndex::testLatLonKeys()
+{
+    TileIndex i1;
+    i1.appendLatLonIndex(1, 2);
+    i1.appendLatLonIndex(3, 4);
+    i1.appendLatLonIndex(0, 9);
+
+    quint64 latKey = 0;
+    quint64 lonKey = 0;
+    i1.toLatLonKeys(&latKey, &lonKey);
+    QCOMPARE(latKey, quint64(130));
+    QCOMPARE(lonKey, quint64(249));
+
+    const TileIndex i2 = TileIndex::fromLatLonKeys(latKey, lonKey, i1.level());
+    QCOMPARE(i2.indexCount(), i1.indexCount());
+    QVERIFY(TileIndex::indicesEqual(i1, i2, i1.level()));
+
+    // dropping the last digit gives the parent tile
+    const TileIndex i3 = TileIndex::fromLatLonKeys(latKey / TileIndex::Tiling, lonKey / TileIndex::Tiling, 1);
+    QVERIFY(TileIndex::indicesEqual(i1, i3, 1));
+}
+
+void TestTileIndex::testKeysFromCoordinates()
+{
+    QVector<qreal> latitudes;
+    QVector<qreal> longitudes;
+
+    // borders of the map and values outside of it
+    const qreal specialValues[] = { -1000.0, -180.0, -90.0, -89.9999999999, -0.0, 0.0,
+                                    1.8e-8, 45.000000018, 89.9999999999, 90.0, 179.9999999999, 180.0, 1000.0, 1e12 };
+
+    for (const qreal lat : specialValues)
+    {
+        for (const qreal lon : specialValues)
+        {
+            latitudes  << lat;
+            longitudes << lon;
+        }
+    }
+
+    // tile borders, where rounding errors are most likely to show
+    for (int i = 0; i <= 10000; ++i)
+    {
+        latitudes  << -90.0 + 180.0 * i / 10000;
+        longitudes << -180.0 + 360.0 * i / 10000;
+    }
+
+    qsrand(1);
+
+    for (int i = 0; i < 100000; ++i)
+    {
+        latitudes  << -90.0 + 180.0 * qreal(qrand()) / RAND_MAX;
+        longitudes << -180.0 + 360.0 * qreal(qrand()) / RAND_MAX;
+    }
+
+    // an odd number of coordinates also exercises the scalar tail of the vectorized paths
+    latitudes  << 12.34;
+    longitudes << -56.78;
+    QVERIFY(latitudes.count() % 2 == 1);
+
+    QVector<quint64> latKeys(latitudes.count());
+    QVector<quint64> lonKeys(latitudes.count());
+
+    for (const int level : { 0, int(TileIndex::DefaultMaxLevel), int(TileIndex::MaxLevel) })
+    {
+        TileIndex::keysFromCoordinates(latitudes.constData(), longitudes.constData(), latitudes.count(), level,
+                                       latKeys.data(), lonKeys.data());
+
+        for (int i = 0; i < latitudes.count(); ++i)
+        {
+            const TileIndex tileIndex = TileIndex::fromCoordinates(GeoCoordinates(latitudes.at(i), longitudes.at(i)),
+                                                                   level);
+            quint64 latKey = 0;
+            quint64 lonKey = 0;
+            tileIndex.toLatLonKeys(&latKey, &lonKey);
+
+            QCOMPARE(latKeys.at(i), latKey);
+            QCOMPARE(lonKeys.at(i), lonKey);
+        }
+    }
+
+    // the batch function also has to work on unaligned data of any length
+    for (int count = 0; count <= 9; ++count)
+    {
+        QVector<quint64> shiftedLatKeys(count);
+        QVector<quint64> shiftedLonKeys(count);
+        TileIndex::keysFromCoordinates(latitudes.constData() + 1, longitudes.constData() + 1, count,
+                                       TileIndex::MaxLevel, shiftedLatKeys.data(), shiftedLonKeys.data());
+
+        for (int i = 0; i < count; ++i)
+        {
+            QCOMPARE(shiftedLatKeys.at(i), latKeys.at(i + 1));
+            QCOMPARE(shiftedLonKeys.at(i), lonKeys.at(i + 1));
+        }
+    }
+}
+
+void TestTileIndex::testCoordinatesRoundTrip()
+{
+    // the corners of the map are exact
+    TileIndex lastTile;
+    TileIndex firstTile;
+
+    for (int l = 0; l <= TileIndex::MaxLevel; ++l)
+    {
+        lastTile.appendLatLonIndex(TileIndex::Tiling - 1, TileIndex::Tiling - 1);
+        firstTile.appendLatLonIndex(0, 0);
+
+        QCOMPARE(firstTile.toCoordinates().lat(), -90.0);
+        QCOMPARE(firstTile.toCoordinates().lon(), -180.0);
+        QCOMPARE(lastTile.toCoordinates(TileIndex::CornerSE).lat(), 90.0);
+        QCOMPARE(lastTile.toCoordinates(TileIndex::CornerSE).lon(), 180.0);
+
+        QVERIFY(TileIndex::indicesEqual(TileIndex::fromCoordinates(GeoCoordinates(90.0, 180.0), l), lastTile, l));
+        QVERIFY(TileIndex::indicesEqual(TileIndex::fromCoordinates(GeoCoordinates(-90.0, -180.0), l), firstTile, l));
+    }
+
+    qsrand(2);
+
+    for (int i = 0; i < 10000; ++i)
+    {
+        TileIndex tileIndex;
+        const int level = qrand() % TileIndex::MaxIndexCount;
+
+        for (int l = 0; l <= level; ++l)
+        {
+            tileIndex.appendLinearIndex(qrand() % TileIndex::MaxLinearIndex);
+        }
+
+        // a tile contains its own corner...
+        const GeoCoordinates corner = tileIndex.toCoordinates();
+        QVERIFY(TileIndex::indicesEqual(TileIndex::fromCoordinates(corner, level), tileIndex, level));
+
+        // neighboring tiles share their borders exactly
+        quint64 latKey = 0;
+        quint64 lonKey = 0;
+        tileIndex.toLatLonKeys(&latKey, &lonKey);
+
+        if ( (latKey % TileIndex::Tiling != TileIndex::Tiling - 1) &&
+             (lonKey % TileIndex::Tiling != TileIndex::Tiling - 1) )
+        {
+            const TileIndex neighbor = TileIndex::fromLatLonKeys(latKey + 1, lonKey + 1, level);
+            QCOMPARE(neighbor.toCoordinates().lat(), tileIndex.toCoordinates(TileIndex::CornerSE).lat());
+            QCOMPARE(neighbor.toCoordinates().lon(), tileIndex.toCoordinates(TileIndex::CornerSE).lon());
+            QCOMPARE(neighbor.toCoordinates().lat(), tileIndex.toCoordinates(TileIndex::CornerSW).lat());
+            QCOMPARE(neighbor.toCoordinates().lon(), tileIndex.toCoordinates(TileIndex::CornerNE).lon());
+        }
+
+        // ... but not the point just below it
+        if ((latKey > 0) && (corner.lat() > -90.0))
+        {
+            const GeoCoordinates below(std::nextafter(corner.lat(), -90.0), corner.lon());
+            const TileIndex belowIndex = TileIndex::fromCoordinates(below, level);
+            QCOMPARE(belowIndex.indexLon(level), tileIndex.indexLon(level));
+            QVERIFY(!TileIndex::indicesEqual(belowIndex, tileIndex, level));
+        }
+    }
+}
+
 QTEST_GUILESS_MAIN(TestTileIndex)
@@ -39,6 +39,9 @@ private Q_SLOTS:
     void testIntListInteraction();
     void testResizing();
     void testMovable();
+    void testLatLonKeys();
+    void testKeysFromCoordinates();
+    void testCoordinatesRoundTrip();
 };
 
 #endif /* TEST_TILEINDEX_H */
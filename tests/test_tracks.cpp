@@ -27,6 +27,7 @@
 #include <QDateTime>
 #include <QtTest>
 #include <QDebug>
+#include <QtMath>
 
 // KDE includes
 
@@ -214,3 +215,89 @@ void TestTracks::testSaxLoaderError()
         qDebug() << fileData.loadError;
     }
 }
+
+/**
+ * @brief Test the Douglas-Peucker hierarchy used to draw tracks at low zoom levels
+ */
+void TestTracks::testTrackSimplification()
+{
+    // a straight line along the equator with one peak
+    const qreal lats[] = { 0.0, 0.0, 0.0, 1.0, 0.0 };
+
+    TrackManager::Track track;
+
+    for (int i = 0; i < 5; ++i)
+    {
+        TrackManager::TrackPoint point;
+        point.coordinates = GeoCoordinates(lats[i], i);
+        track.points << point;
+    }
+
+    // without tolerances, all points are used
+    QCOMPARE(TrackManager::simplifiedPointIndices(track, 10.0), QList<int>() << 0 << 1 << 2 << 3 << 4);
+
+    track.pointTolerances = TrackManager::computePointTolerances(track.points);
+    QCOMPARE(track.pointTolerances.count(), 5);
+    QCOMPARE(track.pointTolerances.at(1), 0.0);
+    QCOMPARE(track.pointTolerances.at(2), qSqrt(0.4));
+    QCOMPARE(track.pointTolerances.at(3), 1.0);
+
+    QCOMPARE(TrackManager::simplifiedPointIndices(track, -1.0), QList<int>() << 0 << 1 << 2 << 3 << 4);
+    QCOMPARE(TrackManager::simplifiedPointIndices(track, 0.0),  QList<int>() << 0 << 2 << 3 << 4);
+    QCOMPARE(TrackManager::simplifiedPointIndices(track, 0.7),  QList<int>() << 0 << 3 << 4);
+    QCOMPARE(TrackManager::simplifiedPointIndices(track, 2.0),  QList<int>() << 0 << 4);
+
+    QVERIFY(TrackManager::computePointTolerances(TrackManager::TrackPoint::List()).isEmpty());
+}
+
+/**
+ * @brief Test splitting tracks into segments and looking up the segments in a region
+ */
+void TestTracks::testTrackSegments()
+{
+    TrackManager::TrackPoint::List points;
+
+    for (int i = 0; i < 600; ++i)
+    {
+        TrackManager::TrackPoint point;
+        point.coordinates = GeoCoordinates(i * 0.01, -i * 0.01);
+        points << point;
+    }
+
+    const TrackManager::TrackSegment::List segments = TrackManager::computeSegments(points);
+    QCOMPARE(segments.count(), 3);
+    QCOMPARE(segments.at(0).firstPoint, 0);
+    QCOMPARE(segments.at(0).lastPoint, 256);
+    QCOMPARE(segments.at(1).firstPoint, 256);
+    QCOMPARE(segments.at(2).lastPoint, 599);
+    QCOMPARE(segments.at(1).latMin, 2.56);
+    QCOMPARE(segments.at(1).latMax, 5.12);
+    QCOMPARE(segments.at(1).lonMin, -5.12);
+    QCOMPARE(segments.at(1).lonMax, -2.56);
+
+    QVERIFY(segments.at(1).intersects(GeoCoordinates::makePair(5.0, -3.0, 6.0, -2.0)));
+    QVERIFY(!segments.at(1).intersects(GeoCoordinates::makePair(5.5, -3.0, 6.0, -2.0)));
+    QVERIFY(TrackManager::computeSegments(points.mid(0, 1)).isEmpty());
+
+    // look up the segments of a loaded track
+    const QUrl testDataDir = GetTestDataDirectory();
+    TrackManager myParser;
+    QSignalSpy spyAllDone(&myParser, SIGNAL(signalAllTrackFilesReady()));
+
+    myParser.loadTrackFiles(QList<QUrl>() << testDataDir.resolved(QUrl(QString::fromLatin1("gpxfile-1.gpx"))));
+
+    while (spyAllDone.isEmpty())
+    {
+        QTest::qWait(100);
+    }
+
+    const QList<TrackManager::SegmentReference> allSegments = QList<TrackManager::SegmentReference>()
+                                                              << TrackManager::SegmentReference(0, 0);
+
+    QCOMPARE(myParser.segmentsInRegions(GeoCoordinates::PairList() << GeoCoordinates::makePair(-90.0, -180.0, 90.0, 180.0)), allSegments);
+    QCOMPARE(myParser.segmentsInRegions(GeoCoordinates::PairList() << GeoCoordinates::makePair(15.5, 3.0, 15.6, 3.1)), allSegments);
+    QCOMPARE(myParser.segmentsInRegions(GeoCoordinates::PairList() << GeoCoordinates::makePair(14.0, 0.0, 15.0, 1.0)
+                                                                   << GeoCoordinates::makePair(17.0, 6.0, 18.0, 7.0)), allSegments);
+    QVERIFY(myParser.segmentsInRegions(GeoCoordinates::PairList() << GeoCoordinates::makePair(-10.0, 3.0, -5.0, 4.0)).isEmpty());
+    QVERIFY(myParser.segmentsInRegions(GeoCoordinates::PairList()).isEmpty());
+}
@@ -43,6 +43,8 @@ private Q_SLOTS:
     void testSaxLoader();
     void testSaxLoaderError();
     void testFileLoading();
+    void testTrackSimplification();
+    void testTrackSegments();
 };
 
 #endif /* TEST_TRACKS_H */
@@ -0,0 +1,171 @@
+/** ===========================================================
+ * @file
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * @date   2016-10-02
+ * @brief  A tool to precompute tile files for KGeoMap::StaticMarkerTiler
+ *
+ * @author Copyright (C) 2010-2016 by Gilles Caulier
+ *         <a href="mailto:caulier dot gilles at gmail dot com">caulier dot gilles at gmail dot com</a>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+// Qt includes
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QRegularExpression>
+#include <QTextStream>
+#include <QtNumeric>
+
+// local includes
+
+#include "staticmarkertiler.h"
+
+using namespace KGeoMap;
+
+namespace
+{
+    QTextStream qout(stdout);
+    QTextStream qerr(stderr);
+}
+
+/**
+ * @brief Read the coordinates of the markers from a text file
+ *
+ * Each line contains the latitude and the longitude of one marker, separated by
+ * whitespace, a comma or a semicolon. Empty lines and lines starting with '#' are skipped.
+ * The id of a marker is the number of the data line it was read from, starting at zero.
+ * Lines which can not be parsed keep their id, but are not added to the tiles.
+ */
+bool readCoordinates(QIODevice* const device, QVector<qreal>* const latitudes, QVector<qreal>* const longitudes)
+{
+    QTextStream stream(device);
+    const QRegularExpression separator(QLatin1String("[\\s,;]+"));
+    int lineNumber = 0;
+
+    while (!stream.atEnd())
+    {
+        const QString line = stream.readLine().trimmed();
+        ++lineNumber;
+
+        if (line.isEmpty() || line.startsWith(QLatin1Char('#')))
+            continue;
+
+        const QStringList parts = line.split(separator, QString::SkipEmptyParts);
+        bool okay               = (parts.count() >= 2);
+        qreal lat               = qQNaN();
+        qreal lon               = qQNaN();
+
+        if (okay)
+        {
+            bool okayLon = false;
+            lat          = parts.at(0).toDouble(&okay);
+            lon          = parts.at(1).toDouble(&okayLon);
+            okay         = okay && okayLon && (qAbs(lat) <= 90.0) && (qAbs(lon) <= 180.0);
+        }
+
+        if (!okay)
+        {
+            qerr << QString::fromLatin1("Skipping invalid line %1: %2").arg(lineNumber).arg(line) << endl;
+            lat = qQNaN();
+            lon = qQNaN();
+        }
+
+        *latitudes  << lat;
+        *longitudes << lon;
+    }
+
+    return stream.status() == QTextStream::Ok;
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QString::fromLatin1("kgeomap_tilebuilder"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QString::fromLatin1("Precomputes the tile pyramid of a read-only set of markers "
+                                                         "for use with KGeoMap::StaticMarkerTiler."));
+    parser.addHelpOption();
+
+    const QCommandLineOption maxLevelOption(QStringList() << QString::fromLatin1("l") << QString::fromLatin1("max-level"),
+                                            QString::fromLatin1("Deepest tile level to store, from 0 to %1.").arg(int(TileIndex::MaxLevel)),
+                                            QString::fromLatin1("level"),
+                                            QString::number(int(TileIndex::DefaultMaxLevel)));
+    parser.addOption(maxLevelOption);
+    parser.addPositionalArgument(QString::fromLatin1("input"),
+                                 QString::fromLatin1("Text file with one 'latitude longitude' pair per line, '-' for stdin."));
+    parser.addPositionalArgument(QString::fromLatin1("output"),
+                                 QString::fromLatin1("Tile file to write."));
+    parser.process(app);
+
+    const QStringList arguments = parser.positionalArguments();
+
+    bool maxLevelOkay  = false;
+    const int maxLevel = parser.value(maxLevelOption).toInt(&maxLevelOkay);
+
+    if ((arguments.count() != 2) || !maxLevelOkay)
+    {
+        parser.showHelp(1);
+    }
+
+    QFile inputFile;
+    bool inputOpened = false;
+
+    if (arguments.at(0) == QLatin1String("-"))
+    {
+        inputOpened = inputFile.open(stdin, QIODevice::ReadOnly);
+    }
+    else
+    {
+        inputFile.setFileName(arguments.at(0));
+        inputOpened = inputFile.open(QIODevice::ReadOnly);
+    }
+
+    if (!inputOpened)
+    {
+        qerr << QString::fromLatin1("Could not open %1: %2").arg(arguments.at(0)).arg(inputFile.errorString()) << endl;
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QVector<qreal> latitudes;
+    QVector<qreal> longitudes;
+
+    if (!readCoordinates(&inputFile, &latitudes, &longitudes))
+    {
+        qerr << QString::fromLatin1("Could not read %1").arg(arguments.at(0)) << endl;
+        return 1;
+    }
+
+    qout << QString::fromLatin1("Read %1 markers in %2 ms").arg(latitudes.count()).arg(timer.restart()) << endl;
+
+    QString errorString;
+
+    if (!StaticMarkerTiler::buildTileFile(arguments.at(1), latitudes, longitudes, maxLevel, &errorString))
+    {
+        qerr << errorString << endl;
+        return 1;
+    }
+
+    qout << QString::fromLatin1("Wrote %1 in %2 ms").arg(arguments.at(1)).arg(timer.elapsed()) << endl;
+
+    return 0;
+}